@@ -0,0 +1,102 @@
+#include "AppConfig.hpp"
+#include "Erosion.hpp"
+#include "HeightfieldFilters.hpp"
+#include "TerrainGraph.hpp"
+
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+/// Benchmarks of the CPU stages of the terrain pipeline. No window or OpenGL context is needed.
+/// Usage: terrainBenchmark [name filter] [size]
+/// @author SD
+
+namespace {
+
+struct Benchmark {
+   std::string name;
+   std::string unit; // what one "item" of the throughput is
+   std::function<double(perlin::matrix&)> run; // returns the number of processed items
+};
+
+/// @brief The default terrain of the application, generated through the node graph
+perlin::matrix defaultTerrain(const unsigned size) {
+   std::vector<std::pair<unsigned, double>> paramsNoise{std::make_pair(720, 30), std::make_pair(360, 250), std::make_pair(180, 50),
+                                                        std::make_pair(90, 50), std::make_pair(45, 20), std::make_pair(12, 5), std::make_pair(8, 2), std::make_pair(3, 1)};
+   std::vector<std::pair<unsigned, double>> filterParams{std::make_pair(180, 2), std::make_pair(120, 2), std::make_pair(60, 2), std::make_pair(30, 1)};
+   std::vector<perlin::vec2d> gradients(128);
+   for (auto& vec : gradients) {
+      vec = perlin::random2DGrad();
+   }
+   TerrainGraph graph = TerrainGraph::fromLayers(size, size, paramsNoise, filterParams, 2.0);
+   graph.setGradients(gradients, 42);
+   return graph.evaluate();
+}
+
+std::vector<Benchmark> benchmarks() {
+   std::vector<Benchmark> list;
+   const std::pair<const char*, perlin::WarpParams> layers[] = {{"layerFill", perlin::WarpParams{}}, {"warpedLayerFill", perlin::WarpParams{200, 40.0}}};
+   for (const auto& [name, warp] : layers) {
+      list.push_back({name, "cells", [warp = warp](perlin::matrix& heights) {
+                         std::vector<perlin::vec2d> gradients(128);
+                         for (auto& vec : gradients) {
+                            vec = perlin::random2DGrad();
+                         }
+                         perlin::PerlinLayer layer(heights.size(), heights[0].size(), 90, 1.0, warp);
+                         layer.fill(gradients);
+                         return double(heights.size() * heights[0].size());
+                      }});
+   }
+   list.push_back({"hydraulicErosion", "droplets", [](perlin::matrix& heights) {
+                      perlin::HydraulicErosionParams params;
+                      params.enabled = true;
+                      params.droplets = 1000000;
+                      return double(perlin::hydraulicErosion(heights, params));
+                   }});
+   list.push_back({"thermalErosion", "iterations", [](perlin::matrix& heights) {
+                      perlin::ThermalErosionParams params;
+                      params.enabled = true;
+                      params.iterations = 100;
+                      return double(perlin::thermalErosion(heights, params));
+                   }});
+   const std::pair<const char*, perlin::SmoothingFilter> filters[] = {{"smoothGaussian", perlin::SmoothingFilter::GAUSSIAN},
+                                                                      {"smoothMedian", perlin::SmoothingFilter::MEDIAN},
+                                                                      {"smoothSlopeLimited", perlin::SmoothingFilter::SLOPE_LIMITED}};
+   for (const auto& [name, filter] : filters) {
+      list.push_back({name, "iterations", [filter = filter](perlin::matrix& heights) {
+                         perlin::SmoothingParams params;
+                         params.enabled = true;
+                         params.filter = filter;
+                         params.iterations = 100;
+                         return double(perlin::smooth(heights, params));
+                      }});
+   }
+   return list;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+   const std::string filter = argc > 1 ? argv[1] : "";
+   const unsigned size = argc > 2 ? std::stoul(argv[2]) : 1440;
+   perlin::AppConfig::initialize(42);
+
+   std::cout << "Generating " << size << "x" << size << " terrain\n";
+   const perlin::matrix terrain = defaultTerrain(size);
+
+   for (const auto& benchmark : benchmarks()) {
+      if (benchmark.name.find(filter) == std::string::npos) {
+         continue;
+      }
+      perlin::matrix heights = terrain; // every benchmark starts from the same heightfield
+      auto start = std::chrono::high_resolution_clock::now();
+      const double items = benchmark.run(heights);
+      auto end = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double> seconds = end - start;
+      std::cout << std::left << std::setw(24) << benchmark.name << std::right << std::setw(10) << std::fixed << std::setprecision(3) << seconds.count()
+                << " s" << std::setw(16) << std::setprecision(0) << items / seconds.count() << " " << benchmark.unit << "/s\n";
+   }
+   return 0;
+}
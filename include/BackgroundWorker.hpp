@@ -0,0 +1,44 @@
+#ifndef BACKGROUND_WORKER_CLASS_HPP
+#define BACKGROUND_WORKER_CLASS_HPP
+
+#include "CancelToken.hpp"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * One background thread running submitted jobs one after the other, the newest job always wins:
+ * submitting replaces the job waiting so far (if any) and cancels the running one through its CancelToken.
+ * Jobs poll the token and stop early by throwing perlin::Cancelled, other exceptions are reported and dropped.
+ * @author SD
+ */
+class BackgroundWorker {
+   public:
+   BackgroundWorker();
+   /// @brief Cancels the running job and waits for it, a waiting one is dropped
+   ~BackgroundWorker();
+
+   BackgroundWorker(const BackgroundWorker&) = delete;
+   BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+
+   /// @brief Run the job as soon as the running one stopped, instead of the job waiting so far (if any)
+   /// @param job Receives the token which is cancelled when a newer job is submitted
+   void submit(std::function<void(const perlin::CancelToken&)> job);
+
+   /// @brief Whether a job is running or waiting
+   bool isBusy() const;
+
+   private:
+   mutable std::mutex mutex;
+   std::condition_variable wake;
+   std::function<void(const perlin::CancelToken&)> waiting; // empty if there is none
+   perlin::CancelToken runningToken; // of the running job
+   bool running = false;
+   bool stopping = false;
+   std::thread thread; // last, so it starts after the other members are initialized
+
+   void run();
+};
+
+#endif // BACKGROUND_WORKER_CLASS_HPP
@@ -0,0 +1,49 @@
+#ifndef PERLIN_CANCEL_TOKEN_HPP
+#define PERLIN_CANCEL_TOKEN_HPP
+
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace perlin {
+
+/// @brief Thrown by CancelToken::check when the job was cancelled
+struct Cancelled : std::exception {
+   const char* what() const noexcept override {
+      return "cancelled";
+   }
+};
+
+/// @brief Flag shared between a running job and the code starting it, polled by the job between chunks of work.
+/// Copies refer to the same flag. A default constructed token is never cancelled and costs nothing to poll.
+class CancelToken {
+   public:
+   CancelToken() = default;
+
+   /// @brief New token which can be cancelled
+   static CancelToken create() {
+      CancelToken token;
+      token.flag = std::make_shared<std::atomic<bool>>(false);
+      return token;
+   }
+
+   void cancel() const {
+      if (flag) flag->store(true, std::memory_order_relaxed);
+   }
+
+   bool isCancelled() const {
+      return flag && flag->load(std::memory_order_relaxed);
+   }
+
+   /// @throws Cancelled if the token was cancelled
+   void check() const {
+      if (isCancelled()) throw Cancelled();
+   }
+
+   private:
+   std::shared_ptr<std::atomic<bool>> flag;
+};
+
+} // namespace perlin
+
+#endif // PERLIN_CANCEL_TOKEN_HPP
@@ -0,0 +1,43 @@
+#ifndef EROSION_HPP
+#define EROSION_HPP
+
+#include "PerlinUtils.hpp"
+
+namespace perlin {
+
+/// @brief Parameters of the particle-based hydraulic erosion
+/// @note Heights are interpreted in the units of the mesh, where the whole terrain is 1.0 wide, and scaled to the
+/// heights per cell the defaults are tuned for. Droplets leaving the grid take their sediment with them.
+struct HydraulicErosionParams {
+   bool enabled = false;
+   unsigned droplets = 500000; // total number of simulated droplets
+   unsigned seed = 1; // droplet start positions
+   unsigned maxLifetime = 30; // maximal number of steps of a droplet, each step moves one cell
+   unsigned radius = 3; // radius of the erosion brush in cells
+   double inertia = 0.05; // how much a droplet keeps its direction, in [0, 1]
+   double sedimentCapacity = 4.0; // multiplier for how much sediment a droplet can carry
+   double minSedimentCapacity = 0.01; // prevents the capacity from dropping to 0 on flat terrain
+   double erodeSpeed = 0.3; // fraction of the free capacity eroded per step, in [0, 1]
+   double depositSpeed = 0.3; // fraction of the excess sediment deposited per step, in [0, 1]
+   double evaporateSpeed = 0.01; // fraction of water lost per step, in [0, 1]
+   double gravity = 4.0;
+};
+
+/**
+ * Simulates water droplets flowing down the heightfield, eroding material on the way and depositing it where they slow down.
+ *
+ * The grid is split into square tiles that are at least twice as wide as the furthest a droplet can travel.
+ * Tiles are processed in four phases like a checkerboard, so that tiles of the same phase never touch the same cells
+ * and can be simulated on separate threads without locks. Every tile draws its droplets from its own random stream,
+ * therefore the result only depends on the parameters and the seed, not on the number of threads.
+ *
+ * @param heights heightfield, indexed heights[x][y], modified in place
+ * @param params erosion parameters
+ * @return number of droplets simulated
+ * @author SD
+ */
+unsigned long hydraulicErosion(matrix& heights, const HydraulicErosionParams& params);
+
+} // namespace perlin
+
+#endif // EROSION_HPP
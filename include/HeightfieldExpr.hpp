@@ -0,0 +1,353 @@
+#ifndef HEIGHTFIELD_EXPR_HPP
+#define HEIGHTFIELD_EXPR_HPP
+
+#include "Parallel.hpp"
+#include "PerlinUtils.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+/// Lazy expression templates over heightfields (perlin::matrix).
+/// An expression like `hf::max(hf::field(a), hf::field(b)) / 2.0` does not compute anything by itself,
+/// it only records the operations. The work happens in hf::assign / hf::evaluate, which run all
+/// chained operations in a single pass over the rows, without intermediate matrices.
+/// Inner loops read each operand row contiguously, so the compiler can vectorize them.
+/// @author SD
+namespace perlin::hf {
+
+/// @brief CRTP base of all heightfield expressions
+template <typename Derived>
+struct Expr {
+   const Derived& self() const { return static_cast<const Derived&>(*this); }
+};
+
+template <typename T>
+using is_expr = std::is_base_of<Expr<T>, T>;
+
+// --- Leaves ---
+
+/// @brief Reference to an existing matrix. The matrix must outlive the expression.
+class Field : public Expr<Field> {
+   public:
+   explicit Field(const matrix& m) : m(m) {}
+
+   std::size_t rows() const { return m.size(); }
+   std::size_t cols() const { return m.empty() ? 0 : m[0].size(); }
+
+   /// @brief Row evaluator: anything with operator[](column)
+   const double* row(std::size_t i) const { return m[i].data(); }
+
+   private:
+   const matrix& m;
+};
+
+/// @brief Matrix of 16-bit codes standing for offset + scale * code, decoded on the fly while the row is read.
+/// The codes must outlive the expression.
+class Quantized : public Expr<Quantized> {
+   public:
+   struct Row {
+      const std::uint16_t* codes;
+      double offset, scale;
+      double operator[](std::size_t j) const { return offset + scale * codes[j]; }
+   };
+
+   Quantized(const std::vector<std::vector<std::uint16_t>>& codes, double offset, double scale) : codes(codes), offset(offset), scale(scale) {}
+
+   std::size_t rows() const { return codes.size(); }
+   std::size_t cols() const { return codes.empty() ? 0 : codes[0].size(); }
+   Row row(std::size_t i) const { return Row{codes[i].data(), offset, scale}; }
+
+   private:
+   const std::vector<std::vector<std::uint16_t>>& codes;
+   double offset, scale;
+};
+
+/// @brief Scalar broadcast to every element. Has no shape of its own (0 x 0).
+class Constant : public Expr<Constant> {
+   public:
+   struct Row {
+      double value;
+      double operator[](std::size_t) const { return value; }
+   };
+
+   explicit Constant(double value) : value(value) {}
+
+   std::size_t rows() const { return 0; }
+   std::size_t cols() const { return 0; }
+   Row row(std::size_t) const { return Row{value}; }
+
+   private:
+   double value;
+};
+
+// --- Composite nodes ---
+
+/// @brief Check an operand of a node of the given shape, scalars (0 x 0) fit any shape
+/// @throws std::runtime_error if the operand has another shape
+template <typename E>
+void requireShape(const E& e, std::size_t rows, std::size_t cols) {
+   if ((e.rows() != 0 || e.cols() != 0) && (e.rows() != rows || e.cols() != cols)) {
+      throw std::runtime_error("Dimension mismatch between heightfield operands.");
+   }
+}
+
+/// @brief Element-wise application of a unary functor
+template <typename Op, typename A>
+class Unary : public Expr<Unary<Op, A>> {
+   public:
+   using ARow = decltype(std::declval<const A&>().row(0));
+   struct Row {
+      ARow a;
+      Op op;
+      double operator[](std::size_t j) const { return op(a[j]); }
+   };
+
+   Unary(const A& a, Op op) : a(a), op(op) {}
+
+   std::size_t rows() const { return a.rows(); }
+   std::size_t cols() const { return a.cols(); }
+   Row row(std::size_t i) const { return Row{a.row(i), op}; }
+
+   private:
+   A a;
+   Op op;
+};
+
+/// @brief Element-wise application of a binary functor
+template <typename Op, typename A, typename B>
+class Binary : public Expr<Binary<Op, A, B>> {
+   public:
+   using ARow = decltype(std::declval<const A&>().row(0));
+   using BRow = decltype(std::declval<const B&>().row(0));
+   struct Row {
+      ARow a;
+      BRow b;
+      Op op;
+      double operator[](std::size_t j) const { return op(a[j], b[j]); }
+   };
+
+   /// @throws std::runtime_error if the operands have different shapes (and neither is a scalar)
+   Binary(const A& a, const B& b, Op op) : a(a), b(b), op(op) {
+      requireShape(a, rows(), cols());
+      requireShape(b, rows(), cols());
+   }
+
+   std::size_t rows() const { return std::max(a.rows(), b.rows()); }
+   std::size_t cols() const { return std::max(a.cols(), b.cols()); }
+   Row row(std::size_t i) const { return Row{a.row(i), b.row(i), op}; }
+
+   private:
+   A a;
+   B b;
+   Op op;
+};
+
+/// @brief Linear blend a + mask * (b - a), the same interpolation as perlin::lerp
+template <typename A, typename B, typename M>
+class Blend : public Expr<Blend<A, B, M>> {
+   public:
+   using ARow = decltype(std::declval<const A&>().row(0));
+   using BRow = decltype(std::declval<const B&>().row(0));
+   using MRow = decltype(std::declval<const M&>().row(0));
+   struct Row {
+      ARow a;
+      BRow b;
+      MRow m;
+      double operator[](std::size_t j) const {
+         const double x = a[j];
+         return x + m[j] * (b[j] - x);
+      }
+   };
+
+   /// @throws std::runtime_error if the operands have different shapes (and none is a scalar)
+   Blend(const A& a, const B& b, const M& m) : a(a), b(b), m(m) {
+      requireShape(a, rows(), cols());
+      requireShape(b, rows(), cols());
+      requireShape(m, rows(), cols());
+   }
+
+   std::size_t rows() const { return std::max({a.rows(), b.rows(), m.rows()}); }
+   std::size_t cols() const { return std::max({a.cols(), b.cols(), m.cols()}); }
+   Row row(std::size_t i) const { return Row{a.row(i), b.row(i), m.row(i)}; }
+
+   private:
+   A a;
+   B b;
+   M m;
+};
+
+// --- Functors ---
+
+namespace op {
+struct Plus {
+   double operator()(double a, double b) const { return a + b; }
+};
+struct Minus {
+   double operator()(double a, double b) const { return a - b; }
+};
+struct Multiply {
+   double operator()(double a, double b) const { return a * b; }
+};
+struct Divide {
+   double operator()(double a, double b) const { return a / b; }
+};
+struct Max {
+   double operator()(double a, double b) const { return std::max(a, b); }
+};
+struct Min {
+   double operator()(double a, double b) const { return std::min(a, b); }
+};
+struct Clamp {
+   double lo, hi;
+   double operator()(double x) const { return std::min(std::max(x, lo), hi); }
+};
+struct Remap {
+   double fromLo, fromRange, toLo, toRange;
+   double operator()(double x) const { return toLo + toRange * (x - fromLo) / fromRange; }
+};
+} // namespace op
+
+// --- Construction helpers ---
+
+inline Field field(const matrix& m) { return Field(m); }
+inline Constant constant(double value) { return Constant(value); }
+inline Quantized quantized(const std::vector<std::vector<std::uint16_t>>& codes, double offset, double scale) {
+   return Quantized(codes, offset, scale);
+}
+
+/// @brief Pass expressions through, wrap scalars into a Constant
+template <typename T, typename = std::enable_if_t<is_expr<T>::value>>
+const T& asExpr(const T& e) { return e; }
+inline Constant asExpr(double value) { return Constant(value); }
+
+template <typename T>
+using ExprOf = std::decay_t<decltype(asExpr(std::declval<const T&>()))>;
+
+/// @brief True if at least one of the arguments is an expression (the rest may be scalars)
+template <typename A, typename B>
+constexpr bool anyExpr = is_expr<std::decay_t<A>>::value || is_expr<std::decay_t<B>>::value;
+
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Plus, ExprOf<A>, ExprOf<B>> operator+(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Plus{}}; }
+
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Minus, ExprOf<A>, ExprOf<B>> operator-(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Minus{}}; }
+
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Multiply, ExprOf<A>, ExprOf<B>> operator*(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Multiply{}}; }
+
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Divide, ExprOf<A>, ExprOf<B>> operator/(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Divide{}}; }
+
+/// @brief Element-wise maximum, either argument may be a scalar
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Max, ExprOf<A>, ExprOf<B>> max(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Max{}}; }
+
+/// @brief Element-wise minimum, either argument may be a scalar
+template <typename A, typename B, typename = std::enable_if_t<anyExpr<A, B>>>
+Binary<op::Min, ExprOf<A>, ExprOf<B>> min(const A& a, const B& b) { return {asExpr(a), asExpr(b), op::Min{}}; }
+
+/// @brief Multiply every element by a factor
+template <typename A, typename = std::enable_if_t<is_expr<A>::value>>
+auto scale(const A& a, double factor) { return a * factor; }
+
+/// @brief wa * a + wb * b
+template <typename A, typename B>
+auto weightedSum(const A& a, double wa, const B& b, double wb) { return wa * a + wb * b; }
+
+/// @brief Clamp every element to [lo, hi]
+template <typename A, typename = std::enable_if_t<is_expr<A>::value>>
+Unary<op::Clamp, A> clamp(const A& a, double lo, double hi) { return {a, op::Clamp{lo, hi}}; }
+
+/// @brief Linearly map [fromLo, fromHi] to [toLo, toHi]
+template <typename A, typename = std::enable_if_t<is_expr<A>::value>>
+Unary<op::Remap, A> remap(const A& a, double fromLo, double fromHi, double toLo, double toHi) {
+   return {a, op::Remap{fromLo, fromHi - fromLo, toLo, toHi - toLo}};
+}
+
+/// @brief Per element a + mask * (b - a), i.e. a where mask is 0 and b where mask is 1
+template <typename A, typename B, typename M>
+Blend<ExprOf<A>, ExprOf<B>, ExprOf<M>> blend(const A& a, const B& b, const M& mask) { return {asExpr(a), asExpr(b), asExpr(mask)}; }
+
+/// @brief Apply an arbitrary function double -> double to every element
+template <typename A, typename F, typename = std::enable_if_t<is_expr<A>::value>>
+Unary<F, A> map(const A& a, F f) { return {a, f}; }
+
+// --- Evaluation ---
+
+/// @brief Rows per thread band such that each band covers at least ~16k elements
+inline std::size_t minBandRows(std::size_t cols) {
+   return std::max<std::size_t>(1, (std::size_t(1) << 14) / std::max<std::size_t>(1, cols));
+}
+
+/// @brief Evaluate the expression into dst in one fused, parallel pass
+/// @throws std::runtime_error if the shapes of dst and the expression differ
+/// @note dst may appear in the expression itself, every element is only read before it is written
+template <typename E>
+void assign(matrix& dst, const Expr<E>& expression) {
+   const E& e = expression.self();
+   const std::size_t rows = dst.size();
+   const std::size_t cols = dst.empty() ? 0 : dst[0].size();
+   if ((e.rows() != 0 && e.rows() != rows) || (e.cols() != 0 && e.cols() != cols)) {
+      throw std::runtime_error("Dimension mismatch between heightfield expression and destination.");
+   }
+   parallelFor(0, rows, minBandRows(cols), [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         const auto r = e.row(i);
+         double* out = dst[i].data();
+         for (std::size_t j = 0; j < cols; ++j) {
+            out[j] = r[j];
+         }
+      }
+   });
+}
+
+/// @brief Evaluate the expression into a new matrix
+/// @throws std::invalid_argument if the expression has no shape (only scalars)
+template <typename E>
+matrix evaluate(const Expr<E>& expression) {
+   const E& e = expression.self();
+   if (e.rows() == 0 || e.cols() == 0) {
+      throw std::invalid_argument("Cannot evaluate a heightfield expression without shape.");
+   }
+   matrix result(e.rows(), std::vector<double>(e.cols()));
+   assign(result, expression);
+   return result;
+}
+
+/// @brief Minimum and maximum value of the expression, computed in parallel
+template <typename E>
+std::pair<double, double> minMax(const Expr<E>& expression) {
+   const E& e = expression.self();
+   const std::size_t rows = e.rows();
+   const std::size_t cols = e.cols();
+   if (rows == 0 || cols == 0) {
+      throw std::invalid_argument("Cannot reduce a heightfield expression without shape.");
+   }
+   std::vector<std::pair<double, double>> rowMinMax(rows);
+   parallelFor(0, rows, minBandRows(cols), [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         const auto r = e.row(i);
+         double lo = r[0];
+         double hi = r[0];
+         for (std::size_t j = 1; j < cols; ++j) {
+            const double v = r[j];
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+         }
+         rowMinMax[i] = {lo, hi};
+      }
+   });
+   auto result = rowMinMax[0];
+   for (const auto& mm : rowMinMax) {
+      result.first = std::min(result.first, mm.first);
+      result.second = std::max(result.second, mm.second);
+   }
+   return result;
+}
+
+} // namespace perlin::hf
+
+#endif // HEIGHTFIELD_EXPR_HPP
@@ -0,0 +1,54 @@
+#ifndef HEIGHTFIELD_FILTERS_HPP
+#define HEIGHTFIELD_FILTERS_HPP
+
+#include "PerlinUtils.hpp"
+
+namespace perlin {
+
+/// @brief Parameters of the thermal (talus) erosion
+/// @note Slopes are measured in the units of the mesh (height difference per terrain width), so they do not depend on the grid size.
+struct ThermalErosionParams {
+   bool enabled = false;
+   unsigned iterations = 50;
+   double talusSlope = 1.5; // material only slides down where the slope is steeper than this
+   double rate = 0.5; // fraction of the excess material moved per iteration, in [0, 1]
+};
+
+enum class SmoothingFilter {
+   GAUSSIAN, // 3x3 binomial blur
+   MEDIAN, // 3x3 median, removes spikes but keeps ridges
+   SLOPE_LIMITED // blur only where the slope exceeds the limit, gentle terrain is untouched
+};
+
+/// @brief Parameters of the smoothing passes
+struct SmoothingParams {
+   bool enabled = false;
+   SmoothingFilter filter = SmoothingFilter::GAUSSIAN;
+   unsigned iterations = 2;
+   double slopeLimit = 2.5; // SLOPE_LIMITED only, same units as ThermalErosionParams::talusSlope
+};
+
+/**
+ * Thermal erosion: wherever the height difference between two neighbouring cells (8-neighbourhood)
+ * exceeds the talus slope, part of the excess slides down to the lower cell.
+ * Every iteration is a 3x3 stencil written into a second buffer (ping-pong), computed in parallel row bands.
+ * The total amount of material is conserved.
+ * @param heights heightfield, indexed heights[x][y], modified in place
+ * @param params erosion parameters
+ * @return number of iterations performed
+ * @author SD
+ */
+unsigned thermalErosion(matrix& heights, const ThermalErosionParams& params);
+
+/**
+ * Apply a 3x3 smoothing filter iteratively, see SmoothingFilter. Borders are handled by repeating the outermost cells.
+ * @param heights heightfield, indexed heights[x][y], modified in place
+ * @param params filter and number of iterations
+ * @return number of iterations performed
+ * @author SD
+ */
+unsigned smooth(matrix& heights, const SmoothingParams& params);
+
+} // namespace perlin
+
+#endif // HEIGHTFIELD_FILTERS_HPP
@@ -0,0 +1,78 @@
+#ifndef PERLIN_LAYER_CACHE_HPP
+#define PERLIN_LAYER_CACHE_HPP
+
+#include "PerlinLayer.hpp"
+#include <cstddef>
+#include <list>
+#include <optional>
+
+namespace perlin {
+
+/// @brief Everything the values of a filled layer depend on, equal keys mean equal values
+struct LayerKey {
+   int seed; // the gradients are those of the seed, see TerrainGenerator::gradientsFor
+   unsigned sizeX, sizeY;
+   unsigned chunkSize;
+   WarpParams warp;
+   LayerStorage storage; // quantized values are not those of a layer with exact ones
+
+   bool operator==(const LayerKey& other) const {
+      return seed == other.seed && sizeX == other.sizeX && sizeY == other.sizeY && chunkSize == other.chunkSize && warp == other.warp &&
+             storage == other.storage;
+   }
+};
+
+/**
+ * Values of filled layers which are not used any more, kept in case the same layer is needed again: a chunk size
+ * tried and set back, a layer moved from one stack to the other, or a seed visited again.
+ * The values are moved in and out, so storing and taking them only swaps the pointers of the rows.
+ * The memory is bounded, the least recently stored values are dropped first. Quantized layers take a quarter of the
+ * memory of exact ones, so four times as many of them fit.
+ * @author SD
+ */
+class LayerCache {
+   public:
+   /// @param budget Bytes of layer values kept at most
+   explicit LayerCache(std::size_t budget) : budget(budget) {}
+
+   /// @brief Keep the values of a layer, values larger than the budget are dropped at once
+   void put(const LayerKey& key, LayerValues&& values);
+
+   /// @brief Take the values stored for the key out of the cache
+   std::optional<LayerValues> take(const LayerKey& key);
+
+   /// @brief Change the budget, dropping the oldest values beyond it
+   void setBudget(std::size_t bytes);
+
+   std::size_t getBudget() const {
+      return budget;
+   }
+
+   /// @brief Bytes of the values stored now
+   std::size_t getUsedBytes() const {
+      return usedBytes;
+   }
+
+   void clear() {
+      entries.clear();
+      usedBytes = 0;
+   }
+
+   private:
+   struct Entry {
+      LayerKey key;
+      LayerValues values;
+      std::size_t bytes;
+   };
+
+   std::size_t budget;
+   std::size_t usedBytes = 0;
+   std::list<Entry> entries; // newest first, a few dozen at most, so lookups are linear
+
+   /// @brief Drop the oldest entries until the budget is kept
+   void trim();
+};
+
+} // namespace perlin
+
+#endif // PERLIN_LAYER_CACHE_HPP
@@ -0,0 +1,66 @@
+#ifndef PERLIN_PARALLEL_HPP
+#define PERLIN_PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#ifndef TERRAIN_NO_THREADS
+#include <thread>
+#include <vector>
+#endif
+
+namespace perlin {
+
+/// @brief Number of threads used by parallelFor, at least 1
+inline unsigned workerCount() {
+#ifdef TERRAIN_NO_THREADS
+   return 1;
+#else
+   static const unsigned count = std::max(1u, std::thread::hardware_concurrency());
+   return count;
+#endif
+}
+
+/// @brief Split [begin, end) into contiguous bands and process each band on its own thread
+/// @param begin, end range of indices (usually matrix rows)
+/// @param minBandSize bands are never smaller than this, so that small ranges stay on the calling thread
+/// @param body callable with signature void(std::size_t bandBegin, std::size_t bandEnd)
+/// @note The calling thread processes the first band itself. Bands are deterministic for a given range and worker count.
+/// Built with TERRAIN_NO_THREADS the whole range is a single band on the calling thread.
+template <typename Body>
+void parallelFor(std::size_t begin, std::size_t end, std::size_t minBandSize, Body&& body) {
+   if (end <= begin) return;
+#ifdef TERRAIN_NO_THREADS
+   (void) minBandSize;
+   body(begin, end);
+#else
+   const std::size_t count = end - begin;
+   const std::size_t maxBands = std::max<std::size_t>(1, count / std::max<std::size_t>(1, minBandSize));
+   const std::size_t numBands = std::min<std::size_t>(workerCount(), maxBands);
+   if (numBands <= 1) {
+      body(begin, end);
+      return;
+   }
+
+   const std::size_t bandSize = count / numBands;
+   const std::size_t remainder = count % numBands;
+   std::vector<std::thread> threads;
+   threads.reserve(numBands - 1);
+
+   // band b gets one extra element if b < remainder
+   std::size_t bandBegin = begin + bandSize + (remainder > 0 ? 1 : 0);
+   const std::size_t firstEnd = bandBegin;
+   for (std::size_t b = 1; b < numBands; ++b) {
+      const std::size_t bandEnd = bandBegin + bandSize + (b < remainder ? 1 : 0);
+      threads.emplace_back([&body, bandBegin, bandEnd]() { body(bandBegin, bandEnd); });
+      bandBegin = bandEnd;
+   }
+   body(begin, firstEnd);
+   for (auto& thread : threads) {
+      thread.join();
+   }
+#endif
+}
+
+} // namespace perlin
+
+#endif // PERLIN_PARALLEL_HPP
@@ -1,30 +1,76 @@
 #ifndef PERLIN_LAYER_HPP
 #define PERLIN_LAYER_HPP
 
+#include "CancelToken.hpp"
 #include "PerlinUtils.hpp"
+#include <cstdint>
 
-enum UpdateState {
-   NONE, // 0
-   WEIGHT, // 1
-   CHUNK_SIZE, // 2
-   BOTH // 3
+namespace perlin {
+
+/// @brief Domain warp of a layer: its sample coordinates are displaced by two noise fields of another chunk size
+struct WarpParams {
+   unsigned chunkSize = 0; // chunk size of the displacement noise, 0 disables the warp
+   double amplitude = 0.0; // displacement in cells for a noise value of 1
+
+   bool enabled() const {
+      return chunkSize > 0 && amplitude != 0.0;
+   }
+
+   bool operator==(const WarpParams& other) const {
+      return chunkSize == other.chunkSize && amplitude == other.amplitude;
+   }
 };
 
-enum LayerType {
-   NOISE_LAYER,
-   BASELINE_LAYER
+/// @brief How a filled layer keeps its values
+enum class LayerStorage {
+   DOUBLE, // exact, 8 bytes per value
+   QUANTIZED16 // 2 bytes per value, see QuantizedMatrix for the error
+};
+
+/**
+ * Values quantized to 16 bits: value = offset + scale * code, the 65536 codes spread evenly over [min, max] of the values.
+ * Every value is rounded to the nearest code, so it errs by at most scale / 2 = (max - min) / 131070. Perlin noise lies
+ * within [-sqrt(0.5), sqrt(0.5)], so a layer errs by at most 1.08e-5 and a weighted sum of layers by 1.08e-5 times the
+ * sum of the absolute weights.
+ * @author SD
+ */
+struct QuantizedMatrix {
+   std::vector<std::vector<std::uint16_t>> codes; // codes[x][y]
+   double offset = 0.0;
+   double scale = 0.0;
+
+   /// @brief Quantize the values, the rows in parallel
+   static QuantizedMatrix encode(const matrix& values);
+
+   /// @brief The values the codes stand for
+   matrix decode() const;
+
+   /// @brief Largest difference between a value and the one its code stands for
+   double maxError() const {
+      return scale / 2;
+   }
+};
+
+/// @brief Values of a filled layer, either exact or quantized (the other one is empty)
+struct LayerValues {
+   matrix exact;
+   QuantizedMatrix quantized;
+
+   std::size_t bytes() const;
 };
 
-namespace perlin {
 class PerlinLayer {
    public:
-   PerlinLayer(unsigned sizeX, unsigned sizeY, unsigned chunkSize, double weight) : sizeX(sizeX), sizeY(sizeY), chunkSize(chunkSize), weight(weight) {
-      result = matrix(sizeX, std::vector<double>(sizeY, 0.0));
+   /// @param storage How the values are kept once the layer is filled
+   PerlinLayer(unsigned sizeX, unsigned sizeY, unsigned chunkSize, double weight, WarpParams warp = {}, LayerStorage storage = LayerStorage::DOUBLE)
+      : sizeX(sizeX), sizeY(sizeY), chunkSize(chunkSize), weight(weight), warp(warp), storage(storage) {
+      result = matrix(sizeX); // rows are allocated when they are first written, see fillLattice
    };
 
    // Move constructor
    PerlinLayer(PerlinLayer&& other) noexcept
-      : sizeX(other.sizeX), sizeY(other.sizeY), chunkSize(other.chunkSize), weight(other.weight), result(std::move(other.result)) {}
+      : sizeX(other.sizeX), sizeY(other.sizeY), chunkSize(other.chunkSize), weight(other.weight), warp(other.warp), storage(other.storage), filled(other.filled),
+        result(std::move(other.result)), packed(std::move(other.packed)) {}
 
    // Move assignment operator
    PerlinLayer& operator=(PerlinLayer&& other) noexcept {
@@ -32,7 +78,11 @@ class PerlinLayer {
          // sizeX and sizeY are const, already initialized by the constructor
          chunkSize = other.chunkSize;
          weight = other.weight;
+         warp = other.warp;
+         storage = other.storage;
+         filled = other.filled;
          result = std::move(other.result); // Move the matrix
+         packed = std::move(other.packed);
       }
       return *this;
    }
@@ -45,43 +95,221 @@ class PerlinLayer {
 
    /// @brief Fill the entire result matrix with Perlin noise values
    /// @param gradients Constant gradients used for computation
-   void fill(const std::vector<vec2d>& gradients);
+   /// @param cancel Polled after every chunk
+   /// @throws Cancelled if the token is cancelled, the layer is then only partly filled (see isFilled)
+   void fill(const std::vector<vec2d>& gradients, const CancelToken& cancel = {});
+
+   /**
+    * One pass of a coarse to fine fill: compute the points whose coordinates are both multiples of stride and which
+    * the previous pass (with twice the stride) did not compute. Warped layers compute whole rows instead of points.
+    * Passes with the strides 2^k, ..., 2, 1 fill the layer completely with the same values as fill, and every
+    * point only once, so a coarse preview of the layer costs no extra work.
+    * @param gradients Constant gradients used for computation
+    * @param stride Power of two, halved from one pass to the next, the last pass has stride 1
+    * @param firstPass Whether this is the coarsest pass, which computes all of its points
+    * @param cancel Polled after every chunk (or row)
+    * @throws Cancelled if the token is cancelled
+    * @author SD
+    */
+   void fillLattice(const std::vector<vec2d>& gradients, unsigned stride, bool firstPass, const CancelToken& cancel = {});
+
+   /**
+    * Fill the rows [x0, x1) with the values fill gives them, so a layer can be computed in small steps.
+    * Calls for consecutive ranges starting at row 0 fill the layer: it is unfilled after the first range and
+    * counts as filled after the range ending at the last row.
+    * @param gradients Constant gradients used for computation
+    * @param x0, x1 Range of rows, x1 at most the number of rows
+    * @author SD
+    */
+   void fillRows(const std::vector<vec2d>& gradients, unsigned x0, unsigned x1);
+
+   /// @brief Take over values computed before (e.g. read from a snapshot), the layer then counts as filled
+   /// @param values sizeX rows of sizeY values, as getResult returns them. Quantized if the storage of the layer is.
+   /// @throws std::invalid_argument if the size does not match
+   void assign(matrix&& values);
+
+   /// @brief Take over the values released by a layer, converted to the storage of this one
+   /// @throws std::invalid_argument if the size does not match
+   void assign(LayerValues&& values);
+
+   /// @brief Move the values out (e.g. into a LayerCache), the layer is then unfilled
+   LayerValues release();
 
    void changeWeight(const double newWeight);
 
    /// @note Triggers recompute
-   void changeChunkSize(const std::vector<vec2d>& gradients, const unsigned newChunkSize);
+   void changeChunkSize(const std::vector<vec2d>& gradients, const unsigned newChunkSize, const CancelToken& cancel = {});
+
+   /// @brief Whether the last fill ran to the end
+   bool isFilled() const {
+      return filled;
+   }
+
+   /// @brief Unweighted noise values, result[x][y]
+   /// @note Rows not written by any fill or fillLattice pass yet are empty, all rows are empty if the values are quantized
+   const matrix& getResult() const {
+      return result;
+   }
+
+   /// @brief Whether the values are kept as QuantizedMatrix, only once the layer is filled
+   bool isQuantized() const {
+      return !packed.codes.empty();
+   }
+
+   /// @brief The quantized values, empty unless isQuantized
+   const QuantizedMatrix& getQuantized() const {
+      return packed;
+   }
+
+   /// @brief Unweighted noise value at (x, y) in either storage
+   double value(const unsigned x, const unsigned y) const {
+      return packed.codes.empty() ? result[x][y] : packed.offset + packed.scale * packed.codes[x][y];
+   }
+
+   /**
+    * Change how the values are kept. The values of a filled layer are converted at once: quantizing them changes every
+    * value by at most QuantizedMatrix::maxError, going back to DOUBLE keeps the quantized values until the next fill.
+    * Layers being filled are quantized when the fill is complete.
+    */
+   void setStorage(LayerStorage newStorage);
+
+   LayerStorage getStorage() const {
+      return storage;
+   }
 
    /// @brief Add the values of the layer to the accumulator matrix
    /// @param accumulator the matrix to accumulate the values to
    /// @param weightFactor the factor to multiply the values with
-   /// @note std::execution::par could also be used here, though doesn't work on all platforms
+   /// @note Runs as a single fused pass split into row bands over std::thread (see perlin::hf::assign),
+   /// quantized values are decoded within that pass
    void accumulate(matrix& accumulator, const double weightFactor);
 
-   double getWeight() {
+   double getWeight() const {
       return weight;
    }
 
-   unsigned getChunkSize() {
+   unsigned getChunkSize() const {
       return chunkSize;
    }
 
+   /// @note Takes effect at the next fill, see changeChunkSize to recompute at once
+   void setChunkSize(const unsigned newChunkSize) {
+      chunkSize = newChunkSize;
+   }
+
+   /// @note Takes effect at the next fill, e.g. through changeChunkSize
+   void setWarp(const WarpParams& newWarp) {
+      warp = newWarp;
+   }
+
+   const WarpParams& getWarp() const {
+      return warp;
+   }
+
+   /// @brief Evaluate the noise at a continuous position, on the same lattice as the integer kernel
+   /// @param gradients Constant gradients used for computation
+   /// @param chunkSize chunk size of the layer
+   /// @param x, y position in cells, may be fractional or outside of the terrain
+   /// @note Agrees with fillRegion at integer positions up to rounding
+   static double sample(const std::vector<vec2d>& gradients, const unsigned chunkSize, const double x, const double y);
+
+   /// @brief Evaluate the noise of a layer with the given chunk size on the region [x0, x1) x [y0, y1)
+   /// @param gradients Constant gradients used for computation
+   /// @param chunkSize chunk size of the layer
+   /// @param out callable receiving (x, y, value) for every point of the region
+   /// @note Produces exactly the values PerlinLayer::fill would store at the same coordinates,
+   /// so that regions (e.g. tiles) can be computed independently of a full layer
+   template <typename Out>
+   static void fillRegion(const std::vector<vec2d>& gradients, const unsigned chunkSize, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1, Out&& out) {
+      if (gradients.empty() || x0 >= x1 || y0 >= y1) return;
+      const int size = gradients.size();
+      for (unsigned chunkX = x0 / chunkSize; chunkX * chunkSize < x1; chunkX++) {
+         for (unsigned chunkY = y0 / chunkSize; chunkY * chunkSize < y1; chunkY++) {
+            // Select a value for each of the 4 corners of the square from the permutation table
+            const int valBL = simpleHash(chunkX, chunkY, size);
+            const int valBR = simpleHash(chunkX + 1, chunkY, size);
+            const int valTL = simpleHash(chunkX, chunkY + 1, size);
+            const int valTR = simpleHash(chunkX + 1, chunkY + 1, size);
+
+            const unsigned beginX = std::max(x0, chunkX * chunkSize);
+            const unsigned beginY = std::max(y0, chunkY * chunkSize);
+            const unsigned endX = std::min(x1, (chunkX + 1) * chunkSize);
+            const unsigned endY = std::min(y1, (chunkY + 1) * chunkSize);
+            for (unsigned i = beginX; i < endX; i++) {
+               for (unsigned j = beginY; j < endY; j++) {
+                  out(i, j, computeWithIndices(gradients, chunkSize, i, j, valBL, valBR, valTL, valTR));
+               }
+            }
+         }
+      }
+   }
+
+   /// @brief Like fillRegion above, with the sample coordinates displaced by a domain warp
+   /// @note The displacement is computed per point inside the kernel, no intermediate warp matrices are stored.
+   /// Without warp this is exactly the unwarped fillRegion.
+   template <typename Out>
+   static void fillRegion(const std::vector<vec2d>& gradients, const unsigned chunkSize, const WarpParams& warp, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1, Out&& out) {
+      if (!warp.enabled()) {
+         fillRegion(gradients, chunkSize, x0, y0, x1, y1, std::forward<Out>(out));
+         return;
+      }
+      if (gradients.empty() || x0 >= x1 || y0 >= y1) return;
+      std::vector<double> row(y1 - y0);
+      for (unsigned i = x0; i < x1; i++) {
+         fillWarpedRow(gradients, chunkSize, warp, i, y0, y1, row.data());
+         for (unsigned j = y0; j < y1; j++) {
+            out(i, j, row[j - y0]);
+         }
+      }
+   }
+
    private:
    const unsigned sizeX;
    const unsigned sizeY;
    unsigned chunkSize;
    double weight = 1.0;
+   WarpParams warp;
+   LayerStorage storage;
+   bool filled = false;
    matrix result;
+   QuantizedMatrix packed; // the values once a quantized layer is filled, result is then empty
+
+   /// @brief Allocate row x of the result (zeros) if it is still empty
+   void allocateRow(const unsigned x) {
+      if (result[x].empty()) {
+         result[x].assign(sizeY, 0.0);
+      }
+   }
+
+   /// @brief The layer is being filled (again), quantized values are dropped
+   void startFill() {
+      filled = false;
+      packed = QuantizedMatrix{};
+   }
+
+   /// @brief The layer is filled, quantize it if that is its storage
+   void finishFill();
+
+   /// @brief Warped noise of the points (x, y0) ... (x, y1 - 1) into out
+   /// @note Compiled once (not inlined into the callers), so layers and graph tiles get bit-identical values
+   static void fillWarpedRow(const std::vector<vec2d>& gradients, const unsigned chunkSize, const WarpParams& warp, const unsigned x, const unsigned y0, const unsigned y1, double* out);
+
+   /// @brief simpleHash mapped into [0, N), also for negative chunk coordinates (warped samples near the border)
+   static int wrappedHash(const int i, const int j, const int N) {
+      const int hash = simpleHash(i, j, N);
+      return hash < 0 ? hash + N : hash;
+   }
 
    /// @brief Compute the Perlin noise value of a pixel
    /// @param gradients Constant gradients used for computation
+   /// @param chunkSize chunk size of the layer
    /// @param x x-coordinate within the chunk
    /// @param y y-coordinate within the chunk
    /// @param valBL index of bottom left gradient
    /// @param valBR index of bottom right gradient
    /// @param valTL index of top left gradient
    /// @param valTR index of top right gradient
-   double computeWithIndices(const std::vector<vec2d>& gradients, const unsigned x, const unsigned y, const int valBL, const int valBR, const int valTL, const int valTR);
+   static double computeWithIndices(const std::vector<vec2d>& gradients, const unsigned chunkSize, const unsigned x, const unsigned y, const int valBL, const int valBR, const int valTL, const int valTR);
 
    /// @brief Fill a chunk of the matrix with Perlin noise values
    /// @param gradients Constant gradients used for computation
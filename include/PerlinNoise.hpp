@@ -1,6 +1,7 @@
 #ifndef _PERLIN_OOP
 #define _PERLIN_OOP
 
+#include "HeightfieldExpr.hpp"
 #include "PerlinLayer.hpp"
 
 namespace perlin {
@@ -33,7 +34,7 @@ class PerlinNoise2D {
    }
 
    /// @brief Get the reference to the result matrix
-   const matrix& getResultRef() {
+   const matrix& getResultRef() const {
       return resultMatrix;
    }
 
@@ -68,7 +69,7 @@ class PerlinNoise2D {
 
    /// @brief Update the own matrix with the maximum values of the own and another PerlinNoise2D object's matrix
    /// @param other another PerlinNoise2D object
-   void filterMatrix(perlin::PerlinNoise2D& other);
+   void filterMatrix(const perlin::PerlinNoise2D& other);
 
    // --- Layer functions ---
 
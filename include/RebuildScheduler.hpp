@@ -0,0 +1,48 @@
+#ifndef REBUILD_SCHEDULER_CLASS_HPP
+#define REBUILD_SCHEDULER_CLASS_HPP
+
+#include <chrono>
+
+/**
+ * Decides when edits of the terrain settings start a rebuild, measured in wall-clock time (independent of the frame rate).
+ * Edits are coalesced: a rebuild is due once no edit came in for the quiet time, but at the latest after the maximum delay
+ * since the first edit it covers, so a continuously dragged slider still refreshes regularly.
+ * @author SD
+ */
+class RebuildScheduler {
+   public:
+   using Clock = std::chrono::steady_clock;
+
+   /// @param quietTime Time without edits after which the rebuild starts
+   /// @param maxDelay Longest time from the first coalesced edit to the rebuild
+   RebuildScheduler(Clock::duration quietTime, Clock::duration maxDelay) : quietTime(quietTime), maxDelay(maxDelay) {}
+
+   /// @brief Record an edit, a zero quiet time makes the rebuild due at once
+   void plan(Clock::time_point now = Clock::now());
+
+   /// @brief Whether the rebuild for the planned edits should start now, true only once per batch of edits
+   bool due(Clock::time_point now = Clock::now());
+
+   /// @brief Forget the planned edits, e.g. when the terrain they belong to is replaced
+   void cancel() {
+      pending = false;
+   }
+
+   bool isPending() const {
+      return pending;
+   }
+
+   void setDelays(const Clock::duration newQuietTime, const Clock::duration newMaxDelay) {
+      quietTime = newQuietTime;
+      maxDelay = newMaxDelay;
+   }
+
+   private:
+   Clock::duration quietTime;
+   Clock::duration maxDelay;
+   bool pending = false;
+   Clock::time_point firstEdit;
+   Clock::time_point lastEdit;
+};
+
+#endif // REBUILD_SCHEDULER_CLASS_HPP
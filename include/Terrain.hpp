@@ -1,10 +1,17 @@
 #ifndef TERRAIN_CLASS_HPP
 #define TERRAIN_CLASS_HPP
 
+#ifndef TERRAIN_NO_THREADS
+#include "BackgroundWorker.hpp"
+#endif
+#include "LodQuadtree.hpp"
 #include "Mesh.hpp"
-#include "PerlinLayer.hpp"
-
-using layerP = std::pair<unsigned, double>;
+#include "RebuildScheduler.hpp"
+#include "Rtin.hpp"
+#include "TerrainGenerator.hpp"
+#include <algorithm>
+#include <mutex>
+#include <optional>
 
 struct BasicConfigParams {
    int seed;
@@ -13,87 +20,275 @@ struct BasicConfigParams {
    double flattenFactor = 2.0;
 };
 
+/**
+ * Terrain generated from noise layers (or a node graph) and drawn as a grid mesh.
+ * The settings are edited on the render thread. Changes are coalesced by a RebuildScheduler, when it is due a copy of
+ * the settings goes to a background worker which runs the TerrainGenerator and builds the vertices of the mesh.
+ * Starting a build cancels the one still running, so the terrain always converges to the newest settings. The newest result waits in a slot until update
+ * picks it up on the render thread and uploads it in slices over the next frames, the previous terrain keeps
+ * drawing meanwhile. So there are up to three versions: one being generated, one ready and one being uploaded.
+ * Builds from scratch (startup, new seed) first hand out coarse previews, so something is drawn within milliseconds
+ * and refined in place until the full resolution is reached. The mesh then has fewer vertices than sizeX x sizeY.
+ * Built with TERRAIN_NO_THREADS there is no worker: update steps the generator on the render thread for a fixed
+ * time per frame (see TerrainGenerator::step) and the previous terrain keeps drawing until the build is complete.
+ * @author SD
+ */
 class Terrain {
    private:
+   /// @brief Result of a background build
+   struct Build {
+      GridMeshData mesh;
+      std::optional<Rtin> rtin; // only if the simplified triangulation is drawn
+      std::vector<GLuint> triangles;
+      float maxError = 0.0f; // of the triangles
+   };
+
    BasicConfigParams configParams;
-   std::optional<Mesh> mesh;
-   std::optional<std::vector<perlin::PerlinLayer>> noiseLayers;
-   std::optional<std::vector<perlin::PerlinLayer>> baselineLayers;
-   std::optional<perlin::matrix> noise;
-   std::optional<perlin::matrix> baseline;
-   std::vector<perlin::vec2d> gradients;
    std::vector<layerP> noiseParams;
    std::vector<layerP> baselineParams;
+   std::vector<perlin::WarpParams> noiseWarps; // domain warp per noise layer
+   std::vector<perlin::WarpParams> baselineWarps; // domain warp per baseline layer
+   std::shared_ptr<TerrainGraph> graph; // custom pipeline, replaces the layer stacks when set. Only used by the generator.
+   std::size_t graphNodeCount = 0; // of the graph as it was set
+   nlohmann::json graphJson;
+   PostProcessParams postProcessParams; // applied after combining the layers, before building the mesh
+   perlin::LayerStorage layerStorage = perlin::LayerStorage::DOUBLE; // of the layers kept by the generator
+   std::optional<Mesh> mesh;
+   IndexMode indexMode = IndexMode::TRIANGLES; // index format of the mesh
+   std::optional<LodQuadtree> lod; // level of detail renderer, created by the first DrawLod
+   float lodDetailDistance = 0.4f;
+   GridRegion view; // heights in view in the last Draw, graph builds evaluate them first
+   bool frustumCulling = true;
+   std::optional<Rtin> rtin; // error map of the current heights, built on first use
+   bool renderSimplified = false; // draw the Rtin triangulation instead of the full grid
+   float renderMaxError = 0.0f;
+   std::size_t uploadBudget = 4u << 20; // bytes of vertices (or LOD textures) uploaded per frame
+   std::optional<Build> uploading; // build whose vertices the mesh is uploading
+   RebuildScheduler scheduler{std::chrono::milliseconds(100), std::chrono::milliseconds(500)};
+
+   TerrainGenerator generator; // only used by the jobs of the worker, or stepped by update without threads
+   mutable std::mutex readyMutex;
+   std::optional<Build> ready; // newest finished build, guarded by readyMutex
+#ifdef TERRAIN_NO_THREADS
+   std::chrono::microseconds stepBudget{6000}; // generation time per frame
+   std::chrono::high_resolution_clock::time_point buildStart; // of the stepped build
+#else
+   BackgroundWorker worker; // last, so it is stopped before the members its jobs use are destroyed
+#endif
+
+   /// @brief Generate the terrain for the current settings in the background (or stepped by update), replacing the build still running
+   void requestBuild();
+
+   /// @brief Take over the simplification of a build whose vertices are now drawn
+   void finishBuild(Build& build);
+
+   /// @brief Remember the part of the terrain the camera sees, for the next graph build
+   void updateView(const Camera& camera);
+
+   /// @brief Hand the simplified triangulation to the mesh if it is drawn
+   void applySimplification();
 
    public:
 
    //Terrain(const std::string& configFile); TODO
 
    /// @brief Constructor to initialize Terrain with basic configuration parameters, noise parameters, and baseline parameters.
+   /// The terrain is generated in the background, it is drawn once update has uploaded it.
    /// @param basicConfigParams Basic configuration parameters.
    /// @param noiseParams Parameters for noise layers.
    /// @param baselineParams Parameters for baseline layers.
    Terrain(const BasicConfigParams& basicConfigParams, const std::vector<layerP>& noiseParams, const std::vector<layerP>& baselineParams);
 
-   /// @brief Adjust the weight of a noise layer.
-   /// @param index Index of the noise layer.
-   /// @param weight New weight for the noise layer.
-   /// @note get current weight, add (weight-currentWeight)*layer to noise
-   void adjustNoiseLayerWeight(const unsigned index, const double weight);
-
-   /// @brief Adjust the chunk size of a noise layer.
-   /// @param index Index of the noise layer.
-   /// @param chunkSize New chunk size for the noise layer.
-   /// @note subtract weight*layer from noise, recompute layer, add weight*layer to noise
-   void adjustNoiseLayerChunkSize(const unsigned index, const unsigned chunkSize);
-
-   /// @brief Adjust the weight of a baseline layer.
-   /// @param index Index of the baseline layer.
-   /// @param weight New weight for the baseline layer.
-   void adjustBaselineLayerWeight(const unsigned index, const double weight);
-
-   /// @brief Adjust the chunk size of a baseline layer.
-   /// @param index Index of the baseline layer.
-   /// @param chunkSize New chunk size for the baseline layer.
-   void adjustBaselineLayerChunkSize(const unsigned index, const unsigned chunkSize);
-
-   /// @brief Adjust both weight and chunk size of a noise layer.
-   /// @param index Index of the noise layer.
-   /// @param pair Pair containing new chunk size and weight for the noise layer.
-   void adjustNoiseBoth(const unsigned index, const layerP pair);
-
-   /// @brief Adjust both weight and chunk size of a baseline layer.
-   /// @param index Index of the baseline layer.
-   /// @param pair Pair containing new chunk size and weight for the baseline layer.
-   void adjustBaselineBoth(const unsigned index, const layerP pair);
-
-   /// @brief Initialize noise layers with given parameters.
-   /// @param noiseParams Parameters for noise layers.
-   void initializeNoise(const std::vector<layerP>& noiseParams);
+   Terrain(const Terrain&) = delete;
+   Terrain& operator=(const Terrain&) = delete;
 
-   /// @brief Initialize baseline layers with given parameters.
-   /// @param baselineParams Parameters for baseline layers.
-   void initializeBaseline(const std::vector<layerP>& baselineParams);
+   /**
+    * Start the scheduled build when it is due, hand finished builds to the mesh and upload the next slice of its vertices.
+    * Without threads this also runs the next step of the build. Call once per frame on the render thread. The first build creates the mesh at once, later ones replace the vertices
+    * when their upload is complete.
+    * @author SD
+    */
+   void update();
+
+   /// @brief Whether a build is scheduled, running, waiting or being uploaded
+   bool isBuilding() const;
 
-   /// @brief Compute the mesh with a given flatten factor.
+   /// @brief Rebuild the terrain once the edits settle, call after changing the parameters returned by the getters.
+   /// The setters of Terrain call it themselves.
+   void scheduleBuild() {
+      scheduler.plan();
+   }
+
+   /// @brief How long to wait for further edits before rebuilding, see RebuildScheduler
+   /// @param quietTime Time without edits after which the rebuild starts, 0 rebuilds at the next update
+   /// @param maxDelay Longest time from the first edit to the rebuild
+   void setRebuildDelay(const RebuildScheduler::Clock::duration quietTime, const RebuildScheduler::Clock::duration maxDelay) {
+      scheduler.setDelays(quietTime, maxDelay);
+   }
+
+   /// @brief Bytes of vertices (then of the LOD textures) uploaded per frame by update, larger values finish sooner but make those frames longer
+   void setUploadBudget(const std::size_t bytes) {
+      uploadBudget = std::max<std::size_t>(bytes, 1);
+   }
+
+#ifdef TERRAIN_NO_THREADS
+   /// @brief Time update spends per frame on generating the terrain, larger values finish sooner but make those frames longer
+   void setStepBudget(const std::chrono::microseconds budget) {
+      stepBudget = budget;
+   }
+#endif
+
+   /// @brief Rebuild the mesh with a given flatten factor, in the background once the edits settle.
    /// @param flattenFactor Factor to flatten the terrain.
    void computeMesh(const double flattenFactor);
 
-   /// @brief Create terrain from a given seed.
+   /// @brief Use a custom node graph instead of the noise and baseline layer stacks.
+   /// @param newGraph Graph of the same size as the terrain.
+   /// @throws std::invalid_argument if the size of the graph does not match.
+   void setGraph(TerrainGraph&& newGraph);
+
+   /// @brief Go back to the noise and baseline layer stacks.
+   void clearGraph();
+
+   bool hasGraph() const {
+      return graph != nullptr;
+   }
+
+   /// @brief Number of nodes of the graph given to setGraph, 0 without a graph
+   std::size_t getGraphNodeCount() const {
+      return graphNodeCount;
+   }
+
+   /// @brief The graph given to setGraph in the format of TerrainGraph::toJson
+   const nlohmann::json& getGraphJson() const {
+      return graphJson;
+   }
+
+   /// @brief Graph equivalent to the current noise and baseline layer stacks.
+   TerrainGraph layersToGraph() const {
+      return TerrainGraph::fromLayers(configParams.sizeX, configParams.sizeY, noiseParams, baselineParams, configParams.flattenFactor, noiseWarps, baselineWarps);
+   }
+
+   unsigned getSizeX() const {
+      return configParams.sizeX;
+   }
+
+   unsigned getSizeY() const {
+      return configParams.sizeY;
+   }
+
+   /// @brief Copy of everything the heights depend on, as handed to the next build
+   TerrainSettings getSettings() const {
+      return TerrainSettings{configParams.seed, configParams.flattenFactor, noiseParams, baselineParams, noiseWarps, baselineWarps, postProcessParams, graph, layerStorage, view};
+   }
+
+   /// @brief Set the erosion and smoothing parameters and recompute the mesh in the background once the edits settle.
+   /// @param params Parameters of all stages, disabled stages are skipped.
+   void setPostProcessParams(const PostProcessParams& params);
+
+   const PostProcessParams& getPostProcessParams() const {
+      return postProcessParams;
+   }
+
+   /// @brief Keep the layers of the generator exact or quantized to 16 bits, which takes a quarter of the memory and
+   /// changes the heights by about 1e-5 of their range (see TerrainGenerator). Rebuilds once the edits settle.
+   void setLayerStorage(perlin::LayerStorage storage);
+
+   perlin::LayerStorage getLayerStorage() const {
+      return layerStorage;
+   }
+
+   /// @brief Choose the primitives and index format used to draw the mesh, the indices are shared through the IndexCache.
+   /// @param mode New index format, takes effect immediately without rebuilding the vertices.
+   void setIndexMode(const IndexMode mode);
+
+   IndexMode getIndexMode() const {
+      return indexMode;
+   }
+
+   /// @brief Create terrain from a given seed, in the background once the edits settle.
    /// @param newSeed Seed for the noise generation.
    void createFromSeed(const int newSeed);
 
+   /**
+    * Save the terrain as a snapshot file (see TerrainSnapshot.hpp): its parameters, the gradients, layers and sums of the
+    * generator, the heights of the mesh and optionally its vertices. Only possible while nothing is being built.
+    * @param filename Name of the file to be saved to
+    * @param extra Stored with the snapshot and returned by loadSnapshot, e.g. the settings of the user interface
+    * @param withMesh Also store the vertices with their normals, so loading does not compute the normals again
+    * @return Whether the file was written, errors are reported on std::cerr
+    * @author SD
+    */
+   bool saveSnapshot(const std::string& filename, const nlohmann::json& extra = {}, bool withMesh = true);
+
+   /**
+    * Load a snapshot saved by saveSnapshot. The parameters are replaced, the generator continues from the saved layers
+    * (later edits only recompute what changed) and the saved heights are drawn after the next update, nothing is generated.
+    * The build running or scheduled is dropped. The file is mapped and validated on the calling thread, the layers are
+    * copied in parallel.
+    * @param filename Snapshot file
+    * @return The extra JSON given to saveSnapshot
+    * @throws std::runtime_error if the file is no valid snapshot or was saved from a terrain of another size,
+    * the terrain is then unchanged
+    * @author SD
+    */
+   nlohmann::json loadSnapshot(const std::string& filename);
+
    /// @brief Draw the terrain using the given shader and camera.
    /// @param shader Shader to use for drawing.
    /// @param camera Camera to use for drawing.
    void Draw(Shader& shader, Camera& camera);
 
-   //void ExportConfiguration(const std::string& filename); // to JSON
+   /// @brief Draw the terrain with per chunk level of detail chosen from the camera position, see LodQuadtree.
+   /// @param shader Shader to use for drawing.
+   /// @param camera Camera to use for drawing.
+   void DrawLod(Shader& shader, Camera& camera);
 
-   /// @brief Recompute layers with given update states.
-   /// @param noiseLayerUpdate Update states for noise layers.
-   /// @param baselineLayerUpdate Update states for baseline layers.
-   void recomputeLayers(std::vector<UpdateState>& noiseLayerUpdate, std::vector<UpdateState>& baselineLayerUpdate);
+   /// @brief Distance from the camera up to which DrawLod uses the full resolution, coarser levels follow at twice the distance each.
+   void setLodDetailDistance(const float distance) {
+      lodDetailDistance = distance;
+   }
+
+   float getLodDetailDistance() const {
+      return lodDetailDistance;
+   }
+
+   /// @brief Patches and triangles drawn and culled by the last DrawLod
+   PatchStats getLodStats() const {
+      return lod.has_value() ? lod->getStats() : PatchStats{};
+   }
+
+   /// @brief Patches and triangles drawn and culled by the last Draw
+   PatchStats getDrawStats() const {
+      return mesh.has_value() ? mesh->getStats() : PatchStats{};
+   }
+
+   /// @brief Error map for simplified triangulations of the current heights, see Rtin
+   const Rtin& getRtin();
+
+   /// @brief Adaptive triangulation of the current heights with a vertical error of at most maxError, as grid vertex indices.
+   std::vector<GLuint> simplify(const float maxError) {
+      return getRtin().triangulate(maxError);
+   }
+
+   /// @brief Smallest error threshold for simplify which gives at most maxTriangles triangles
+   float errorForTriangleBudget(const std::size_t maxTriangles) {
+      return getRtin().errorForBudget(maxTriangles);
+   }
+
+   /// @brief Draw the simplified triangulation instead of the full grid, it is recomputed whenever the heights change.
+   /// @param enabled Whether to draw the simplified triangulation
+   /// @param maxError Vertical error threshold passed to simplify
+   void setRenderSimplification(const bool enabled, const float maxError);
+
+   /// @brief Skip the patches of the full resolution mesh outside the view frustum, DrawLod always culls
+   void setFrustumCulling(const bool enabled);
+
+   bool isFrustumCulling() const {
+      return frustumCulling;
+   }
+
+   //void ExportConfiguration(const std::string& filename); // to JSON
 
    // --- Getter functions ---
 
@@ -105,6 +300,20 @@ class Terrain {
       return baselineParams;
    }
 
+   /// @note Changes take effect with the next build, see scheduleBuild
+   std::vector<perlin::WarpParams>& getNoiseWarps() {
+      return noiseWarps;
+   }
+
+   std::vector<perlin::WarpParams>& getBaselineWarps() {
+      return baselineWarps;
+   }
+
+   /// @brief Whether the first build has been uploaded
+   bool hasMesh() const {
+      return mesh.has_value();
+   }
+
    Mesh& getMesh() {
       return mesh.value();
    }
@@ -67,6 +67,9 @@ class Terrain3D {
    /// @return Vector of filter layer parameters.
    std::vector<std::pair<unsigned, double>> getFilterLayersParams();
 
+   /// @brief Combine noise and baseline and build the mesh from the result.
+   void computeMesh();
+
    /// @brief Draw the terrain using the given shader and camera.
    /// @param shader Shader to use for drawing.
    /// @param camera Camera to use for drawing.
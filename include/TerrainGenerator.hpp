@@ -0,0 +1,256 @@
+#ifndef TERRAIN_GENERATOR_CLASS_HPP
+#define TERRAIN_GENERATOR_CLASS_HPP
+
+#include "Erosion.hpp"
+#include "HeightfieldExpr.hpp"
+#include "HeightfieldFilters.hpp"
+#include "LayerCache.hpp"
+#include "Mesh.hpp"
+#include "PerlinLayer.hpp"
+#include "TerrainGraph.hpp"
+#include "TerrainSnapshot.hpp"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+
+using layerP = std::pair<unsigned, double>;
+
+/// @brief Stages applied to the combined heightfield before the mesh is built, in this order
+struct PostProcessParams {
+   perlin::HydraulicErosionParams hydraulic;
+   perlin::ThermalErosionParams thermal;
+   perlin::SmoothingParams smoothing;
+
+   bool anyEnabled() const {
+      return hydraulic.enabled || thermal.enabled || smoothing.enabled;
+   }
+};
+
+/// @brief Write the parameters of all stages as the keys "erosion", "thermalErosion" and "smoothing" of a settings object
+void postProcessToJson(const PostProcessParams& params, nlohmann::json& j);
+
+/// @brief Read the keys written by postProcessToJson, missing values keep those of params and missing stages are disabled
+PostProcessParams postProcessFromJson(const nlohmann::json& j, PostProcessParams params);
+
+/// @brief Region [x0, x1) x [y0, y1) of the heights, indexed like the layers
+struct GridRegion {
+   unsigned x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+
+   bool empty() const {
+      return x0 >= x1 || y0 >= y1;
+   }
+};
+
+/// @brief Everything the heights of a terrain depend on. A copy is handed to every build, so the GUI can keep editing meanwhile.
+struct TerrainSettings {
+   int seed;
+   double flattenFactor;
+   std::vector<layerP> noiseParams; // (chunk size, weight) per noise layer
+   std::vector<layerP> baselineParams;
+   std::vector<perlin::WarpParams> noiseWarps; // domain warp per noise layer
+   std::vector<perlin::WarpParams> baselineWarps;
+   PostProcessParams postProcessParams;
+   std::shared_ptr<TerrainGraph> graph; // custom pipeline replacing the layer stacks, only used by the generator
+   perlin::LayerStorage layerStorage = perlin::LayerStorage::DOUBLE; // of the filled layers, QUANTIZED16 for a quarter of the memory
+   GridRegion view; // part of the terrain in view, evaluated first by graph builds, may be empty
+};
+
+/**
+ * CPU side of a Terrain: the gradients, the noise and baseline layers with their sums (or a node graph),
+ * and the grid mesh built from them. Has no OpenGL state, so it can run on a worker thread.
+ * The state of the last build is kept, the next one only recomputes the layers whose parameters changed.
+ * Layers replaced by other parameters or another seed go into a LayerCache shared by both stacks, so going back to
+ * them (or using them in the other stack) takes their values from there instead of computing them.
+ * The layers can be kept quantized to 16 bits (see perlin::QuantizedMatrix), the sums stay exact sums of the quantized
+ * values, so the heights differ from those of exact layers by at most 1.08e-5 times the sum of the absolute weights
+ * divided by the normalizing factor.
+ * When the layer stacks are computed from scratch (first build, new seed) the layers are filled coarse to fine and a
+ * preview mesh at 1/8, 1/4 and 1/2 of the resolution is handed out after each pass, every pass reusing the points
+ * of the coarser ones (see PerlinLayer::fillLattice).
+ * With a node graph the tiles in view (TerrainSettings::view) are evaluated first and handed out as a full resolution
+ * preview on top of the heights of the last build, before the rest of the terrain is evaluated.
+ * Builds can be cancelled between chunks of a layer and between stages. A cancelled layer is left out of the
+ * sums until it is filled again, so the generator stays consistent and the next build continues from there.
+ * Without threads a build can also run in slices on the calling thread (begin, then step once per frame), it then
+ * works on one row of a layer, of the heights or of the normals at a time.
+ * @note Not thread safe, the builds of one generator must not overlap.
+ * @author SD
+ */
+class TerrainGenerator {
+   public:
+   /// @brief Receives the vertices of a coarse preview and its stride (every stride-th vertex of the full grid)
+   using PreviewCallback = std::function<void(GridMeshData&& mesh, unsigned stride)>;
+
+   TerrainGenerator(unsigned sizeX, unsigned sizeY);
+
+   /**
+    * Bring the layers to the given settings and build the vertices of the mesh.
+    * A new seed recomputes everything, otherwise a changed weight is added to the sum as a difference and
+    * a changed chunk size or warp refills only that layer.
+    * @param settings Parameters of the terrain, the graph (if any) must have the size of the generator
+    * @param cancel Polled between chunks of the layers and between the stages
+    * @param preview Called with the coarse meshes when the layers are computed from scratch, or with the part of a node
+    * graph in view (stride 1) when an earlier build left heights to draw it on, may be empty.
+    * Previews skip the post-processing stages, graphs with erosion or smoothing nodes have no previews.
+    * @return Vertices ready for Mesh
+    * @throws perlin::Cancelled if the token is cancelled
+    */
+   GridMeshData generate(const TerrainSettings& settings, const perlin::CancelToken& cancel = {}, const PreviewCallback& preview = {});
+
+   using Clock = std::chrono::steady_clock;
+
+   /**
+    * Start a build which runs in slices through step, with the same result as generate. It replaces the stepped build
+    * in progress (if any): the layers it finished are kept, the one it was filling is computed again.
+    * @param settings Parameters of the terrain, the graph (if any) must have the size of the generator
+    */
+   void begin(const TerrainSettings& settings);
+
+   /**
+    * Continue the build started by begin until it is finished or the deadline has passed.
+    * The layers are filled one row at a time, the sums, heights and normals one band of rows at a time, so a step ends
+    * shortly after the deadline. Adding a layer to its sum, the graph evaluation, the post-processing and the height
+    * pyramid run as one unit each. Stepped builds have no previews.
+    * @param deadline Time after which no further unit is started, at least one unit runs per call
+    * @return The vertices once the build is finished, nothing before or without a build
+    */
+   std::optional<GridMeshData> step(Clock::time_point deadline);
+
+   /// @brief Whether a build started by begin is not finished yet
+   bool isStepping() const {
+      return stepping.has_value();
+   }
+
+   /// @brief Bytes of replaced layers kept for reuse (see LayerCache), 0 disables the cache. Must not overlap with a build.
+   void setLayerCacheBudget(const std::size_t bytes) {
+      layerCache.setBudget(bytes);
+   }
+
+   /// @brief Keep the layers exact or quantized. Exact layers are quantized at once, quantized ones are filled again
+   /// by the next build (or taken from the cache). Builds call it with TerrainSettings::layerStorage.
+   /// Must not overlap with a build.
+   void setLayerStorage(perlin::LayerStorage storage);
+
+   perlin::LayerStorage getLayerStorage() const {
+      return layerStorage;
+   }
+
+   /// @brief The gradients every generator uses for a seed, thread safe
+   static std::vector<perlin::vec2d> gradientsFor(int seed);
+
+   /**
+    * Heights of the region [x0, x1) x [y0, y1) straight from the noise functions (see PerlinLayer::fillRegion), without
+    * any layer matrices. Regions of a map of any size can so be computed independently and on any thread, e.g. tiles.
+    * The heights are those of generate up to rounding, the layers are summed in their order here.
+    * @param settings Parameters of the terrain, without graph and post-processing, they need the whole heightfield
+    * @param gradients gradientsFor(settings.seed)
+    * @param out (x1 - x0) * (y1 - y0) heights row by row, height (x, y) at (y - y0) * (x1 - x0) + x - x0
+    * @throws std::invalid_argument for settings with a graph or enabled post-processing
+    */
+   static void regionHeights(const TerrainSettings& settings, const std::vector<perlin::vec2d>& gradients, unsigned x0, unsigned y0,
+                             unsigned x1, unsigned y1, float* out);
+
+   /**
+    * Add the gradients, the layers and their sums to a snapshot. A stack is only saved if all of its layers are filled,
+    * otherwise it is computed again after restore. Quantized layers are saved as their codes. Must not overlap with a build.
+    * @param writer Receives the sections, they refer to the data of the generator until it is written
+    * @return Description of the sections for restore (seed and parameters of the saved layers)
+    */
+   nlohmann::json addToSnapshot(SnapshotWriter& writer) const;
+
+   /**
+    * Take over the state saved by addToSnapshot, the next build with the same settings only builds the mesh.
+    * A stepped build in progress is dropped. The layer storage becomes the one the layers were saved with.
+    * @param snapshot Validated snapshot file
+    * @param state Description returned by addToSnapshot
+    * @throws std::runtime_error if the sections or values of the state are missing or do not have the size of the generator
+    */
+   void restore(const Snapshot& snapshot, const nlohmann::json& state);
+
+   private:
+   /// @brief Stages of a stepped build, in this order
+   enum class Stage { LAYERS, COMBINE, HEIGHTS, NORMALS };
+
+   /// @brief Progress of the build run by step
+   struct StepState {
+      TerrainSettings settings;
+      Stage stage = Stage::LAYERS;
+      std::size_t layer = 0; // noise layers first, then the baseline layers
+      unsigned row = 0; // next row of the layer, tile row of the heights or row of the normals
+      perlin::matrix heights; // materialized heights, only with a graph or post-processing
+      GridMeshData mesh;
+   };
+
+
+   /// @brief Default budget of the layer cache, 16 layers of 1440 x 1440
+   static constexpr std::size_t defaultLayerCacheBytes = std::size_t(256) << 20;
+
+   /// @brief Stride of the first preview, 1/8 of the resolution
+   static constexpr unsigned coarsestPreviewStride = 8;
+
+   unsigned sizeX, sizeY;
+   bool seeded = false;
+   int seed = 0;
+   std::vector<perlin::vec2d> gradients;
+   std::vector<perlin::PerlinLayer> noiseLayers;
+   std::vector<perlin::PerlinLayer> baselineLayers;
+   perlin::matrix noise; // weighted sum of the noise layers, empty until they are computed
+   perlin::matrix baseline;
+   std::shared_ptr<TerrainGraph> graph; // graph of the last build, its gradients are set
+   perlin::matrix graphHeights; // output of the graph in the last build with previews, the view preview is drawn on it
+   std::optional<StepState> stepping; // build run by step, if any
+   perlin::LayerStorage layerStorage = perlin::LayerStorage::DOUBLE;
+
+   perlin::LayerCache layerCache{defaultLayerCacheBytes}; // layers replaced by other chunk sizes, warps or seeds
+
+   /// @brief Key of the values of a layer of this generator
+   perlin::LayerKey keyOf(const perlin::PerlinLayer& layer) const;
+
+   /// @brief Move the values of a filled layer into the cache before its parameters change
+   void retire(perlin::PerlinLayer& layer);
+
+   /// @brief Take the values for the parameters of a layer from the cache, if there
+   /// @return Whether the layer is filled now
+   bool reuse(perlin::PerlinLayer& layer);
+
+   /// @brief New gradients for the seed, the layers are computed again when they are used next
+   void reseed(int newSeed);
+
+   /// @brief Take over the seed, the graph and its flatten factor and the layer storage, the start of every build
+   void applySettings(const TerrainSettings& settings);
+
+   /// @brief Divisor of the combined noise and baseline sums
+   static double normalizingFactor(const TerrainSettings& settings);
+
+   /// @brief Create the layers of a stack (unfilled, weight 0) if the stack has to be computed from scratch
+   void prepareStack(std::vector<perlin::PerlinLayer>& layers, perlin::matrix& sum, const std::vector<layerP>& params,
+                     const std::vector<perlin::WarpParams>& warps);
+
+   /// @brief Rows of a sum allocated per unit of a stepped build
+   static constexpr unsigned sumRowsPerStep = 128;
+
+   /// @brief Allocate the missing rows of the sum of a stack (zeros, all of its layers are then out of the sum)
+   /// @param maxRows Allocate at most this many rows
+   /// @return Whether all rows are allocated
+   bool allocateSum(perlin::matrix& sum, unsigned maxRows = ~0u) const;
+
+   /// @brief Fill all layers coarse to fine, handing a preview to the callback after every pass but the last
+   void fillProgressive(const TerrainSettings& settings, const perlin::CancelToken& cancel, const PreviewCallback& preview);
+
+   /// @brief Bring a layer stack and its weighted sum to the given parameters
+   void updateStack(std::vector<perlin::PerlinLayer>& layers, perlin::matrix& sum, const std::vector<layerP>& params,
+                    const std::vector<perlin::WarpParams>& warps, const perlin::CancelToken& cancel);
+
+   /// @brief Next unit of the layer stage of the stepped build, false once all layers are up to date
+   bool stepLayers(StepState& state);
+
+   /// @brief Run the enabled erosion and smoothing stages on the combined heightfield
+   static void postProcess(perlin::matrix& heights, const PostProcessParams& params, const perlin::CancelToken& cancel);
+
+   /// @brief Vertices of the grid mesh for a heightfield expression of size sizeX x sizeY
+   template <typename E>
+   static GridMeshData buildMesh(const perlin::hf::Expr<E>& heights);
+};
+
+#endif // TERRAIN_GENERATOR_CLASS_HPP
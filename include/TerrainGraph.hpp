@@ -0,0 +1,195 @@
+#ifndef TERRAIN_GRAPH_CLASS_HPP
+#define TERRAIN_GRAPH_CLASS_HPP
+
+#include "CancelToken.hpp"
+#include "Erosion.hpp"
+#include "HeightfieldFilters.hpp"
+#include "PerlinLayer.hpp"
+#include <cstdint>
+#include <json.hpp>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// @brief Kind of a node in the terrain graph
+enum class GraphNodeType {
+   NOISE, // Perlin noise layer with a given chunk size (generator, no inputs)
+   COMBINE, // weighted sum of the inputs
+   MAX, // element-wise maximum of the inputs
+   NORMALIZE, // divide the input by flatten * (total weight of the input)
+   // Filters of the whole heightfield of their input, see TerrainGraph for how they are evaluated
+   HYDRAULIC_EROSION,
+   THERMAL_EROSION,
+   SMOOTH
+};
+
+/// @brief A generator or operator node. Inputs always refer to nodes added before this one, so the graph is acyclic by construction.
+struct GraphNode {
+   GraphNodeType type = GraphNodeType::NOISE;
+   std::vector<unsigned> inputs;
+   unsigned chunkSize = 1; // NOISE
+   perlin::WarpParams warp; // NOISE, domain warp of the sample coordinates
+   std::vector<double> weights; // COMBINE, one weight per input
+   double flatten = 1.0; // NORMALIZE
+   perlin::HydraulicErosionParams hydraulic; // HYDRAULIC_EROSION, the enabled flags of the filters are ignored
+   perlin::ThermalErosionParams thermal; // THERMAL_EROSION
+   perlin::SmoothingParams smoothing; // SMOOTH
+};
+
+/// @brief Values of one node on one tile. Stored like perlin::matrix, i.e. x-major: values[(x - x0) * height + (y - y0)]
+struct GraphTile {
+   unsigned x0, y0, width, height;
+   std::vector<double> values;
+
+   double at(unsigned x, unsigned y) const {
+      return values[(x - x0) * height + (y - y0)];
+   }
+};
+
+/**
+ * Terrain pipeline described as a DAG of generator and operator nodes.
+ * Evaluation is lazy and per tile: only the tiles of the requested region are computed,
+ * and only for the nodes the requested node depends on.
+ * Every node's tiles are memoized under a hash of its parameters and of its inputs' hashes (and the seed),
+ * so editing one node only invalidates that node and the nodes downstream of it.
+ * Erosion and smoothing nodes move material across the whole heightfield, so they cannot work on one tile: they
+ * evaluate their input on the whole terrain, filter it once (memoized under their hash like the tiles) and hand out
+ * tiles of the result. Regions depending on such a node therefore cost the whole terrain, see needsWholeMap.
+ * @author SD
+ */
+class TerrainGraph {
+   public:
+   /// @param sizeX, sizeY extent of the terrain
+   /// @param tileSize side length of the evaluation tiles
+   /// @param maxCachedTiles bound on the number of memoized tiles (least recently used are dropped first)
+   TerrainGraph(const unsigned sizeX, const unsigned sizeY, const unsigned tileSize = 128, const std::size_t maxCachedTiles = 4096);
+
+   // Movable (the cache moves along), not copyable
+   TerrainGraph(TerrainGraph&& other) noexcept;
+   TerrainGraph& operator=(TerrainGraph&& other) noexcept;
+   TerrainGraph(const TerrainGraph&) = delete;
+   TerrainGraph& operator=(const TerrainGraph&) = delete;
+
+   /// @brief Build the graph equivalent to Terrain's layer stacks:
+   /// normalize(max(combine(noise layers), combine(baseline layers)), flatten)
+   /// @param noiseWarps, baselineWarps domain warp per layer, missing entries mean no warp
+   static TerrainGraph fromLayers(const unsigned sizeX, const unsigned sizeY, const std::vector<std::pair<unsigned, double>>& noiseParams,
+                                  const std::vector<std::pair<unsigned, double>>& baselineParams, const double flatten,
+                                  const std::vector<perlin::WarpParams>& noiseWarps = {}, const std::vector<perlin::WarpParams>& baselineWarps = {});
+
+   // --- Building and editing ---
+
+   /// @brief Add a node and return its index. The last added node becomes the output.
+   /// @throws std::invalid_argument if the node refers to inputs which do not exist yet or has invalid parameters
+   unsigned addNode(const GraphNode& node);
+   unsigned addNoise(const unsigned chunkSize, const perlin::WarpParams& warp = {});
+   unsigned addCombine(const std::vector<unsigned>& inputs, const std::vector<double>& weights);
+   unsigned addMax(const std::vector<unsigned>& inputs);
+   unsigned addNormalize(const unsigned input, const double flatten);
+   unsigned addHydraulicErosion(const unsigned input, const perlin::HydraulicErosionParams& params);
+   unsigned addThermalErosion(const unsigned input, const perlin::ThermalErosionParams& params);
+   unsigned addSmooth(const unsigned input, const perlin::SmoothingParams& params);
+
+   /// @brief Replace the parameters of a node. Only this node and its downstream nodes will be recomputed.
+   /// @throws std::invalid_argument on invalid index or parameters
+   void updateNode(const unsigned index, const GraphNode& node);
+
+   const GraphNode& getNode(const unsigned index) const { return nodes.at(index); }
+   std::size_t numNodes() const { return nodes.size(); }
+
+   void setOutput(const unsigned index);
+   unsigned getOutput() const { return output; }
+
+   /// @brief Set the gradients (i.e. the seed) used by the noise nodes
+   void setGradients(const std::vector<perlin::vec2d>& gradients, const int seed);
+
+   // --- Evaluation ---
+
+   /// @brief Evaluate (or fetch from the cache) one tile of a node
+   /// @param tileX, tileY tile coordinates, i.e. the tile starts at (tileX * tileSize, tileY * tileSize)
+   std::shared_ptr<const GraphTile> evaluateTile(const unsigned index, const unsigned tileX, const unsigned tileY);
+
+   /// @brief Evaluate the output node on the region [x0, x1) x [y0, y1), e.g. the part of the terrain in view
+   /// @param out matrix of size sizeX x sizeY, only the region is written
+   /// @param cancel Polled between tiles, the tiles not started yet are skipped once it is cancelled
+   /// @throws perlin::Cancelled if the token is cancelled
+   void evaluateRegion(perlin::matrix& out, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1,
+                       const perlin::CancelToken& cancel = {});
+
+   /// @brief Evaluate the output node on the whole terrain
+   /// @throws perlin::Cancelled if the token is cancelled
+   perlin::matrix evaluate(const perlin::CancelToken& cancel = {});
+
+   /// @brief Whether the node is, or depends on, an erosion or smoothing node, so that any tile of it needs the whole terrain
+   bool needsWholeMap(const unsigned index) const;
+
+   /// @brief Drop all memoized tiles
+   void clearCache();
+
+   std::size_t cachedTiles() const;
+
+   // --- Serialization ---
+
+   nlohmann::json toJson() const;
+
+   /// @throws std::invalid_argument if the description is not a valid graph
+   static TerrainGraph fromJson(const nlohmann::json& j, const unsigned sizeX, const unsigned sizeY);
+
+   unsigned getSizeX() const { return sizeX; }
+   unsigned getSizeY() const { return sizeY; }
+
+   private:
+   struct CacheKey {
+      std::uint64_t hash;
+      unsigned tileX, tileY;
+      bool operator==(const CacheKey& other) const { return hash == other.hash && tileX == other.tileX && tileY == other.tileY; }
+   };
+   struct CacheKeyHasher {
+      std::size_t operator()(const CacheKey& key) const {
+         return key.hash ^ (std::size_t(key.tileX) * 0x9E3779B97F4A7C15ull) ^ (std::size_t(key.tileY) << 32);
+      }
+   };
+   using LruList = std::list<CacheKey>;
+   struct CacheEntry {
+      std::shared_ptr<const GraphTile> tile;
+      LruList::iterator lruPosition;
+   };
+
+   unsigned sizeX;
+   unsigned sizeY;
+   unsigned tileSize;
+   std::size_t maxCachedTiles;
+   int seed = 0;
+   std::vector<perlin::vec2d> gradients;
+   std::vector<GraphNode> nodes;
+   std::vector<std::uint64_t> hashes; // parameter hash of each node, including its inputs' hashes
+   unsigned output = 0;
+
+   /// @brief Output of an erosion or smoothing node on the whole terrain, computed by the first thread asking for it
+   struct WholeMap {
+      std::once_flag computed;
+      perlin::matrix values;
+   };
+
+   mutable std::mutex cacheMutex;
+   std::unordered_map<CacheKey, CacheEntry, CacheKeyHasher> cache;
+   LruList lru; // front = most recently used
+   std::unordered_map<std::uint64_t, std::shared_ptr<WholeMap>> wholeMaps; // by node hash, only of the current nodes
+
+   void validate(const GraphNode& node, const unsigned index) const;
+   void rehash(); // recompute all node hashes, in topological (= index) order
+   double referenceWeight(const unsigned index) const;
+   void computeTile(const unsigned index, GraphTile& tile);
+
+   /// @brief Evaluate any node on the region [x0, x1) x [y0, y1), the tiles in parallel
+   void evaluateNodeRegion(const unsigned index, perlin::matrix& out, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1,
+                           const perlin::CancelToken& cancel);
+
+   /// @brief The memoized output of an erosion or smoothing node on the whole terrain
+   std::shared_ptr<const WholeMap> wholeMap(const unsigned index);
+};
+
+#endif // TERRAIN_GRAPH_CLASS_HPP
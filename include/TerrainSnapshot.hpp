@@ -0,0 +1,126 @@
+#ifndef TERRAIN_SNAPSHOT_HPP
+#define TERRAIN_SNAPSHOT_HPP
+
+#include "FileParts.hpp"
+#include "PerlinUtils.hpp"
+#include <cstdint>
+#include <json.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
+/// @brief Alignment of the sections within a snapshot file, in bytes
+constexpr std::size_t snapshotAlignment = 64;
+
+/// @brief Version written into new snapshots, files of other versions are rejected
+constexpr std::uint32_t snapshotVersion = 1;
+
+/// @brief Kinds of data in a snapshot, several sections of a kind are told apart by their index
+enum class SnapshotSection : std::uint32_t {
+   PARAMETERS = 1, // JSON text
+   GRADIENTS, // vec2d array
+   NOISE_LAYER, // sizeX x sizeY doubles, row x of the matrix after row x - 1, index = layer
+   BASELINE_LAYER,
+   NOISE_SUM,
+   BASELINE_SUM,
+   HEIGHTS, // floats in vertex order, vertex (i, j) at j * sizeX + i
+   MESH_VERTICES, // TerrainVertex array of the grid mesh
+   NOISE_LAYER_CODES, // sizeX x sizeY uint16 codes of a quantized layer (see perlin::QuantizedMatrix), rows like NOISE_LAYER
+   BASELINE_LAYER_CODES
+};
+
+/**
+ * Builds a snapshot file: a header, a table of the sections and the sections, each starting at a multiple of
+ * snapshotAlignment bytes. Every section has its own 64-bit checksum, computed on all threads (a section per thread).
+ * The data is written in place with a single gathered write, nothing is copied.
+ * The byte order is that of the host, only little endian hosts read and write snapshots.
+ * @author SD
+ */
+class SnapshotWriter {
+   public:
+   /// @brief Add a section, the data must stay valid until write
+   void add(SnapshotSection type, std::uint32_t index, const void* data, std::size_t size);
+
+   /// @brief Add the rows of a matrix as one section, rows[x][y] at (x * rows[0].size() + y) * 8
+   /// @throws std::invalid_argument if the rows differ in length
+   void addMatrix(SnapshotSection type, std::uint32_t index, const perlin::matrix& rows);
+
+   /// @brief Add a matrix computed for the snapshot, the writer keeps it until write
+   /// @throws std::invalid_argument if the rows differ in length
+   void addMatrix(SnapshotSection type, std::uint32_t index, perlin::matrix&& rows);
+
+   /// @brief Add the rows of quantized codes as one section, rows[x][y] at (x * rows[0].size() + y) * 2
+   /// @throws std::invalid_argument if the rows differ in length
+   void addCodes(SnapshotSection type, std::uint32_t index, const std::vector<std::vector<std::uint16_t>>& rows);
+
+   /**
+    * Write the file, the parameters become the PARAMETERS section.
+    * @return Whether the file was written completely, errors are reported on std::cerr
+    * @throws std::runtime_error on a big endian host
+    */
+   bool write(const std::string& filename, const nlohmann::json& parameters);
+
+   private:
+   struct Section {
+      SnapshotSection type;
+      std::uint32_t index;
+      std::vector<FilePart> parts;
+   };
+   std::vector<Section> sections;
+   std::list<perlin::matrix> owned; // matrices added by value, a list so the rows never move
+};
+
+/**
+ * A snapshot file mapped into memory (read into a buffer where mmap is not available).
+ * Opening checks the header and the checksums of all sections, on all threads, so every section handed out is valid.
+ * Sections are views into the mapping, aligned to snapshotAlignment, and stay valid as long as the snapshot.
+ * @author SD
+ */
+class Snapshot {
+   public:
+   /// @throws std::runtime_error if the file cannot be read, is no snapshot, has another version or a wrong checksum
+   explicit Snapshot(const std::string& filename);
+   ~Snapshot();
+
+   Snapshot(const Snapshot&) = delete;
+   Snapshot& operator=(const Snapshot&) = delete;
+
+   const nlohmann::json& getParameters() const {
+      return parameters;
+   }
+
+   /// @brief A section, data is nullptr if the file has none of this type and index
+   FilePart find(SnapshotSection type, std::uint32_t index = 0) const;
+
+   /// @brief A section which must be there with the given size
+   /// @throws std::runtime_error if it is missing or has another size
+   FilePart require(SnapshotSection type, std::uint32_t index, std::size_t size) const;
+
+   /// @brief Copy a section written by addMatrix into sizeX rows of sizeY values, the rows in parallel
+   /// @throws std::runtime_error if it is missing or has another size
+   perlin::matrix readMatrix(SnapshotSection type, std::uint32_t index, unsigned sizeX, unsigned sizeY) const;
+
+   /// @brief Copy a section written by addCodes into sizeX rows of sizeY codes, the rows in parallel
+   /// @throws std::runtime_error if it is missing or has another size
+   std::vector<std::vector<std::uint16_t>> readCodes(SnapshotSection type, std::uint32_t index, unsigned sizeX, unsigned sizeY) const;
+
+   private:
+   struct Entry {
+      std::uint32_t type, index;
+      std::uint64_t offset, size, checksum;
+   };
+
+   std::string filename;
+   const unsigned char* data = nullptr;
+   std::size_t size = 0;
+   std::vector<Entry> entries;
+   nlohmann::json parameters;
+#if defined(__unix__) || defined(__APPLE__)
+   bool mapped = false;
+#endif
+   std::vector<std::uint64_t> buffer; // file contents if it is not mapped
+
+   void fail(const std::string& what) const;
+};
+
+#endif
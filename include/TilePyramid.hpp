@@ -0,0 +1,38 @@
+#ifndef TILE_PYRAMID_HPP
+#define TILE_PYRAMID_HPP
+
+#include "HeightmapExport.hpp"
+#include "TerrainGenerator.hpp"
+#include <string>
+
+/// @brief File format of the tiles of a pyramid
+enum class TileFormat { PNG16, R16, F32 };
+
+/// @brief Layout and format of ExportTilePyramid
+struct TileExportOptions {
+   unsigned tileSize = 256; // pixels per side of a tile, even
+   TileFormat format = TileFormat::PNG16;
+   HeightmapOptions heightmap; // height range of PNG16 and R16 (fixed up front, the tiles are written as they are computed) and the PNG compression
+};
+
+/**
+ * Exports a terrain of any size as a pyramid of heightmap tiles in the XYZ layout of web maps, directory/{z}/{x}/{y}.png
+ * (or .r16, .f32), with a manifest.json describing the levels. Zoom maxZoom holds the full resolution, it is the
+ * lowest zoom whose tiles cover the map, every level above halves the resolution (2x2 average, rounded up), down to
+ * zoom 0 with a single tile. Tiles on the right and bottom edge are padded by repeating their last column and row.
+ * The heights are never held as a whole: every leaf tile is computed straight from the noise functions
+ * (TerrainGenerator::regionHeights), so the map may be far larger than the memory. The tiles are built depth first,
+ * the subtrees of one level in parallel, each keeping only the tiles of its path down to the leaves, and written as
+ * soon as they are complete.
+ * @param settings Parameters of the terrain, without graph and post-processing, they need the whole heightfield
+ * @param sizeX, sizeY Size of the map in pixels
+ * @param directory Root of the pyramid, created if needed
+ * @param options Tile size, format and height range
+ * @return Whether all tiles were written, the first failure stops the export and is reported on std::cerr
+ * @throws std::invalid_argument for an empty map, an odd tile size or settings with a graph or enabled post-processing
+ * @author SD
+ */
+bool ExportTilePyramid(const TerrainSettings& settings, unsigned sizeX, unsigned sizeY, const std::string& directory,
+                       const TileExportOptions& options = {});
+
+#endif
@@ -5,6 +5,7 @@
 
 #include "Window.hpp"
 #include "ShaderClass.hpp"
+#include "Frustum.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -39,6 +40,9 @@ class Camera {
    /// @brief matrix which describes the transformation applied to the objects being rendered
    glm::mat4 cameraMatrix = glm::mat4(1.0f);
 
+   /// @brief part of `cameraMatrix` which transforms the objects themselves (e.g. rotating the terrain), applied before the view
+   glm::mat4 modelMatrix = glm::mat4(1.0f);
+
    /// @brief scaling factor for keyboard input
    float speed = 0.7f;
 
@@ -54,6 +58,11 @@ class Camera {
    /// @param uniform name of cameraMatrix inside the shader
    void Matrix(Shader& shader, const char* uniform);
 
+   /// @brief view frustum of the current `cameraMatrix`, in the coordinates of the objects being rendered
+   Frustum frustum() const {
+      return Frustum(cameraMatrix);
+   }
+
    /// @brief updates the `cameraMatrix` based on current values of `Position` and `Orientation`
    /// @param FOVdeg field of view in degrees
    /// @param nearPlane minimum distance at which the camera can see
@@ -0,0 +1,24 @@
+#ifndef FRUSTUM_CLASS_HPP
+#define FRUSTUM_CLASS_HPP
+
+#include <glm/glm.hpp>
+
+/**
+ * The six planes of a view frustum, taken from a combined projection * view (* model) matrix,
+ * so the planes are in the coordinates the matrix is applied to.
+ * @author SD
+ */
+class Frustum {
+   public:
+   /// @param matrix e.g. Camera::cameraMatrix
+   explicit Frustum(const glm::mat4& matrix);
+
+   /// @brief Whether the axis aligned box [low, high] is at least partially inside the frustum
+   /// @note Conservative: boxes close to an edge of the frustum may be reported as intersecting although they are outside
+   bool intersects(const glm::vec3& low, const glm::vec3& high) const;
+
+   private:
+   glm::vec4 planes[6]; // dot(plane.xyz, p) + plane.w >= 0 inside
+};
+
+#endif
@@ -11,11 +11,17 @@
 /// https://github.com/VictorGordan/opengl-tutorials
 class EBO {
    public:
-   GLuint ID;
+   GLuint ID = 0;
+   /// @brief No buffer yet, it is created by the first call of Data
+   EBO() = default;
    EBO(std::vector<GLuint>& indices);
 
+   /// @brief (Re)allocate the buffer with the given content, creating it if needed
+   /// @note Binds the buffer to the currently bound VAO
+   void Data(const void* data, GLsizeiptr size, GLenum usage);
+
    void Bind();
    void Unbind();
    void Delete();
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,59 @@
+#ifndef FILE_PARTS_HPP
+#define FILE_PARTS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#if !defined(__unix__) && !defined(__APPLE__)
+#include <fstream>
+#endif
+
+/// @brief A piece of a file, written without copying
+struct FilePart {
+   const void* data;
+   std::size_t size;
+};
+
+/**
+ * Write the parts one after the other into a new file.
+ * With POSIX this is a gathered write (writev) with as few system calls as possible, otherwise one write per part.
+ * @return Whether the file was written completely, errors are reported on std::cerr
+ * @author SD
+ */
+bool writeFileParts(const std::string& filename, const std::vector<FilePart>& parts);
+
+/**
+ * New file written in blocks, with POSIX every block is a single system call (more only after a partial write).
+ * The first error is reported on std::cerr, later writes are then skipped.
+ * @author SD
+ */
+class BlockFile {
+   public:
+   explicit BlockFile(const std::string& filename);
+   ~BlockFile();
+
+   BlockFile(const BlockFile&) = delete;
+   BlockFile& operator=(const BlockFile&) = delete;
+
+   /// @return Whether everything up to now was written
+   bool write(const void* data, std::size_t size);
+
+   /// @return Whether the whole file was written and closed
+   bool close();
+
+   private:
+   std::string filename;
+   bool ok = true;
+#if defined(__unix__) || defined(__APPLE__)
+   int fd = -1;
+#else
+   std::ofstream file;
+#endif
+
+   void fail(const char* what);
+};
+
+/// @brief Whether the host stores the lowest byte of an integer first
+bool littleEndianHost();
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef GRID_NORMALS_HPP
+#define GRID_NORMALS_HPP
+
+#include "VBO.hpp"
+#include <algorithm>
+#include <vector>
+
+/**
+ * Vertex normals of a regular grid mesh, computed directly on the heights instead of scattering over the index buffer.
+ * Every vertex gathers the normalized face normals of the (up to 6) triangles around it, in the same order as
+ * the triangle list of the IndexCache, so the result is bitwise the same as computeTriangleNormals on that list
+ * (both without floating point contraction, see CMakeLists.txt).
+ * Face normals are computed once per row of quads into a small rolling buffer with a branch free, vectorized loop,
+ * and the rows are split into bands processed on separate threads.
+ * @param vertices sizeX * sizeY vertices, vertex (i, j) is vertices[j * sizeX + i], their normals are overwritten
+ * @param sizeX, sizeY number of vertices along x and z, at least 2 each
+ * @author SD
+ */
+void computeGridNormals(std::vector<TerrainVertex>& vertices, unsigned long sizeX, unsigned long sizeY);
+
+/**
+ * Normals of the vertex rows [begin, end) only, the same values computeGridNormals gives them.
+ * The heights of the rows begin - 1 and end are read as well, so the rows can be done in any order once all heights are set.
+ * Every call recomputes the face normals of one extra quad row, bands of gridNormalBandRows rows keep that overhead small.
+ * @author SD
+ */
+void computeGridNormalRows(std::vector<TerrainVertex>& vertices, unsigned long sizeX, unsigned long sizeY, unsigned long begin, unsigned long end);
+
+/**
+ * Vertex normals by scattering the normalized face normals of a triangle list onto its vertices, for meshes with
+ * arbitrary triangles. Lives next to computeGridNormals and is built with the same flags, so both give bitwise
+ * the same normals for the triangle list of the IndexCache.
+ * @param vertices sizeX * sizeY vertices laid out as a grid, their normals are overwritten
+ * @param triangles 3 vertex indices per triangle
+ * @author SD
+ */
+void computeTriangleNormals(std::vector<TerrainVertex>& vertices, unsigned long sizeX, unsigned long sizeY, const std::vector<GLuint>& triangles);
+
+/// @brief Rows per band of computeGridNormalRows for a grid sizeX vertices wide, about 16k vertices
+inline unsigned long gridNormalBandRows(const unsigned long sizeX) {
+   return std::max<unsigned long>(1, 16384 / sizeX);
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef HEIGHT_PYRAMID_CLASS_HPP
+#define HEIGHT_PYRAMID_CLASS_HPP
+
+#include "VBO.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+/// @brief Patches of a terrain drawn and skipped by frustum culling in the last frame
+struct PatchStats {
+   unsigned patches = 0;
+   unsigned culledPatches = 0;
+   unsigned long triangles = 0;
+   unsigned long culledTriangles = 0;
+};
+
+/**
+ * Minimum and maximum height of square cells of a grid mesh, for bounding boxes of terrain patches.
+ * Level 0 has cells of cellSize x cellSize quads (including the vertices on their border), every further level
+ * combines 2 x 2 cells of the previous one, up to a single cell covering the whole grid.
+ * Cells at the end of the grid may be smaller.
+ * @author SD
+ */
+class HeightPyramid {
+   public:
+   /// @brief Quads along a side of a cell at level 0
+   static constexpr unsigned cellSize = 32;
+
+   /// @brief Compute all levels for the vertices of a grid, vertex (i, j) is vertices[j * sizeX + i]
+   void build(const std::vector<TerrainVertex>& vertices, unsigned long sizeX, unsigned long sizeY);
+
+   unsigned getLevels() const {
+      return levels.size();
+   }
+
+   unsigned cellsX(const unsigned level) const {
+      return levels[level].cellsX;
+   }
+
+   unsigned cellsZ(const unsigned level) const {
+      return levels[level].cellsZ;
+   }
+
+   /**
+    * Bounding box of a cell in mesh coordinates (the grid spans [-0.5, 0.5] along x and z).
+    * @param level Level of the cell, its cells have cellSize << level quads per side
+    * @param cellX, cellZ Index of the cell within the level
+    * @param low, high Corners of the box
+    */
+   void bounds(unsigned level, unsigned cellX, unsigned cellZ, glm::vec3& low, glm::vec3& high) const;
+
+   private:
+   struct Level {
+      unsigned cellsX = 0, cellsZ = 0;
+      std::vector<float> minHeights, maxHeights; // cell (x, z) at z * cellsX + x
+   };
+
+   unsigned long sizeX = 0, sizeY = 0;
+   std::vector<Level> levels;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef HEIGHTMAP_EXPORT_HPP
+#define HEIGHTMAP_EXPORT_HPP
+
+#include "Mesh.hpp"
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief Heights of a grid read in place, height (x, y) is heights[(y * sizeX + x) * stride]
+struct HeightGrid {
+   const float* heights = nullptr;
+   unsigned long sizeX = 0, sizeY = 0;
+   std::size_t stride = 1; // in floats, e.g. 2 for the heights inside the TerrainVertex array of a mesh
+
+   float at(const unsigned long x, const unsigned long y) const {
+      return heights[(y * sizeX + x) * stride];
+   }
+
+   /// @brief The heights of the vertices of a grid mesh
+   static HeightGrid of(const Mesh& mesh);
+
+   /// @brief The heights of a grid mesh built by buildGridMeshData
+   static HeightGrid of(const GridMeshData& data);
+
+   /// @brief sizeX * sizeY heights stored row by row
+   /// @throws std::invalid_argument if the number of heights does not match the size
+   static HeightGrid of(const std::vector<float>& heights, unsigned long sizeX, unsigned long sizeY);
+};
+
+/// @brief Lowest and highest height of the grid, computed on all threads
+std::pair<float, float> heightRange(const HeightGrid& grid);
+
+/// @brief How heights become integer pixels, and how the PNG is compressed
+struct HeightmapOptions {
+   float low = 0.0f; // height of the darkest pixel, lower heights are clamped
+   float high = 1.0f; // height of the brightest pixel (255 or 65535), higher heights are clamped
+   bool fast = false; // PNG: fixed row filter and Huffman coding only, compressed in parallel bands
+};
+
+/// @brief Sample types of the raw exports, both little endian
+enum class RawHeightFormat { R16, F32 };
+
+/**
+ * Exports the heights as a 16-bit grayscale PNG, row y of the image is row y of the grid.
+ * The rows are quantized and filtered on all threads, each row with the filter giving the smallest sum of absolute
+ * differences (the heuristic of the PNG specification). The default compression is the LZ77 and Huffman coding of
+ * lodepng on one thread. The fast mode instead uses the Paeth filter on every row and only Huffman coding, in bands of
+ * rows which are compressed in parallel and joined by empty stored blocks, each band in its own IDAT chunk.
+ * Heightfields rarely repeat byte sequences, so the fast files are typically less than 10% larger.
+ * @param grid Heights to be exported
+ * @param filename Name of the file to be saved to
+ * @param options Height range and compression
+ * @author SD
+ */
+void ExportHeightmapPng(const HeightGrid& grid, const std::string& filename, const HeightmapOptions& options = {});
+
+/// @brief The file ExportHeightmapPng writes, in memory. Small images (e.g. tiles) are encoded on the calling thread.
+/// @throws std::runtime_error if lodepng fails
+std::vector<unsigned char> encodeHeightmapPng(const HeightGrid& grid, const HeightmapOptions& options = {});
+
+/// @brief Binary Netpbm images written by ExportHeightmapNetpbm
+enum class NetpbmFormat { PGM, PPM };
+
+/**
+ * Exports the heights as a binary Netpbm image, P5 (gray) or P6 (the gray value in all three channels), with 8-bit
+ * (maxval 255) or 16-bit samples (maxval 65535, big endian as the format requires). Row y of the image is row y of the grid.
+ * The rows are streamed through one reusable buffer of a few MB, which is filled on all threads and written with a
+ * single system call whenever it is full, so the memory used does not grow with the size of the map.
+ * @param grid Heights to be exported
+ * @param filename Name of the file to be saved to
+ * @param format Gray (.pgm) or color (.ppm) image
+ * @param bits 8 or 16 bits per sample
+ * @param options Height range, the compression setting is ignored
+ * @throws std::invalid_argument for other sample sizes
+ * @author SD
+ */
+void ExportHeightmapNetpbm(const HeightGrid& grid, const std::string& filename, NetpbmFormat format, unsigned bits = 16,
+                           const HeightmapOptions& options = {});
+
+/**
+ * Exports the heights as raw little endian samples without any header, row by row, for tools importing .r16/.raw
+ * heightmaps. A small JSON sidecar (filename + ".json") records the size, the format and for R16 the height range,
+ * sample v stands for the height low + v / 65535 * (high - low). F32 samples are the heights as they are.
+ * @param grid Heights to be exported
+ * @param filename Name of the file to be saved to
+ * @param format Unsigned 16-bit or float samples
+ * @param options Height range of R16, the compression setting is ignored
+ * @author SD
+ */
+void ExportHeightmapRaw(const HeightGrid& grid, const std::string& filename, RawHeightFormat format, const HeightmapOptions& options = {});
+
+/// @brief The samples ExportHeightmapRaw writes, in memory and without the sidecar
+std::vector<unsigned char> encodeHeightmapRaw(const HeightGrid& grid, RawHeightFormat format, const HeightmapOptions& options = {});
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef INDEX_CACHE_CLASS_HPP
+#define INDEX_CACHE_CLASS_HPP
+
+#include "EBO.hpp"
+#include <map>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+/// @brief How the quads of a grid are turned into primitives on the GPU
+enum class IndexMode {
+   TRIANGLES, // 6 32-bit indices per quad
+   STRIPS, // one triangle strip per grid row, rows separated by a primitive restart index
+   PATCHES16 // 16-bit triangle indices per band of rows, drawn with one base vertex per band
+};
+
+/// @brief Rectangle of quads [x0, x1) x [z0, z1) of a grid
+struct QuadRegion {
+   unsigned x0, z0, x1, z1;
+};
+
+/**
+ * Index buffer of a grid of numX x numY quads (vertex k = j * (numX + 1) + i), in one of the IndexMode formats,
+ * together with its copy on the GPU and what is needed to draw it. The CPU copy is freed once it is uploaded.
+ * @author SD
+ */
+class GridIndices {
+   public:
+   GridIndices(const unsigned numX, const unsigned numY, const IndexMode mode);
+   ~GridIndices();
+
+   GridIndices(const GridIndices&) = delete;
+   GridIndices& operator=(const GridIndices&) = delete;
+
+   /// @brief Bind the element buffer to the currently bound VAO, creating the GPU buffer on first use
+   void Bind();
+
+   /// @brief Draw the grid, the VAO with this element buffer must be bound
+   void Draw() const;
+
+   /// @brief Draw only the quads inside the given regions, with one multi draw call of one range per grid row and region.
+   /// The VAO with this element buffer must be bound.
+   void DrawRegions(const std::vector<QuadRegion>& regions);
+
+   IndexMode getMode() const {
+      return mode;
+   }
+
+   /// @brief Size of the index data in bytes
+   std::size_t byteSize() const {
+      return indexBytes;
+   }
+
+   private:
+   unsigned numX, numY;
+   IndexMode mode;
+   std::vector<GLuint> indices32; // TRIANGLES, STRIPS, until uploaded
+   std::vector<GLushort> indices16; // PATCHES16: full band followed by the (shorter) last band, until uploaded
+   GLsizei indexCount = 0; // of indices32, drawn by Draw
+   std::size_t indexBytes = 0;
+   EBO ebo;
+
+   // PATCHES16: one entry per band
+   std::vector<GLsizei> bandCounts;
+   std::vector<const void*> bandOffsets;
+   std::vector<GLint> bandBaseVertices;
+   unsigned bandRows = 0;
+   std::size_t fullBandCount = 0;
+
+   // Ranges of DrawRegions, kept between calls to avoid allocations every frame
+   std::vector<GLsizei> rangeCounts;
+   std::vector<const void*> rangeOffsets;
+   std::vector<GLint> rangeBaseVertices;
+
+   void buildTriangles();
+   void buildStrips();
+   void buildPatches();
+};
+
+/**
+ * Process-wide cache of grid indices, keyed by grid shape and IndexMode.
+ * Every mesh of the same grid shares the same GPU element buffer, so rebuilding a mesh never regenerates or
+ * re-uploads indices. CPU triangle lists are only built on request (e.g. exports) and not kept by meshes.
+ * @note Call release() while the OpenGL context still exists.
+ * @author SD
+ */
+class IndexCache {
+   public:
+   /// @brief Triangle list of the grid (6 indices per quad) on the CPU, e.g. for normals and exports
+   static std::shared_ptr<const std::vector<GLuint>> triangles(const unsigned numX, const unsigned numY);
+
+   /// @brief GPU indices of the grid in the given mode.
+   /// PATCHES16 falls back to TRIANGLES if a single grid row does not fit into 16-bit indices.
+   static std::shared_ptr<GridIndices> gpu(const unsigned numX, const unsigned numY, const IndexMode mode);
+
+   /// @brief Drop all cached indices, GPU buffers are deleted once no mesh uses them anymore
+   static void release();
+
+   private:
+   using Key = std::tuple<unsigned, unsigned, IndexMode>;
+   // Triangle lists stay only as long as someone holds them, e.g. an export in progress
+   static std::map<std::pair<unsigned, unsigned>, std::weak_ptr<const std::vector<GLuint>>>& triangleCache();
+   static std::map<Key, std::shared_ptr<GridIndices>>& gpuCache();
+};
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef LOD_QUADTREE_CLASS_HPP
+#define LOD_QUADTREE_CLASS_HPP
+
+#include "Camera.hpp"
+#include "HeightPyramid.hpp"
+#include "IndexCache.hpp"
+#include "Mesh.hpp"
+#include "VAO.hpp"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * Chunked level of detail renderer for a grid mesh (CDLOD).
+ * The grid is covered by a quadtree of square nodes, a node of level l spans patchSize << l quads and is drawn
+ * as one patch of patchSize x patchSize quads taking every (1 << l)-th grid vertex. Each frame the nodes are
+ * selected by distance to the camera: level l is used up to ranges[l], ranges double from level to level.
+ * Towards the end of its range a patch morphs its odd vertices onto the coarser grid of the next level
+ * (in TerrainVertex.glsl), so switching levels does not pop and neighbouring patches of different levels
+ * meet without cracks.
+ * The nodes of a level are the cells of the same level of the mesh's HeightPyramid, which gives their bounding boxes
+ * for the distance test and for culling against the view frustum.
+ * Heights and normals are read from textures in the vertex shader, so all patches share the same two small index buffers
+ * from the IndexCache and no vertex buffer is needed.
+ * @note Must not outlive the OpenGL context.
+ * @author SD
+ */
+class LodQuadtree {
+   public:
+   /// @brief Number of quads along a side of a patch, patches of nodes drawn only partially have half of it
+   static constexpr unsigned patchSize = HeightPyramid::cellSize;
+
+   /// @param mesh Grid mesh whose heights and normals are rendered
+   LodQuadtree(const Mesh& mesh);
+   ~LodQuadtree();
+
+   LodQuadtree(const LodQuadtree&) = delete;
+   LodQuadtree& operator=(const LodQuadtree&) = delete;
+
+   /**
+    * Start uploading the heights and normals of the mesh again (e.g. after Mesh::updateHeights or a finished
+    * Mesh::continueUpload) into a second pair of textures, in slices by continueUpload.
+    * The current textures keep drawing until the upload is complete. An upload still running is dropped.
+    * @param mesh Grid mesh of the same shape, its vertices must not change until the upload is complete
+    * @throws std::invalid_argument if the grid shape differs
+    * @author SD
+    */
+   void beginUpdate(const Mesh& mesh);
+
+   /**
+    * Upload the next rows of the heights and normals given to beginUpdate, and swap the textures once all of them are there.
+    * @param mesh The mesh given to beginUpdate
+    * @param maxBytes Largest number of bytes uploaded by this call, at least one row is uploaded
+    * @return true if the new heights are drawn from now on
+    * @author SD
+    */
+   bool continueUpload(const Mesh& mesh, std::size_t maxBytes);
+
+   /// @brief Whether beginUpdate was called and the upload is not complete yet
+   bool isUploading() const {
+      return uploading;
+   }
+
+   /**
+    * Select the patches for the camera and draw them.
+    * @param shader Shader to be used for rendering, its vertex shader must include TerrainVertex.glsl
+    * @param camera The camera from which the terrain is being viewed from
+    * @author SD
+    */
+   void Draw(Shader& shader, Camera& camera);
+
+   /// @brief Distance up to which the finest level is used, in mesh units (the grid spans 1 along x)
+   void setDetailDistance(const float distance) {
+      detailDistance = distance;
+   }
+
+   float getDetailDistance() const {
+      return detailDistance;
+   }
+
+   /// @brief Patches and triangles drawn and culled in the last frame
+   const PatchStats& getStats() const {
+      return stats;
+   }
+
+   unsigned getLevels() const {
+      return levels;
+   }
+
+   private:
+   /// @brief Node (or quarter of a node) drawn as one patch
+   struct Patch {
+      unsigned x, z; // first grid vertex
+      unsigned level;
+      bool quarter; // only one quadrant of the node, patchSize / 2 quads per side
+   };
+
+   unsigned long sizeX, sizeY;
+   unsigned levels;
+   HeightPyramid pyramid;
+   float detailDistance = 0.4f;
+   std::vector<float> ranges;
+   std::vector<Patch> selection;
+   PatchStats stats;
+
+   GLuint heightTexture = 0; // R32F, texel (i, j) is vertex (i, j)
+   GLuint normalTexture = 0; // RG16_SNORM, octahedron packed normals
+   GLuint backHeightTexture = 0, backNormalTexture = 0; // receive the update, swapped with the ones above when complete
+   bool uploading = false;
+   unsigned long uploadedRows = 0; // of the update
+   std::vector<float> rowHeights; // rows of the current slice, reused between calls
+   std::vector<GLshort> rowNormals;
+   VAO fullVAO, quarterVAO; // no attributes, only the element buffer of the patch
+   std::shared_ptr<GridIndices> fullIndices, quarterIndices;
+
+   /// @brief Copy rows [first, first + count) of the mesh into the back textures
+   void uploadRows(const Mesh& mesh, unsigned long first, unsigned long count);
+
+   /// @brief Add the patches of a node to the selection, returns false if the node is beyond the range of its level.
+   /// Nodes outside the frustum count as handled and add nothing.
+   bool select(unsigned x, unsigned z, unsigned level, const glm::vec3& camera, const Frustum& frustum);
+
+   /// @brief Whether the box intersects the sphere of the given radius around the camera
+   static bool inRange(const glm::vec3& low, const glm::vec3& high, const glm::vec3& camera, float range);
+};
+
+#endif
@@ -4,28 +4,156 @@
 #include "lodepng.h"
 #include "Camera.hpp"
 #include "EBO.hpp"
+#include "HeightPyramid.hpp"
+#include "IndexCache.hpp"
 #include "VAO.hpp"
 #include <iomanip>
+#include <memory>
 #include <string>
+#include <optional>
 #include <vector>
 
+/// @brief Vertices of a grid mesh with their normals and pyramid, built without OpenGL (e.g. on a worker thread) and uploaded by a Mesh
+struct GridMeshData {
+   unsigned long sizeX = 0, sizeY = 0;
+   std::vector<TerrainVertex> vertices; // vertex (i, j) at j * sizeX + i
+   HeightPyramid pyramid;
+};
+
+/**
+ * Vertices of a regular grid of numX x numY quads, the height of vertex (i, j) is heights[j * (numX + 1) + i].
+ * Computes the normals and the HeightPyramid, which is all the CPU work of building a grid mesh.
+ * @throws std::invalid_argument if the number of heights does not match the grid
+ * @author SD
+ */
+GridMeshData buildGridMeshData(const std::vector<float>& heights, unsigned numX, unsigned numY);
+
 /**
  * Class for storing and managing the vertices and indices of a mesh.
+ * The mesh owns its GPU buffers and deletes them when it is destroyed, so it must not outlive the OpenGL context.
+ * Vertices are always laid out as a grid of sizeX x sizeY, vertex (i, j) is vertices[j * sizeX + i].
+ * Only heights and normals are stored (TerrainVertex), x/z and texture coordinates follow from the grid position,
+ * on the GPU they are reconstructed from gl_VertexID. Vertex shaders include TerrainVertex.glsl for that.
+ * Meshes of a regular grid take their indices from the IndexCache, so they share one index buffer per grid shape,
+ * and keep no triangle list on the CPU (see triangles()).
+ * Grid meshes are drawn in patches of HeightPyramid::cellSize quads, patches outside the view frustum are skipped.
+ * New vertices of a grid mesh can be uploaded in slices over several frames (beginUpdate, continueUpload) into a second
+ * vertex buffer, the current one keeps drawing until the upload is complete and the buffers are swapped.
  * @author SD
  */
 class Mesh {
    public:
-   std::vector<Vertex> vertices;
-   std::vector<GLuint> indices;
+   std::vector<TerrainVertex> vertices;
+   std::shared_ptr<const std::vector<GLuint>> indices; // triangle list of meshes built from explicit indices, empty for grid meshes
 
    // Size of the mesh, so it doesn't need to be recalculated later during 2D saves.
    unsigned long sizeX, sizeY;
 
    VAO myVAO;
 
+   /// @brief Mesh with arbitrary triangles, the vertices must still be ordered in a grid (only their heights are kept)
    Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
    Mesh(const std::vector<std::vector<double>>& matrix);
 
+   /**
+    * Mesh of a regular grid of numX x numY quads, the height of vertex (i, j) is heights[j * (numX + 1) + i].
+    * The GPU indices are not built here but taken from the IndexCache.
+    * @param heights (numX + 1) * (numY + 1) heights
+    * @param mode Primitive and index format used for drawing
+    * @throws std::invalid_argument if the number of heights does not match the grid
+    * @author SD
+    */
+   Mesh(const std::vector<float>& heights, unsigned numX, unsigned numY, IndexMode mode = IndexMode::TRIANGLES);
+
+   /// @brief Grid mesh from vertices prepared by buildGridMeshData, uploaded at once
+   /// @param mode Primitive and index format used for drawing
+   Mesh(GridMeshData&& data, IndexMode mode = IndexMode::TRIANGLES);
+   ~Mesh();
+
+   // The GPU buffers are owned by exactly one mesh
+   Mesh(const Mesh&) = delete;
+   Mesh& operator=(const Mesh&) = delete;
+
+   /**
+    * Replace the heights of the grid (e.g. the same terrain with new noise).
+    * Normals are recomputed and the vertex buffer is uploaded again, the index buffer is kept.
+    * @param heights New heights in the same order as the vertices
+    * @throws std::invalid_argument if the number of heights differs
+    * @author SD
+    */
+   void updateHeights(const std::vector<float>& heights);
+
+   /**
+    * Start replacing the vertices of a grid mesh by prepared ones, which are uploaded by continueUpload.
+    * Until then the current vertices are drawn and returned by the accessors. An update which is still
+    * being uploaded is dropped.
+    * The grid may change its shape (e.g. a coarse preview refined to the full grid), the indices are then taken
+    * from the IndexCache and a triangulation given to setTriangles is dropped when the buffers are swapped.
+    * @param data Vertices of a grid, see buildGridMeshData
+    * @throws std::invalid_argument if the mesh was built from explicit indices
+    * @author SD
+    */
+   void beginUpdate(GridMeshData&& data);
+
+   /**
+    * Upload the next slice of the pending vertices into the back vertex buffer, and swap the buffers
+    * once all of them are there.
+    * @param maxBytes Largest number of bytes uploaded by this call, at least 1
+    * @return true if the new vertices are drawn from now on
+    * @author SD
+    */
+   bool continueUpload(std::size_t maxBytes);
+
+   /// @brief Whether beginUpdate was called and the upload is not complete yet
+   bool isUploading() const {
+      return pending.has_value();
+   }
+
+   /// @brief Switch the index format of a grid mesh, meshes built from explicit indices always draw triangles
+   void setIndexMode(IndexMode mode);
+
+   /**
+    * Draw the given triangles of the grid instead of the whole grid, e.g. a simplified triangulation from Rtin.
+    * The vertices stay the same, only a different index buffer is bound.
+    * @param triangles 3 grid vertex indices per triangle, an empty list draws the whole grid again
+    * @throws std::runtime_error for meshes built from explicit indices
+    * @author SD
+    */
+   void setTriangles(const std::vector<GLuint>& triangles);
+
+   /// @brief Skip the patches outside the view frustum when drawing a grid mesh (on by default)
+   void setFrustumCulling(const bool enabled) {
+      frustumCulling = enabled;
+   }
+
+   bool isFrustumCulling() const {
+      return frustumCulling;
+   }
+
+   /// @brief Min/max heights of the patches, updated with the heights
+   const HeightPyramid& getPyramid() const {
+      return pyramid;
+   }
+
+   /// @brief Smallest region of quads containing the patches of a grid mesh inside the frustum, empty if none is.
+   /// Meshes built from explicit indices give the whole grid.
+   QuadRegion viewBounds(const Frustum& frustum) const;
+
+   /// @brief Patches and triangles drawn and culled in the last Draw
+   const PatchStats& getStats() const {
+      return stats;
+   }
+
+   /// @brief Triangle list of the mesh, e.g. for exports. Built by the IndexCache for grid meshes, release it when done.
+   std::shared_ptr<const std::vector<GLuint>> triangles() const;
+
+   /// @brief Full position of vertex k, reconstructed from the grid
+   glm::vec3 position(size_t k) const;
+   /// @brief Unpacked normal of vertex k
+   glm::vec3 normal(size_t k) const;
+   /// @brief Texture coordinates of vertex k, in [0, 1]^2
+   glm::vec2 texUV(size_t k) const;
+
    /**
     * Shows the mesh in the rendering area.
     * @param shader Shader to be used for rendering
@@ -42,21 +170,50 @@ class Mesh {
    void exportToPNG(const std::string& filename) const;
 
    /**
-    * Exports the current map to a NetBPM (PPM) file.
+    * Exports the current map to a binary NetBPM (P6) file with 8-bit samples, heights [0, 1] map to [0, 255].
     * @param filename Name (and location) of the file to be saved
-    * @author PK
+    * @see ExportHeightmapNetpbm for 16-bit samples and other height ranges
+    * @author PK, SD
     */
    void exportToPPM(const std::string& filename) const;
+
+   private:
+   VBO myVBO; // heights and packed normals
+   VBO backVBO; // receives the vertices of the pending update, swapped with myVBO when complete
+   std::optional<GridMeshData> pending; // set by beginUpdate
+   std::size_t uploadedBytes = 0; // of the pending vertices
+   EBO myEBO; // meshes built from explicit indices, or the triangles of setTriangles
+   GLsizei customCount = 0; // number of indices given to setTriangles, 0 if the whole grid is drawn
+   std::shared_ptr<GridIndices> gridIndices; // only used by grid meshes
+   HeightPyramid pyramid;
+   bool frustumCulling = true;
+   PatchStats stats;
+   std::vector<char> visibleCells; // level 0 cells of the pyramid passing the frustum test, reused every frame
+   std::vector<QuadRegion> visibleRegions;
+
+   /// @brief Collect the visible level 0 cells below a cell of the pyramid
+   void cullCell(const Frustum& frustum, unsigned level, unsigned cellX, unsigned cellZ);
+
+   /// @brief Grow cells = [x0, x1) x [z0, z1) of level 0 cells to contain the visible ones below a cell of the pyramid
+   void boundCell(const Frustum& frustum, unsigned level, unsigned cellX, unsigned cellZ, QuadRegion& cells) const;
+
+   /// @brief Vertex normals by scattering the face normals over the index buffer (computeTriangleNormals), for meshes
+   /// built from explicit indices. Grid meshes use computeGridNormals instead.
+   void computeNormals();
+
+   /// @brief Create the GPU buffers and link them to the VAO
+   void setupBuffers();
+
+   /// @brief Take the grid indices from the cache and bind them to the VAO
+   void setupGridIndices(IndexMode mode);
+
+   /// @brief Upload the vertices into the existing vertex buffer
+   void upload();
+
+   /// @brief Point the vertex attributes of the VAO to myVBO
+   void linkAttributes();
 };
 
 // void ComputeNormals(Mesh& mesh);
 
-/**
- * Exports the mesh to an .obj file.
- * @param mesh The mesh to be exported
- * @param filename Name of the file to be saved to
- * @author SD
- */
-void ExportToObj(const Mesh& mesh, const std::string& filename);
-
 #endif
\ No newline at end of file
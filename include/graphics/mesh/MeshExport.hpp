@@ -0,0 +1,76 @@
+#ifndef MESH_EXPORT_HPP
+#define MESH_EXPORT_HPP
+
+#include "Mesh.hpp"
+#include <string>
+#include <vector>
+
+/// @brief What ExportToObj writes besides the positions and faces
+struct ObjOptions {
+   int precision = 6; // significant digits of the numbers (1 to 9), 0 writes the shortest text that reads back exactly
+   bool normals = true; // vn lines
+   bool texCoords = true; // vt lines
+};
+
+/**
+ * Exports the mesh to an .obj file.
+ * The text is formatted with std::to_chars in bands of lines on all threads, each into its own buffer, and the
+ * buffers are written in order, so the file is the same for any number of threads.
+ * With the default options the numbers are the same as with std::ostream.
+ * @param mesh The mesh to be exported
+ * @param filename Name of the file to be saved to
+ * @param options Precision and optional attributes, faces refer to the attributes that are written
+ * @author SD
+ */
+void ExportToObj(const Mesh& mesh, const std::string& filename, const ObjOptions& options = {});
+
+/**
+ * Exports some of the triangles of a mesh to an .obj file, e.g. a simplified triangulation from Rtin.
+ * Only the vertices used by the triangles are written, in the order of the mesh.
+ * @param mesh The mesh to be exported
+ * @param filename Name of the file to be saved to
+ * @param triangles 3 vertex indices of the mesh per triangle
+ * @param options Precision and optional attributes, faces refer to the attributes that are written
+ * @author SD
+ */
+void ExportToObj(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const ObjOptions& options = {});
+
+/// @brief Attributes and layout of the binary exporters
+struct BinaryMeshOptions {
+   bool compact = false; // quantized attributes (.glb) or positions with the packed normals of the mesh (.ply)
+   bool normals = true;
+   bool texCoords = true;
+};
+
+/**
+ * Exports triangles of a mesh to a binary glTF 2.0 file (.glb), one node with one triangle primitive.
+ * The attributes are stored in separate buffer views and written with the triangles in a single gathered write
+ * (writev where available), the index array of the mesh is written as it is.
+ * Compact files use KHR_mesh_quantization: positions and normals as normalized 16-bit integers (the node transform
+ * maps the positions back, the normals are stored scaled by its inverse), texture coordinates as normalized unsigned
+ * 16-bit integers. 20 instead of 32 bytes per vertex.
+ * If the triangles do not use all vertices, only the used ones are written, in the order of the mesh.
+ * @param mesh The mesh to be exported
+ * @param filename Name of the file to be saved to
+ * @param triangles 3 vertex indices of the mesh per triangle
+ * @param options Layout and optional attributes
+ * @note Needs a little endian host, as glTF does
+ * @author SD
+ */
+void ExportToGlb(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const BinaryMeshOptions& options = {});
+
+/**
+ * Exports triangles of a mesh to a binary PLY file in the byte order of the host.
+ * The standard layout has float x, y, z (and nx, ny, nz and s, t), only the vertices used by the triangles are written.
+ * The compact layout has float x, y, z and the normal as the two shorts of its octahedron encoding in the mesh
+ * (see packNormal, noted in the header comments), 16 instead of 24 bytes per vertex. Faces are lists of 3 unsigned
+ * int indices.
+ * @param mesh The mesh to be exported
+ * @param filename Name of the file to be saved to
+ * @param triangles 3 vertex indices of the mesh per triangle
+ * @param options Layout and optional attributes, the compact layout always contains the normals and no texture coordinates
+ * @author SD
+ */
+void ExportToPly(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const BinaryMeshOptions& options = {});
+
+#endif
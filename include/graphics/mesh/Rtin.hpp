@@ -0,0 +1,61 @@
+#ifndef RTIN_CLASS_HPP
+#define RTIN_CLASS_HPP
+
+#include "VBO.hpp"
+#include <glad/glad.h>
+#include <vector>
+
+/**
+ * Adaptive triangulation of a grid mesh with a bounded vertical error (right-triangulated irregular network, as in Martini).
+ * The grid is embedded into a square of size x size quads, size a power of two, which is split recursively into
+ * right triangles along their hypotenuse. The error of a vertex is how far its height is from the middle of the
+ * hypotenuse it splits, maximized over all finer vertices below it, so cutting the hierarchy at any error threshold
+ * gives a triangulation without cracks.
+ * Triangles crossing the border of the grid are always split, the ones outside of it are dropped.
+ * As in Martini the error is measured at the vertices of the hierarchy, between them the surface may deviate slightly more.
+ * The error map is computed once per heightfield in parallel, triangulations for any threshold are cheap afterwards.
+ * @author SD
+ */
+class Rtin {
+   public:
+   /// @param vertices sizeX * sizeY vertices, vertex (i, j) is vertices[j * sizeX + i]
+   /// @param sizeX, sizeY number of vertices along x and z, at least 2 each
+   Rtin(const std::vector<TerrainVertex>& vertices, unsigned long sizeX, unsigned long sizeY);
+
+   /**
+    * Triangles whose heights differ from the grid by at most maxError, with the same winding as the grid triangles.
+    * @param maxError Largest allowed vertical error, in mesh units
+    * @return 3 grid vertex indices (j * sizeX + i) per triangle
+    */
+   std::vector<GLuint> triangulate(float maxError) const;
+
+   /// @brief Number of triangles triangulate(maxError) would return
+   std::size_t countTriangles(float maxError) const;
+
+   /// @brief Smallest error threshold whose triangulation has at most maxTriangles triangles
+   float errorForBudget(std::size_t maxTriangles) const;
+
+   private:
+   struct Triangle {
+      unsigned ax, ay, bx, by, cx, cy; // hypotenuse a-b, right angle at c
+   };
+
+   unsigned long sizeX, sizeY;
+   unsigned size; // power of two, at least the number of quads along x and z
+   std::vector<float> errors; // (size + 1)^2, vertex (x, y) at y * (size + 1) + x
+   float largestError = 0.0f; // largest finite error
+
+   /// @brief Triangles (of the two root triangles) from which the traversal continues in parallel
+   std::vector<Triangle> tasks(float maxError, std::vector<Triangle>& leaves) const;
+
+   /// @brief Call emit(triangle) for every triangle of the triangulation below the given one
+   template <typename Emit>
+   void visit(const Triangle& triangle, float maxError, Emit& emit) const;
+
+   /// @brief Whether the triangle has to be split further
+   bool split(const Triangle& triangle, float maxError) const;
+
+   bool outside(const Triangle& triangle) const;
+};
+
+#endif
@@ -13,7 +13,8 @@ class VAO {
    GLuint ID;
    VAO();
 
-   void LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset);
+   /// @param normalized whether integer attributes are mapped to [-1, 1] or [0, 1]
+   void LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset, GLboolean normalized = GL_FALSE);
 
    void Bind();
    void Unbind();
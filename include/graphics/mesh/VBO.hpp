@@ -1,6 +1,7 @@
 #ifndef VBO_CLASS_HPP
 #define VBO_CLASS_HPP
 
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <vector>
 #include <glad/glad.h>
@@ -13,6 +14,21 @@ struct Vertex {
    glm::vec2 texUV;
 };
 
+/// @brief Compact vertex of a terrain grid (8 bytes instead of the 44 of Vertex).
+/// Only the height and the normal vary, x/z and the texture coordinates follow from the position in the grid
+/// and are reconstructed in the vertex shader from gl_VertexID (see shaders/TerrainVertex.glsl).
+struct TerrainVertex {
+   float height;
+   std::int16_t normal[2]; // octahedron encoded, see packNormal
+};
+
+/// @brief Encode a unit normal by projecting it onto an octahedron and unfolding the lower half (y < 0) onto the square [-1, 1]^2,
+/// stored as two signed normalized 16-bit values. The error is below 1e-4 radians.
+void packNormal(const glm::vec3& normal, std::int16_t packed[2]);
+
+/// @brief Inverse of packNormal, the same decoding as unpackNormal in TerrainVertex.glsl
+glm::vec3 unpackNormal(const std::int16_t packed[2]);
+
 /// @brief Class for handling openGL Vertex Buffer Objects
 /// A VBO stores vertex data in the GPU's memory for rendering
 /// In this implementation, this vertex data is organized in the `Vertex` struct
@@ -20,10 +36,20 @@ struct Vertex {
 /// https://github.com/VictorGordan/opengl-tutorials
 class VBO {
    public:
-   GLuint ID;
+   GLuint ID = 0;
+   /// @brief No buffer yet, it is created by the first call of Data
+   VBO() = default;
    VBO(std::vector<Vertex>& vertices);
+
+   /// @brief (Re)allocate the buffer with the given content, creating it if needed
+   /// @param data may be nullptr to only allocate (or orphan) the storage
+   void Data(const void* data, GLsizeiptr size, GLenum usage);
+
+   /// @brief Overwrite part of the buffer, the storage is kept
+   void SubData(GLintptr offset, GLsizeiptr size, const void* data);
+
    void Bind();
    void Unbind();
    void Delete();
 };
-#endif
\ No newline at end of file
+#endif
@@ -21,6 +21,9 @@ void parse_uniform_float_names_and_values(const std::string &contents,
 
 std::string get_file_contents(std::string filename);
 
+/// @brief Replace the '#include "<file>"' lines of a shader source by the files from the shader directory (not recursive)
+std::string resolve_includes(const std::string &contents);
+
 class Shader {
 public:
     GLuint ID;
@@ -4,8 +4,10 @@
 #include "Window.hpp"
 #include "ShaderManager.hpp"
 #include "Mesh.hpp"
+#include "HeightmapExport.hpp"
+#include "MeshExport.hpp"
 #include "Terrain.hpp"
-#include "Fuse.hpp"
+#include "TilePyramid.hpp"
 #include <vector>
 #include <json.hpp>
 
@@ -30,20 +32,28 @@ class GUI {
    void RenderCommonImGui(Terrain& terrain, float fps);
    void ShaderDropdown2D();
    void ShaderDropdown3D();
+   void IndexFormatDropdown(Terrain& terrain);
+   void LodSettings(Terrain& terrain);
    void _3DInputControls();
    void _2DInputControls();
-   void SaveToFile3D(Mesh& mesh);
+   void SaveToFile3D(Terrain& terrain);
+   float ExportMaxError(Terrain& terrain);
    void SaveToFile2D(Mesh& mesh);
+   void SaveTilePyramid(Terrain& terrain);
 
    void SaveJSON(Terrain& terrain, std::string filename);
    void LoadJSON(Terrain& terrain, std::string filename);
    void JSON_IO(Terrain& terrain);
+   void SaveSnapshot(Terrain& terrain, const std::string& filename);
+   void LoadSnapshot(Terrain& terrain, const std::string& filename);
 
    void DisplayMode();
    void UserShaderParameters();
    void MeshSettings();
    bool InputUnsigned(const char* label, unsigned int* v, unsigned int step = 1, unsigned int step_fast = 10, ImGuiInputTextFlags flags = 0);
-   void NoiseLayersGui(Terrain& terrain, Fuse& fuse);
+   void NoiseLayersGui(Terrain& terrain);
+   void WarpGui(std::vector<perlin::WarpParams>& warps, const char* title, Terrain& terrain);
+   void PostProcessGui(Terrain& terrain);
    void FPSDisplay();
 
    void Render3DImGui(Terrain& terrain, float fps);
@@ -57,6 +67,21 @@ class GUI {
    bool operationCompleted = false; // For "completed successfully" popups.
    bool guiHovered = false;
    bool is3DMode = false;
+   int exportDetail = 0; // 0: full grid, 1: error threshold, 2: triangle budget
+   float exportMaxError = 0.002f;
+   int exportTriangleBudget = 200000;
+   bool previewSimplified = false; // draw the triangulation that would be exported
+   ObjOptions objOptions;
+   BinaryMeshOptions binaryMeshOptions;
+   std::string pendingMeshExtension; // format of the export waiting for the overwrite confirmation
+   int heightmapFormat = 0; // 0: 16-bit png, 1: 16-bit pgm, 2: raw r16, 3: raw f32
+   bool heightmapFitRange = false; // map the lowest and highest height to black and white instead of [0, 1]
+   HeightmapOptions heightmapOptions;
+   bool snapshotWithMesh = true; // store the vertices in snapshots, loading then skips the normals
+   unsigned tilePyramidSizeX = 16384, tilePyramidSizeY = 16384; // map size of the tile export, independent of the terrain drawn
+   int tilePyramidTileSize = 1; // 128 << index
+   int tilePyramidFormat = 0; // TileFormat
+   bool lodEnabled = false; // draw the 3D view through the LOD quadtree instead of the full grid
    bool switchedShaderRecently = false;
    const std::vector<std::vector<std::string>> shaders = {
       {"Beach2D.vert", "Mustafar2D.vert", "Default2D.vert"}, // 2D shaders
@@ -78,6 +103,6 @@ class GUI {
    unsigned currentItem3D = 0;
    Window& window;
    ShaderManager shaderManager;
-   Fuse fuse;
+   PostProcessParams postProcessParams; // edited here, handed to the terrain on every change
 };
 #endif
\ No newline at end of file
@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 // Outputs the normal for the Fragment Shader
 out vec3 Normal;
@@ -15,6 +12,7 @@ out vec2 texCoord;
 uniform mat4 camMatrix;
 
 void main() {
+    decodeVertex();
     Normal = aNormal;
     color = vec3(aPos.y, aPos.y, aPos.y); // Using the height as the color
     texCoord = aTexture;
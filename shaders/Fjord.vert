@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 // Outputs the normal for the Fragment Shader
 out vec3 Normal;
@@ -21,6 +18,7 @@ uniform float rockUpperBound;  // 0.016
 uniform float snowLowerBound;  // 0.095 
 
 void main() {
+    decodeVertex();
     Normal = aNormal;
     vec3 waterColor = vec3(0.0, 0.5, 0.8); 
     vec3 sandColor = vec3(0.9, 0.8, 0.6);  
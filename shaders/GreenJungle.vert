@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 
 // Outputs the normal for the Fragment Shader
@@ -24,6 +21,7 @@ uniform float normalGrassLower; // 0.35
 
 
 void main(){
+    decodeVertex();
     Normal = aNormal;
     vec3 oceanColor = vec3(0.0, 0.3, 0.7);
     vec3 sandColor = vec3(0.9, 0.8, 0.6); 
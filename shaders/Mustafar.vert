@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 // Outputs the normal for the Fragment Shader
 out vec3 Normal;
@@ -21,6 +18,7 @@ uniform float rockUpperBound; // 0.511 (height for rocky terrain)
 uniform float magmaCrackThreshold; // 0.676 (slope threshold for magma cracks)
 
 void main() {
+    decodeVertex();
     Normal = aNormal;
     vec3 lavaColor = vec3(1.0, 0.3, 0.1); // Bright orange-red for lava
     vec3 magmaColor = vec3(0.8, 0.2, 0.0); // Darker red for magma
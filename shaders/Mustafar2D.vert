@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 // Outputs the normal for the Fragment Shader
 out vec3 Normal;
@@ -23,6 +20,7 @@ uniform float lowerAshLimit; // 0.12
 uniform float upperAshLimit; // 0.2
 
 void main(){
+    decodeVertex();
     Normal = aNormal;
 
     if (aPos.y < lavaLimit) {
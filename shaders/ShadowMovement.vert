@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 out vec3 Normal;
 out vec3 color;  
@@ -15,6 +12,7 @@ uniform float edgeThreshold; // 0.1
 uniform float intensity; // 0.4 
 
 void main() {
+    decodeVertex();
     vec3 meshColor = vec3(intensity); 
     vec3 edgeColor = vec3(0.0, 0.0, 0.0); 
 
@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 // Outputs for the Fragment Shader
 out vec3 Normal;
@@ -18,6 +15,7 @@ uniform float sandUpperBound;   // 0.010
 uniform float sandSlopeLimit; // 0.3
 uniform float grassSlopeLimit; // 0.683
 void main() {
+    decodeVertex();
     Normal = aNormal;
 
     // Base terrain colors
@@ -0,0 +1,65 @@
+// Compact terrain vertex, shared by all vertex shaders of the terrain mesh (see TerrainVertex in VBO.hpp).
+// Only the height and the normal are stored per vertex, the rest follows from the position in the grid.
+// Call decodeVertex() at the beginning of main, afterwards aPos, aNormal and aTexture are set.
+// With lodStride > 0 the vertex belongs to a patch of the LOD quadtree (see LodQuadtree.hpp) instead,
+// its height and normal are then read from heightMap and normalMap.
+
+layout(location = 0) in float aHeight;
+layout(location = 1) in vec2 aPackedNormal; // octahedron encoded, signed normalized 16-bit
+
+uniform ivec2 gridSize; // number of vertices along x and z
+
+uniform int lodStride; // 0 for the full grid, otherwise grid vertices between two patch vertices
+uniform int lodPatchSize; // quads along a side of the patch
+uniform ivec2 lodOrigin; // grid vertex of the first patch vertex
+uniform vec2 lodMorph; // camera distance at which the patch starts and ends morphing to the next coarser level
+uniform vec3 lodCamera; // camera position in mesh coordinates
+uniform sampler2D heightMap;
+uniform sampler2D normalMap;
+
+vec3 aPos;
+vec3 aNormal;
+vec2 aTexture;
+
+vec3 unpackNormal(vec2 encoded) {
+    vec3 normal = vec3(encoded.x, 1.0 - abs(encoded.x) - abs(encoded.y), encoded.y);
+    float fold = max(-normal.y, 0.0);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.z += normal.z >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+vec2 gridTexCoord(vec2 grid) {
+    return (grid + 0.5) / vec2(gridSize);
+}
+
+vec2 patchGrid(vec2 local) {
+    return min(vec2(lodOrigin) + local * float(lodStride), vec2(gridSize - 1));
+}
+
+void decodePatchVertex() {
+    vec2 local = vec2(gl_VertexID % (lodPatchSize + 1), gl_VertexID / (lodPatchSize + 1));
+    vec2 grid = patchGrid(local);
+    vec2 uv = grid / vec2(gridSize - 1);
+    vec3 pos = vec3(uv.x - 0.5, texture(heightMap, gridTexCoord(grid)).r, uv.y - 0.5);
+
+    // Odd vertices slide onto their even neighbour, at morph = 1 the patch is the grid of the next level
+    float morph = clamp((distance(pos, lodCamera) - lodMorph.x) / (lodMorph.y - lodMorph.x), 0.0, 1.0);
+    grid = patchGrid(local - fract(local * 0.5) * 2.0 * morph);
+
+    aTexture = grid / vec2(gridSize - 1);
+    aPos = vec3(aTexture.x - 0.5, texture(heightMap, gridTexCoord(grid)).r, aTexture.y - 0.5);
+    aNormal = unpackNormal(texture(normalMap, gridTexCoord(grid)).rg);
+}
+
+void decodeVertex() {
+    if (lodStride > 0) {
+        decodePatchVertex();
+        return;
+    }
+    int i = gl_VertexID % gridSize.x;
+    int j = gl_VertexID / gridSize.x;
+    aTexture = vec2(i, j) * (1.0 / vec2(gridSize - 1));
+    aPos = vec3(aTexture.x - 0.5, aHeight, aTexture.y - 0.5);
+    aNormal = unpackNormal(aPackedNormal);
+}
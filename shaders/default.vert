@@ -1,9 +1,6 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec3 aColor;
-layout(location = 3) in vec2 aTexture;
+#include "TerrainVertex.glsl"
 
 out vec3 Normal;
 out vec3 color;  
@@ -12,6 +9,7 @@ out vec2 texCoord;
 uniform mat4 camMatrix;
 
 void main() {
+    decodeVertex();
     vec3 meshColor = vec3(0.4, 0.4, 0.4); 
     vec3 edgeColor = vec3(0.0, 0.0, 0.0); 
     float edgeThreshold = 0.1; 
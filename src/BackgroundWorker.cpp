@@ -0,0 +1,55 @@
+#include "BackgroundWorker.hpp"
+
+#include <exception>
+#include <iostream>
+
+BackgroundWorker::BackgroundWorker() : thread(&BackgroundWorker::run, this) {
+}
+
+BackgroundWorker::~BackgroundWorker() {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+      waiting = nullptr;
+      runningToken.cancel();
+   }
+   wake.notify_one();
+   thread.join();
+}
+
+void BackgroundWorker::submit(std::function<void(const perlin::CancelToken&)> job) {
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      waiting = std::move(job);
+      runningToken.cancel();
+   }
+   wake.notify_one();
+}
+
+bool BackgroundWorker::isBusy() const {
+   std::lock_guard<std::mutex> lock(mutex);
+   return running || waiting;
+}
+
+void BackgroundWorker::run() {
+   std::unique_lock<std::mutex> lock(mutex);
+   while (true) {
+      wake.wait(lock, [this] { return stopping || waiting; });
+      if (stopping) return;
+      std::function<void(const perlin::CancelToken&)> job = std::move(waiting);
+      waiting = nullptr;
+      running = true;
+      runningToken = perlin::CancelToken::create();
+      const perlin::CancelToken token = runningToken;
+      lock.unlock();
+      try {
+         job(token);
+      } catch (const perlin::Cancelled&) {
+         // a newer job is waiting
+      } catch (const std::exception& e) {
+         std::cout << "Background job failed: " << e.what() << "\n";
+      }
+      lock.lock();
+      running = false;
+   }
+}
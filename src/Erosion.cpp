@@ -0,0 +1,194 @@
+#include "Erosion.hpp"
+#include "HeightfieldExpr.hpp"
+#include "Parallel.hpp"
+
+#include <cstdint>
+
+namespace perlin {
+
+namespace {
+
+/// @brief Small, fast and seedable random number generator (splitmix64), one per tile and round
+class SplitMix {
+   public:
+   explicit SplitMix(std::uint64_t seed) : state(seed) {}
+
+   std::uint64_t next() {
+      std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+   }
+
+   /// @brief Uniform in [0, 1)
+   double unit() {
+      return (next() >> 11) * (1.0 / 9007199254740992.0);
+   }
+
+   private:
+   std::uint64_t state;
+};
+
+struct BrushCell {
+   int dx, dy;
+   double weight;
+};
+
+/// @brief Cells within the radius, weighted by their distance to the center, weights sum to 1
+std::vector<BrushCell> makeBrush(const int radius) {
+   std::vector<BrushCell> brush;
+   double weightSum = 0.0;
+   for (int dx = -radius; dx <= radius; ++dx) {
+      for (int dy = -radius; dy <= radius; ++dy) {
+         const double distance = std::sqrt(double(dx * dx + dy * dy));
+         if (distance < radius) {
+            const double weight = 1.0 - distance / radius;
+            brush.push_back({dx, dy, weight});
+            weightSum += weight;
+         }
+      }
+   }
+   if (brush.empty()) { // radius 0: erode only the cell itself
+      brush.push_back({0, 0, 1.0});
+      weightSum = 1.0;
+   }
+   for (auto& cell : brush) {
+      cell.weight /= weightSum;
+   }
+   return brush;
+}
+
+struct HeightAndGradient {
+   double height, gradientX, gradientY;
+};
+
+/// @brief Bilinear interpolation of height and gradient, requires 0 <= x < rows - 1 and 0 <= y < cols - 1
+HeightAndGradient heightAndGradient(const matrix& heights, const double x, const double y) {
+   const int cellX = static_cast<int>(x);
+   const int cellY = static_cast<int>(y);
+   const double u = x - cellX;
+   const double v = y - cellY;
+   const double h00 = heights[cellX][cellY];
+   const double h10 = heights[cellX + 1][cellY];
+   const double h01 = heights[cellX][cellY + 1];
+   const double h11 = heights[cellX + 1][cellY + 1];
+   return {h00 * (1 - u) * (1 - v) + h10 * u * (1 - v) + h01 * (1 - u) * v + h11 * u * v,
+           (h10 - h00) * (1 - v) + (h11 - h01) * v,
+           (h01 - h00) * (1 - u) + (h11 - h10) * u};
+}
+
+void simulateDroplet(matrix& heights, const HydraulicErosionParams& params, const std::vector<BrushCell>& brush, double x, double y) {
+   const int rows = heights.size();
+   const int cols = heights[0].size();
+   double dirX = 0.0, dirY = 0.0;
+   double speed = 1.0;
+   double water = 1.0;
+   double sediment = 0.0;
+
+   for (unsigned step = 0; step < params.maxLifetime; ++step) {
+      const int cellX = static_cast<int>(x);
+      const int cellY = static_cast<int>(y);
+      const double u = x - cellX;
+      const double v = y - cellY;
+      const HeightAndGradient current = heightAndGradient(heights, x, y);
+
+      // Update the direction, move exactly one cell
+      dirX = dirX * params.inertia - current.gradientX * (1 - params.inertia);
+      dirY = dirY * params.inertia - current.gradientY * (1 - params.inertia);
+      const double length = std::sqrt(dirX * dirX + dirY * dirY);
+      if (length == 0.0) break;
+      dirX /= length;
+      dirY /= length;
+      x += dirX;
+      y += dirY;
+      if (x < 0 || y < 0 || x >= rows - 1 || y >= cols - 1) break;
+
+      const double newHeight = heightAndGradient(heights, x, y).height;
+      const double deltaHeight = newHeight - current.height;
+      const double capacity = std::max(-deltaHeight * speed * water * params.sedimentCapacity, params.minSedimentCapacity);
+
+      if (sediment > capacity || deltaHeight > 0) {
+         // Uphill: fill the pit behind. Otherwise drop a fraction of the excess sediment.
+         const double deposit = deltaHeight > 0 ? std::min(deltaHeight, sediment) : (sediment - capacity) * params.depositSpeed;
+         sediment -= deposit;
+         heights[cellX][cellY] += deposit * (1 - u) * (1 - v);
+         heights[cellX + 1][cellY] += deposit * u * (1 - v);
+         heights[cellX][cellY + 1] += deposit * (1 - u) * v;
+         heights[cellX + 1][cellY + 1] += deposit * u * v;
+      } else {
+         // Never erode more than the height difference, and no cell below the droplet's new height, to avoid digging holes
+         const double erode = std::min((capacity - sediment) * params.erodeSpeed, -deltaHeight);
+         for (const auto& cell : brush) {
+            const int bx = cellX + cell.dx;
+            const int by = cellY + cell.dy;
+            if (bx < 0 || by < 0 || bx >= rows || by >= cols) continue;
+            const double amount = std::min(erode * cell.weight, std::max(0.0, heights[bx][by] - newHeight));
+            heights[bx][by] -= amount;
+            sediment += amount;
+         }
+      }
+
+      speed = std::sqrt(std::max(0.0, speed * speed - deltaHeight * params.gravity));
+      water *= (1 - params.evaporateSpeed);
+   }
+}
+
+} // namespace
+
+unsigned long hydraulicErosion(matrix& heights, const HydraulicErosionParams& params) {
+   if (heights.size() < 2 || heights[0].size() < 2 || params.droplets == 0) return 0;
+   const unsigned rows = heights.size();
+   const unsigned cols = heights[0].size();
+
+   // The default constants are tuned for heights in [0, 1] on a grid 256 cells wide
+   const double heightScale = (std::max(rows, cols) - 1) / 256.0;
+   hf::assign(heights, hf::field(heights) * heightScale);
+
+   const std::vector<BrushCell> brush = makeBrush(params.radius);
+
+   // A droplet reads and writes at most `reach` cells away from its start
+   const unsigned reach = params.maxLifetime + params.radius + 2;
+   const unsigned tileSize = std::max(64u, 2 * reach + 2);
+   const unsigned tilesX = (rows + tileSize - 1) / tileSize;
+   const unsigned tilesY = (cols + tileSize - 1) / tileSize;
+   const unsigned numTiles = tilesX * tilesY;
+
+   // Droplets are spread over the tiles in rounds, so that later droplets see the erosion of earlier ones everywhere
+   const unsigned long perTile = (params.droplets + numTiles - 1) / numTiles;
+   const unsigned perRound = 32;
+   const unsigned long rounds = (perTile + perRound - 1) / perRound;
+
+   std::vector<std::vector<unsigned>> phaseTiles(4);
+   for (unsigned tx = 0; tx < tilesX; ++tx) {
+      for (unsigned ty = 0; ty < tilesY; ++ty) {
+         phaseTiles[(tx % 2) * 2 + ty % 2].push_back(tx * tilesY + ty);
+      }
+   }
+
+   for (unsigned long round = 0; round < rounds; ++round) {
+      const unsigned long inRound = std::min<unsigned long>(perRound, perTile - round * perRound);
+      for (const auto& tiles : phaseTiles) {
+         parallelFor(0, tiles.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t t = begin; t < end; ++t) {
+               const unsigned tile = tiles[t];
+               const unsigned x0 = (tile / tilesY) * tileSize;
+               const unsigned y0 = (tile % tilesY) * tileSize;
+               const unsigned width = std::min(tileSize, rows - 1 - std::min(rows - 1, x0));
+               const unsigned height = std::min(tileSize, cols - 1 - std::min(cols - 1, y0));
+               if (width == 0 || height == 0) continue;
+               SplitMix rng((std::uint64_t(params.seed) << 40) ^ (std::uint64_t(tile) << 20) ^ round);
+               for (unsigned long d = 0; d < inRound; ++d) {
+                  const double x = x0 + rng.unit() * width;
+                  const double y = y0 + rng.unit() * height;
+                  simulateDroplet(heights, params, brush, x, y);
+               }
+            }
+         });
+      }
+   }
+
+   hf::assign(heights, hf::field(heights) / heightScale);
+   return perTile * numTiles;
+}
+
+} // namespace perlin
@@ -0,0 +1,122 @@
+#include "HeightfieldFilters.hpp"
+#include "HeightfieldExpr.hpp"
+#include "Parallel.hpp"
+
+namespace perlin {
+
+namespace {
+
+/**
+ * One stencil pass src -> dst. The kernel gets the rows above, at and below the cell and the columns left, center and right of it,
+ * with indices clamped at the borders. The interior loop has no branches, so the kernels are vectorized by the compiler.
+ */
+template <typename Kernel>
+void sweep(const matrix& src, matrix& dst, const Kernel& kernel) {
+   const std::size_t rows = src.size();
+   const std::size_t cols = src[0].size();
+   parallelFor(0, rows, hf::minBandRows(cols), [&](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         const double* up = src[i > 0 ? i - 1 : i].data();
+         const double* mid = src[i].data();
+         const double* down = src[i + 1 < rows ? i + 1 : i].data();
+         double* out = dst[i].data();
+         out[0] = kernel(up, mid, down, 0, 0, cols > 1 ? 1 : 0);
+         for (std::size_t j = 1; j + 1 < cols; ++j) {
+            out[j] = kernel(up, mid, down, j - 1, j, j + 1);
+         }
+         if (cols > 1) {
+            out[cols - 1] = kernel(up, mid, down, cols - 2, cols - 1, cols - 1);
+         }
+      }
+   });
+}
+
+/// @brief Run `iterations` sweeps, swapping the buffers after each one so heights always holds the latest result
+template <typename Kernel>
+unsigned iterate(matrix& heights, const unsigned iterations, const Kernel& kernel) {
+   if (heights.empty() || heights[0].empty() || iterations == 0) return 0;
+   matrix buffer(heights.size(), std::vector<double>(heights[0].size()));
+   for (unsigned it = 0; it < iterations; ++it) {
+      sweep(heights, buffer, kernel);
+      std::swap(heights, buffer);
+   }
+   return iterations;
+}
+
+/// @brief Height difference between neighbouring cells that corresponds to a slope in mesh units
+double slopeToCellDifference(const matrix& heights, const double slope) {
+   return slope / std::max<double>(1, std::max(heights.size(), heights[0].size()) - 1);
+}
+
+inline double gaussian(const double* up, const double* mid, const double* down, std::size_t l, std::size_t c, std::size_t r) {
+   return (up[l] + 2 * up[c] + up[r] + 2 * (mid[l] + 2 * mid[c] + mid[r]) + down[l] + 2 * down[c] + down[r]) * (1.0 / 16.0);
+}
+
+inline void sort2(double& a, double& b) {
+   const double lo = std::min(a, b);
+   b = std::max(a, b);
+   a = lo;
+}
+
+/// @brief Median of 9 values with a fixed network of 19 min/max operations (no data dependent branches)
+inline double median9(double p0, double p1, double p2, double p3, double p4, double p5, double p6, double p7, double p8) {
+   sort2(p1, p2); sort2(p4, p5); sort2(p7, p8);
+   sort2(p0, p1); sort2(p3, p4); sort2(p6, p7);
+   sort2(p1, p2); sort2(p4, p5); sort2(p7, p8);
+   sort2(p0, p3); sort2(p5, p8); sort2(p4, p7);
+   sort2(p3, p6); sort2(p1, p4); sort2(p2, p5);
+   sort2(p4, p7); sort2(p4, p2); sort2(p6, p4);
+   sort2(p4, p2);
+   return p4;
+}
+
+} // namespace
+
+unsigned thermalErosion(matrix& heights, const ThermalErosionParams& params) {
+   if (!params.enabled || heights.empty() || heights[0].empty()) return 0;
+   const double talus = slopeToCellDifference(heights, params.talusSlope);
+   const double talusDiagonal = talus * std::sqrt(2.0);
+   const double rate = params.rate / 8.0; // shared among the 8 neighbours
+   // Each pair of neighbours exchanges rate * (excess height difference), which is symmetric and therefore conserves material
+   auto exchange = [=](double neighbour, double center, double threshold) {
+      const double difference = neighbour - center;
+      return std::max(0.0, difference - threshold) - std::max(0.0, -difference - threshold);
+   };
+   return iterate(heights, params.iterations, [=](const double* up, const double* mid, const double* down, std::size_t l, std::size_t c, std::size_t r) {
+      const double h = mid[c];
+      const double straight = exchange(up[c], h, talus) + exchange(down[c], h, talus) + exchange(mid[l], h, talus) + exchange(mid[r], h, talus);
+      const double diagonal = exchange(up[l], h, talusDiagonal) + exchange(up[r], h, talusDiagonal) + exchange(down[l], h, talusDiagonal) +
+                              exchange(down[r], h, talusDiagonal);
+      return h + rate * (straight + diagonal);
+   });
+}
+
+unsigned smooth(matrix& heights, const SmoothingParams& params) {
+   if (!params.enabled || heights.empty() || heights[0].empty()) return 0;
+   switch (params.filter) {
+      case SmoothingFilter::GAUSSIAN:
+         return iterate(heights, params.iterations, [](const double* up, const double* mid, const double* down, std::size_t l, std::size_t c, std::size_t r) {
+            return gaussian(up, mid, down, l, c, r);
+         });
+      case SmoothingFilter::MEDIAN:
+         return iterate(heights, params.iterations, [](const double* up, const double* mid, const double* down, std::size_t l, std::size_t c, std::size_t r) {
+            return median9(up[l], up[c], up[r], mid[l], mid[c], mid[r], down[l], down[c], down[r]);
+         });
+      case SmoothingFilter::SLOPE_LIMITED: {
+         const double limit = slopeToCellDifference(heights, params.slopeLimit);
+         const double invLimitSquared = limit > 0 ? 1.0 / (limit * limit) : 0.0;
+         return iterate(heights, params.iterations, [=](const double* up, const double* mid, const double* down, std::size_t l, std::size_t c, std::size_t r) {
+            const double h = mid[c];
+            const double gradientX = 0.5 * (down[c] - up[c]);
+            const double gradientY = 0.5 * (mid[r] - mid[l]);
+            const double slopeSquared = gradientX * gradientX + gradientY * gradientY;
+            // 0 below the limit, rising to a full blur at twice the limit. Squared slopes avoid the square root in the inner loop.
+            const double strength = std::min(1.0, std::max(0.0, (slopeSquared * invLimitSquared - 1.0) * (1.0 / 3.0)));
+            return h + strength * (gaussian(up, mid, down, l, c, r) - h);
+         });
+      }
+   }
+   return 0;
+}
+
+} // namespace perlin
@@ -0,0 +1,42 @@
+#include "LayerCache.hpp"
+
+#include <algorithm>
+
+namespace perlin {
+
+void LayerCache::put(const LayerKey& key, LayerValues&& values) {
+   const std::size_t bytes = values.bytes();
+   if (bytes > budget) return;
+   // Values of the same key are equal, the older ones are replaced
+   auto old = std::find_if(entries.begin(), entries.end(), [&key](const Entry& entry) { return entry.key == key; });
+   if (old != entries.end()) {
+      usedBytes -= old->bytes;
+      entries.erase(old);
+   }
+   entries.push_front({key, std::move(values), bytes});
+   usedBytes += bytes;
+   trim();
+}
+
+std::optional<LayerValues> LayerCache::take(const LayerKey& key) {
+   auto found = std::find_if(entries.begin(), entries.end(), [&key](const Entry& entry) { return entry.key == key; });
+   if (found == entries.end()) return std::nullopt;
+   std::optional<LayerValues> values(std::move(found->values));
+   usedBytes -= found->bytes;
+   entries.erase(found);
+   return values;
+}
+
+void LayerCache::setBudget(const std::size_t bytes) {
+   budget = bytes;
+   trim();
+}
+
+void LayerCache::trim() {
+   while (usedBytes > budget) {
+      usedBytes -= entries.back().bytes;
+      entries.pop_back();
+   }
+}
+
+} // namespace perlin
@@ -1,7 +1,53 @@
 #include "PerlinLayer.hpp"
+#include "HeightfieldExpr.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
 namespace perlin {
 
-double PerlinLayer::computeWithIndices(const std::vector<vec2d>& gradients, const unsigned x, const unsigned y, const int valBL, const int valBR, const int valTL, const int valTR) {
+QuantizedMatrix QuantizedMatrix::encode(const matrix& values) {
+   QuantizedMatrix quantized;
+   if (values.empty() || values[0].empty()) return quantized;
+   const auto [low, high] = hf::minMax(hf::field(values));
+   const double levels = 65535.0;
+   quantized.offset = low;
+   quantized.scale = (high - low) / levels;
+   // A constant matrix gets code 0 everywhere
+   const double toCode = high > low ? levels / (high - low) : 0.0;
+   const std::size_t cols = values[0].size();
+   quantized.codes.resize(values.size());
+   parallelFor(0, values.size(), hf::minBandRows(cols), [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t x = begin; x < end; ++x) {
+         const double* row = values[x].data();
+         std::vector<std::uint16_t> codes(cols);
+         for (std::size_t y = 0; y < cols; ++y) {
+            // Nonnegative, so adding 0.5 and truncating rounds to the nearest code
+            codes[y] = static_cast<std::uint16_t>(std::min((row[y] - low) * toCode + 0.5, levels));
+         }
+         quantized.codes[x] = std::move(codes);
+      }
+   });
+   return quantized;
+}
+
+matrix QuantizedMatrix::decode() const {
+   if (codes.empty()) return {};
+   return hf::evaluate(hf::quantized(codes, offset, scale));
+}
+
+std::size_t LayerValues::bytes() const {
+   std::size_t bytes = 0;
+   for (const auto& row : exact) {
+      bytes += row.size() * sizeof(double);
+   }
+   for (const auto& row : quantized.codes) {
+      bytes += row.size() * sizeof(std::uint16_t);
+   }
+   return bytes;
+}
+
+double PerlinLayer::computeWithIndices(const std::vector<vec2d>& gradients, const unsigned chunkSize, const unsigned x, const unsigned y, const int valBL, const int valBR, const int valTL, const int valTR) {
    // Compute the position of the point within the square
    double dx = (x % chunkSize + 1) / static_cast<double>(chunkSize);
    double dy = (y % chunkSize + 1) / static_cast<double>(chunkSize);
@@ -26,33 +72,59 @@ double PerlinLayer::computeWithIndices(const std::vector<vec2d>& gradients, cons
    return (lerp(lerp(dotBL, dotBR, u), lerp(dotTL, dotTR, u), v));
 }
 
+double PerlinLayer::sample(const std::vector<vec2d>& gradients, const unsigned chunkSize, const double x, const double y) {
+   const int size = gradients.size();
+   // Cell x of the integer kernel lies at (x % chunkSize + 1) / chunkSize within chunk x / chunkSize, i.e. in (0, 1]
+   const double invChunkSize = 1.0 / chunkSize;
+   const double qx = (x + 1.0) * invChunkSize;
+   const double qy = (y + 1.0) * invChunkSize;
+   const int chunkX = static_cast<int>(std::ceil(qx)) - 1;
+   const int chunkY = static_cast<int>(std::ceil(qy)) - 1;
+   const double dx = qx - chunkX;
+   const double dy = qy - chunkY;
+
+   // Same computation as computeWithIndices
+   const vec2d& gBL = gradients[wrappedHash(chunkX, chunkY, size)];
+   const vec2d& gBR = gradients[wrappedHash(chunkX + 1, chunkY, size)];
+   const vec2d& gTL = gradients[wrappedHash(chunkX, chunkY + 1, size)];
+   const vec2d& gTR = gradients[wrappedHash(chunkX + 1, chunkY + 1, size)];
+   const double dotBL = dot(gBL, {dx, dy});
+   const double dotBR = dot(gBR, {dx - 1.0, dy});
+   const double dotTL = dot(gTL, {dx, dy - 1.0});
+   const double dotTR = dot(gTR, {dx - 1.0, dy - 1.0});
+   const double u = fade(dx);
+   const double v = fade(dy);
+   return lerp(lerp(dotBL, dotBR, u), lerp(dotTL, dotTR, u), v);
+}
+
+void PerlinLayer::fillWarpedRow(const std::vector<vec2d>& gradients, const unsigned chunkSize, const WarpParams& warp, const unsigned x, const unsigned y0, const unsigned y1, double* out) {
+   // The second displacement field is the first one shifted by a fraction of chunks, so the two are uncorrelated
+   const double shiftX = 5.2 * warp.chunkSize;
+   const double shiftY = 1.3 * warp.chunkSize;
+   for (unsigned j = y0; j < y1; j++) {
+      const double warpX = warp.amplitude * sample(gradients, warp.chunkSize, x, j);
+      const double warpY = warp.amplitude * sample(gradients, warp.chunkSize, x + shiftX, j + shiftY);
+      out[j - y0] = sample(gradients, chunkSize, x + warpX, j + warpY);
+   }
+}
+
 void PerlinLayer::fillChunk(const std::vector<vec2d>& gradients, const unsigned chunkX, const unsigned chunkY) {
    if (gradients.empty()) return; // Prevent out-of-bounds access - should not happen
 
    const unsigned offsetX = chunkSize * chunkX;
    const unsigned offsetY = chunkSize * chunkY;
 
-   size_t size = gradients.size();
-
-   // Select a value for each of the 4 corners of the square from the permutation table
-   const int valBL = simpleHash(chunkX, chunkY, size);
-   const int valBR = simpleHash(chunkX + 1, chunkY, size);
-   const int valTL = simpleHash(chunkX, chunkY + 1, size);
-   const int valTR = simpleHash(chunkX + 1, chunkY + 1, size);
-
    // if chunk does not fit entirely in matrix
    const unsigned boundX = std::min(offsetX + chunkSize, sizeX);
    const unsigned boundY = std::min(offsetY + chunkSize, sizeY);
 
    // --- sequential loop
-   for (unsigned i = offsetX; i < boundX; i++) {
-      for (unsigned j = offsetY; j < boundY; j++) {
-         result[i][j] = computeWithIndices(gradients, i, j, valBL, valBR, valTL, valTR);
-      }
-   }
+   fillRegion(gradients, chunkSize, warp, offsetX, offsetY, boundX, boundY, [this](unsigned i, unsigned j, double value) {
+      result[i][j] = value;
+   });
 }
 
-void PerlinLayer::fill(const std::vector<vec2d>& gradients) {
+void PerlinLayer::fill(const std::vector<vec2d>& gradients, const CancelToken& cancel) {
    const unsigned numChunksX = std::ceil(((double) sizeX) / chunkSize);
    const unsigned numChunksY = std::ceil(((double) sizeY) / chunkSize);
 
@@ -60,27 +132,153 @@ void PerlinLayer::fill(const std::vector<vec2d>& gradients) {
    auto start = std::chrono::high_resolution_clock::now();
 
    // --- sequential loop
+   startFill();
+   for (unsigned x = 0; x < sizeX; x++) {
+      allocateRow(x);
+   }
    for (unsigned chunkX = 0; chunkX < numChunksX; chunkX++) {
       for (unsigned chunkY = 0; chunkY < numChunksY; chunkY++) {
+         cancel.check();
          fillChunk(gradients, chunkX, chunkY);
       }
    }
+   finishFill();
 
    // Measuring time
    auto end = std::chrono::high_resolution_clock::now();
    std::chrono::duration<double> elapsed = end - start;
 }
 
+void PerlinLayer::fillLattice(const std::vector<vec2d>& gradients, const unsigned stride, const bool firstPass, const CancelToken& cancel) {
+   startFill();
+   if (gradients.empty()) return;
+   const unsigned coarser = 2 * stride;
+   // Only the rows of this pass are touched, so the first passes of a large layer do not pay for all of its memory
+   for (unsigned i = 0; i < sizeX; i += stride) {
+      allocateRow(i);
+   }
+   if (warp.enabled()) {
+      // Whole rows, the rows of the coarser passes are complete already
+      for (unsigned i = 0; i < sizeX; i += stride) {
+         if (!firstPass && i % coarser == 0) continue;
+         cancel.check();
+         fillWarpedRow(gradients, chunkSize, warp, i, 0, sizeY, result[i].data());
+      }
+   } else {
+      const int size = gradients.size();
+      auto firstMultiple = [stride](const unsigned begin) {
+         return (begin + stride - 1) / stride * stride;
+      };
+      for (unsigned chunkX = 0; chunkX * chunkSize < sizeX; chunkX++) {
+         const unsigned beginX = firstMultiple(chunkX * chunkSize);
+         const unsigned endX = std::min((chunkX + 1) * chunkSize, sizeX);
+         if (beginX >= endX) continue;
+         for (unsigned chunkY = 0; chunkY * chunkSize < sizeY; chunkY++) {
+            const unsigned beginY = firstMultiple(chunkY * chunkSize);
+            const unsigned endY = std::min((chunkY + 1) * chunkSize, sizeY);
+            if (beginY >= endY) continue;
+            cancel.check();
+            // Same corners and kernel as fillRegion, so the values are identical to fill
+            const int valBL = simpleHash(chunkX, chunkY, size);
+            const int valBR = simpleHash(chunkX + 1, chunkY, size);
+            const int valTL = simpleHash(chunkX, chunkY + 1, size);
+            const int valTR = simpleHash(chunkX + 1, chunkY + 1, size);
+            for (unsigned i = beginX; i < endX; i += stride) {
+               const bool coarseRow = !firstPass && i % coarser == 0;
+               for (unsigned j = beginY; j < endY; j += stride) {
+                  if (coarseRow && j % coarser == 0) continue;
+                  result[i][j] = computeWithIndices(gradients, chunkSize, i, j, valBL, valBR, valTL, valTR);
+               }
+            }
+         }
+      }
+   }
+   if (stride == 1) {
+      finishFill();
+   }
+}
+
+void PerlinLayer::fillRows(const std::vector<vec2d>& gradients, const unsigned x0, const unsigned x1) {
+   if (x0 == 0) {
+      startFill();
+   }
+   for (unsigned x = x0; x < x1; x++) {
+      allocateRow(x);
+   }
+   fillRegion(gradients, chunkSize, warp, x0, 0, x1, sizeY, [this](unsigned i, unsigned j, double value) {
+      result[i][j] = value;
+   });
+   if (x1 == sizeX) {
+      finishFill();
+   }
+}
+
+void PerlinLayer::assign(matrix&& values) {
+   assign(LayerValues{std::move(values), {}});
+}
+
+void PerlinLayer::assign(LayerValues&& values) {
+   auto rowsFit = [this](const auto& rows) {
+      return rows.size() == sizeX && std::all_of(rows.begin(), rows.end(), [this](const auto& row) { return row.size() == sizeY; });
+   };
+   if (!values.quantized.codes.empty() ? !rowsFit(values.quantized.codes) : !rowsFit(values.exact)) {
+      throw std::invalid_argument("The values of a layer must have its size.");
+   }
+   if (values.quantized.codes.empty()) {
+      result = std::move(values.exact);
+      packed = QuantizedMatrix{};
+      finishFill();
+   } else {
+      result = matrix(sizeX);
+      packed = std::move(values.quantized);
+      filled = true;
+      setStorage(storage); // decoded if this layer keeps exact values
+   }
+}
+
+LayerValues PerlinLayer::release() {
+   LayerValues values{std::move(result), std::move(packed)};
+   result = matrix(sizeX);
+   packed = QuantizedMatrix{};
+   filled = false;
+   return values;
+}
+
+void PerlinLayer::setStorage(const LayerStorage newStorage) {
+   storage = newStorage;
+   if (!filled) return;
+   if (storage == LayerStorage::QUANTIZED16 && packed.codes.empty()) {
+      packed = QuantizedMatrix::encode(result);
+      result = matrix(sizeX);
+   } else if (storage == LayerStorage::DOUBLE && !packed.codes.empty()) {
+      result = packed.decode();
+      packed = QuantizedMatrix{};
+   }
+}
+
+void PerlinLayer::finishFill() {
+   filled = true;
+   setStorage(storage);
+}
+
 void PerlinLayer::changeWeight(const double newWeight) {
    weight = newWeight;
 }
 
-void PerlinLayer::changeChunkSize(const std::vector<vec2d>& gradients, const unsigned newChunkSize) {
+void PerlinLayer::changeChunkSize(const std::vector<vec2d>& gradients, const unsigned newChunkSize, const CancelToken& cancel) {
    chunkSize = newChunkSize;
-   fill(gradients);
+   fill(gradients, cancel);
 }
 
 void PerlinLayer::accumulate(matrix& accumulator, const double weightFactor) {
+   if (!packed.codes.empty()) {
+      // Decoded on the fly, the exact values are never materialized
+      hf::assign(accumulator, hf::field(accumulator) + weightFactor * hf::quantized(packed.codes, packed.offset, packed.scale));
+      return;
+   }
+   for (unsigned x = 0; x < sizeX; x++) {
+      allocateRow(x); // a layer which was never filled counts as zero
+   }
    // Ensure accumulator and result have the same dimensions
    if (accumulator.empty() || accumulator.size() != result.size() || accumulator[0].size() != result[0].size()) {
       throw std::runtime_error("Dimension mismatch between accumulator and result.");
@@ -89,19 +287,8 @@ void PerlinLayer::accumulate(matrix& accumulator, const double weightFactor) {
    // measuring the time
    auto start = std::chrono::high_resolution_clock::now();
 
-   // --- parallel loop
-   // Parallel transformation for each row
-   // std::execution::par could also be used here, though doesn't work on all platforms
-   std::transform(accumulator.begin(), accumulator.end(),
-                  result.begin(), accumulator.begin(),
-                  [weightFactor](std::vector<double>& accRow, const std::vector<double>& resRow) {
-                     std::transform(accRow.begin(), accRow.end(),
-                                    resRow.begin(), accRow.begin(),
-                                    [weightFactor](double accVal, double resVal) {
-                                       return accVal + weightFactor * resVal;
-                                    });
-                     return accRow;
-                  });
+   // --- fused parallel loop over rows
+   hf::assign(accumulator, hf::field(accumulator) + weightFactor * hf::field(result));
 
    // measuring the time
    auto end = std::chrono::high_resolution_clock::now();
@@ -53,16 +53,7 @@ void PerlinNoise2D::fill() {
 
 std::pair<double, double> PerlinNoise2D::getMinMaxVal() {
    // Find the minimum and maximum values in the matrix
-   double minVal = resultMatrix[0][0];
-   double maxVal = resultMatrix[0][0];
-   for (const auto& row : resultMatrix) {
-      for (double value : row) {
-         minVal = std::min(minVal, value);
-         maxVal = std::max(maxVal, value);
-      }
-   }
-
-   return std::make_pair(minVal, maxVal);
+   return hf::minMax(hf::field(resultMatrix));
 }
 
 void PerlinNoise2D::normalizeMatrix0255() {
@@ -71,12 +62,9 @@ void PerlinNoise2D::normalizeMatrix0255() {
    double minVal = minmax.first;
    double maxVal = minmax.second;
 
-   // Normalize the matrix to [0, 255]
-   for (size_t i = 0; i < sizeX; ++i) {
-      for (size_t j = 0; j < sizeY; ++j) {
-         resultMatrix[i][j] = static_cast<int>(255 * (resultMatrix[i][j] - minVal) / (maxVal - minVal));
-      }
-   }
+   // Normalize the matrix to [0, 255], truncated to integer values
+   auto truncate = [](double v) { return static_cast<double>(static_cast<int>(v)); };
+   hf::assign(resultMatrix, hf::map(hf::remap(hf::field(resultMatrix), minVal, maxVal, 0.0, 255.0), truncate));
 }
 
 void PerlinNoise2D::normalizeMatrixPM1() {
@@ -86,20 +74,12 @@ void PerlinNoise2D::normalizeMatrixPM1() {
    double maxVal = minmax.second;
 
    // Normalize the matrix to [-1, 1]
-   for (size_t i = 0; i < sizeX; ++i) {
-      for (size_t j = 0; j < sizeY; ++j) {
-         resultMatrix[i][j] = 2.0f * (resultMatrix[i][j] - minVal) / (maxVal - minVal) - 1.0f;
-      }
-   }
+   hf::assign(resultMatrix, hf::remap(hf::field(resultMatrix), minVal, maxVal, -1.0, 1.0));
 }
 
 void PerlinNoise2D::normalizeMatrixSUM(const double flatteningFactor) {
    // Normalize the matrix by dividing by the sum of the weights
-   for (size_t i = 0; i < sizeX; ++i) {
-      for (size_t j = 0; j < sizeY; ++j) {
-         resultMatrix[i][j] /= weightSum * flatteningFactor;
-      }
-   }
+   hf::assign(resultMatrix, hf::field(resultMatrix) / (weightSum * flatteningFactor));
 }
 
 void PerlinNoise2D::normalizeMatrixReLU(const double threshold) {
@@ -110,21 +90,12 @@ void PerlinNoise2D::normalizeMatrixReLU(const double threshold) {
 
 void PerlinNoise2D::matrixReLU(const double threshold) {
    // Apply the ReLU function with minimal threshold to the matrix
-   for (auto& row : resultMatrix) {
-      for (auto& el : row) {
-         el = std::max(el, threshold);
-      }
-   }
+   hf::assign(resultMatrix, hf::max(hf::field(resultMatrix), threshold));
 }
 
-void PerlinNoise2D::filterMatrix(perlin::PerlinNoise2D& other) {
+void PerlinNoise2D::filterMatrix(const perlin::PerlinNoise2D& other) {
    // Update the own matrix with the maximum values of the own and another PerlinNoise2D object's matrix
-   matrix otherMatrix = other.getResultRef();
-   for (unsigned i = 0; i < sizeX; i++) {
-      for (unsigned j = 0; j < sizeY; j++) {
-         resultMatrix[i][j] = std::max(resultMatrix.at(i).at(j), otherMatrix.at(i).at(j));
-      }
-   }
+   hf::assign(resultMatrix, hf::max(hf::field(resultMatrix), hf::field(other.getResultRef())));
 }
 
 // --- Layer functions ---
@@ -0,0 +1,16 @@
+#include "RebuildScheduler.hpp"
+
+void RebuildScheduler::plan(const Clock::time_point now) {
+   if (!pending) {
+      pending = true;
+      firstEdit = now;
+   }
+   lastEdit = now;
+}
+
+bool RebuildScheduler::due(const Clock::time_point now) {
+   if (!pending) return false;
+   if (now - lastEdit < quietTime && now - firstEdit < maxDelay) return false;
+   pending = false;
+   return true;
+}
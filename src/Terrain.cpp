@@ -1,260 +1,356 @@
 #include "Terrain.hpp"
 
+#include <chrono>
+#include <iostream>
+#include <memory>
+
 Terrain::Terrain(const BasicConfigParams& basicConfigParams, const std::vector<layerP>& noiseParams, const std::vector<layerP>& baselineParams)
    : configParams(basicConfigParams),
      noiseParams(noiseParams),
-     baselineParams(baselineParams) {
-   createFromSeed(configParams.seed);
+     baselineParams(baselineParams),
+     noiseWarps(noiseParams.size()),
+     baselineWarps(baselineParams.size()),
+     generator(basicConfigParams.sizeX, basicConfigParams.sizeY) {
+   requestBuild();
 }
 
-void Terrain::createFromSeed(const int newSeed) {
-   configParams.seed = newSeed;
-   // Create gradients
-   perlin::AppConfig::getInstance().setGenerator(configParams.seed);
-   gradients.resize(128);
-   for (auto& vec : gradients) {
-      vec = perlin::random2DGrad();
-   }
-   // Create Layers and noise matrices
-   initializeNoise(noiseParams);
-   initializeBaseline(baselineParams);
-   // Create Mesh
-   computeMesh(configParams.flattenFactor);
-   std::cout << "Terrain complete\n";
+void Terrain::requestBuild() {
+   TerrainSettings settings = getSettings();
+#ifdef TERRAIN_NO_THREADS
+   // The simplified triangulation is computed by finishBuild when it is drawn
+   generator.begin(settings);
+   buildStart = std::chrono::high_resolution_clock::now();
+#else
+   const bool simplified = renderSimplified;
+   const float maxError = renderMaxError;
+   worker.submit([this, settings = std::move(settings), simplified, maxError](const perlin::CancelToken& cancel) {
+      auto start = std::chrono::high_resolution_clock::now();
+      // Previews are drawn like any other build, the next one (or the full mesh) replaces them
+      auto preview = [this, start](GridMeshData&& mesh, const unsigned stride) {
+         std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+         std::cout << "Terrain preview 1/" << stride << " in " << seconds.count() << "s\n";
+         std::lock_guard<std::mutex> lock(readyMutex);
+         ready = Build{std::move(mesh), std::nullopt, {}, 0.0f};
+      };
+      Build build{generator.generate(settings, cancel, preview), std::nullopt, {}, maxError};
+      if (simplified) {
+         cancel.check();
+         build.rtin.emplace(build.mesh.vertices, build.mesh.sizeX, build.mesh.sizeY);
+         build.triangles = build.rtin->triangulate(maxError);
+      }
+      std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+      std::cout << "Terrain complete in " << seconds.count() << "s\n";
+      std::lock_guard<std::mutex> lock(readyMutex);
+      ready = std::move(build);
+   });
+#endif
 }
-// todo: add exceptions
-void Terrain::adjustNoiseLayerWeight(const unsigned index, const double weight) {
-   if (noiseLayers.has_value()) {
-      if (index < noiseLayers->size()) {
-         double oldWeight = (*noiseLayers)[index].getWeight();
-         double weightFactor = weight - oldWeight;
-         (*noiseLayers)[index].changeWeight(weight);
-         if (noise.has_value()) {
-            (*noiseLayers)[index].accumulate(*noise, weightFactor);
-         } else {
-            std::cout << "noise not initialized yet\n";
-         }
 
-      } else {
-         std::cout << "index out of bounds\n";
+void Terrain::update() {
+   if (scheduler.due()) {
+      requestBuild();
+   }
+#ifdef TERRAIN_NO_THREADS
+   if (std::optional<GridMeshData> data = generator.step(TerrainGenerator::Clock::now() + stepBudget)) {
+      std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - buildStart;
+      std::cout << "Terrain complete in " << seconds.count() << "s\n";
+      ready = Build{std::move(*data), std::nullopt, {}, 0.0f};
+   }
+#endif
+   std::optional<Build> build;
+   {
+      std::lock_guard<std::mutex> lock(readyMutex);
+      build = std::move(ready);
+      ready.reset();
+   }
+   if (build.has_value()) {
+      if (!mesh.has_value()) {
+         mesh.emplace(std::move(build->mesh), indexMode);
+         mesh->setFrustumCulling(frustumCulling);
+         finishBuild(*build);
+         return;
       }
-   } else {
-      std::cout << "noiseLayers not initalized yet\n";
+      // A build still being uploaded is dropped, its vertices are outdated
+      mesh->beginUpdate(std::move(build->mesh));
+      uploading = std::move(build);
+   }
+   if (!mesh.has_value()) return;
+   if (!mesh->isUploading()) {
+      // The textures of the LOD renderer follow the vertices, in slices of the same budget
+      if (lod.has_value()) {
+         lod->continueUpload(*mesh, uploadBudget);
+      }
+      return;
+   }
+   const unsigned long sizeX = mesh->sizeX, sizeY = mesh->sizeY;
+   if (mesh->continueUpload(uploadBudget)) {
+      if (mesh->sizeX != sizeX || mesh->sizeY != sizeY) {
+         lod.reset(); // built again for the new grid when it is drawn
+      } else if (lod.has_value()) {
+         lod->beginUpdate(*mesh); // keeps drawing the previous heights until its upload is complete
+      }
+      finishBuild(*uploading);
+      uploading.reset();
    }
 }
 
-void Terrain::adjustNoiseLayerChunkSize(const unsigned index, const unsigned chunkSize) {
-   if (noiseLayers.has_value()) {
-      if (index < noiseLayers->size()) {
-         if (noise.has_value()) {
-            double weight = (*noiseLayers)[index].getWeight();
-            (*noiseLayers)[index].accumulate(*noise, -weight); // subtract old layer;
-            (*noiseLayers)[index].changeChunkSize(gradients, chunkSize); // recompute layer with new chunkSize
-            (*noiseLayers)[index].accumulate(*noise, weight); // add new layer back
-         } else {
-            std::cout << "noise not initialized yet\n";
-         }
-      } else {
-         std::cout << "index out of bounds\n";
-      }
+bool Terrain::isBuilding() const {
+   {
+      std::lock_guard<std::mutex> lock(readyMutex);
+      if (ready.has_value()) return true;
+   }
+#ifdef TERRAIN_NO_THREADS
+   const bool generating = generator.isStepping();
+#else
+   const bool generating = worker.isBusy();
+#endif
+   return scheduler.isPending() || generating || (mesh.has_value() && mesh->isUploading()) || (lod.has_value() && lod->isUploading());
+}
+
+void Terrain::finishBuild(Build& build) {
+   rtin = std::move(build.rtin);
+   if (renderSimplified && rtin.has_value() && build.maxError == renderMaxError) {
+      mesh->setTriangles(build.triangles);
    } else {
-      std::cout << "noiseLayers not initalized yet\n";
+      applySimplification(); // the settings changed during the build
    }
 }
 
-// todo: add exceptions
-void Terrain::adjustBaselineLayerWeight(const unsigned index, const double weight) {
-   if (baselineLayers.has_value()) {
-      if (index < baselineLayers->size()) {
-         double oldWeight = (*baselineLayers)[index].getWeight();
-         double weightFactor = weight - oldWeight;
-         (*baselineLayers)[index].changeWeight(weight);
-         if (baseline.has_value()) {
-            (*baselineLayers)[index].accumulate(*baseline, weightFactor);
-         } else {
-            std::cout << "baseline not initialized yet\n";
-         }
+void Terrain::createFromSeed(const int newSeed) {
+   configParams.seed = newSeed;
+   scheduleBuild();
+}
 
-      } else {
-         std::cout << "index out of bounds\n";
-      }
-   } else {
-      std::cout << "baselineLayers not initalized yet\n";
+void Terrain::computeMesh(const double flattenFactor) {
+   configParams.flattenFactor = flattenFactor;
+   scheduleBuild();
+}
+
+void Terrain::setPostProcessParams(const PostProcessParams& params) {
+   postProcessParams = params;
+   scheduleBuild();
+}
+
+void Terrain::setLayerStorage(const perlin::LayerStorage storage) {
+   layerStorage = storage;
+   scheduleBuild();
+}
+
+void Terrain::setIndexMode(const IndexMode mode) {
+   indexMode = mode;
+   if (mesh.has_value()) {
+      mesh->setIndexMode(mode);
    }
 }
 
-void Terrain::adjustBaselineLayerChunkSize(const unsigned index, const unsigned chunkSize) {
-   if (baselineLayers.has_value()) {
-      if (index < baselineLayers->size()) {
-         if (baseline.has_value()) {
-            double weight = (*baselineLayers)[index].getWeight();
-            (*baselineLayers)[index].accumulate(*baseline, -weight); // subtract old layer;
-            (*baselineLayers)[index].changeChunkSize(gradients, chunkSize); // recompute layer with new chunkSize
-            (*baselineLayers)[index].accumulate(*baseline, weight); // add new layer back
-         } else {
-            std::cout << "noise not initialized yet\n";
-         }
-      } else {
-         std::cout << "index out of bounds\n";
-      }
-   } else {
-      std::cout << "noiseLayers not initalized yet\n";
+const Rtin& Terrain::getRtin() {
+   if (!rtin.has_value()) {
+      rtin.emplace(mesh->vertices, mesh->sizeX, mesh->sizeY);
    }
+   return *rtin;
 }
 
-void Terrain::adjustNoiseBoth(const unsigned index, const layerP pair) {
-   if (noiseLayers.has_value()) {
-      if (index < noiseLayers->size()) {
-         if (noise.has_value()) {
-            double weight = (*noiseLayers)[index].getWeight();
-            (*noiseLayers)[index].accumulate(*noise, -weight); // subtract old layer;
-            (*noiseLayers)[index].changeChunkSize(gradients, pair.first); // recompute layer with new chunkSize
-            (*noiseLayers)[index].changeWeight(pair.second);
-            (*noiseLayers)[index].accumulate(*noise, pair.second); // add new layer back
-         } else {
-            std::cout << "noise not initialized yet\n";
-         }
-      } else {
-         std::cout << "index out of bounds\n";
-      }
+void Terrain::applySimplification() {
+   if (!mesh.has_value()) return;
+   if (renderSimplified) {
+      mesh->setTriangles(simplify(renderMaxError));
    } else {
-      std::cout << "noiseLayers not initalized yet\n";
+      mesh->setTriangles({});
    }
 }
 
-void Terrain::adjustBaselineBoth(const unsigned index, const layerP pair) {
-   if (baselineLayers.has_value()) {
-      if (index < baselineLayers->size()) {
-         if (baseline.has_value()) {
-            double weight = (*baselineLayers)[index].getWeight();
-            (*baselineLayers)[index].accumulate(*baseline, -weight); // subtract old layer;
-            (*baselineLayers)[index].changeChunkSize(gradients, pair.first); // recompute layer with new chunkSize
-            (*baselineLayers)[index].changeWeight(pair.second);
-            (*baselineLayers)[index].accumulate(*baseline, pair.second); // add new layer back
-         } else {
-            std::cout << "noise not initialized yet\n";
-         }
-      } else {
-         std::cout << "index out of bounds\n";
-      }
-   } else {
-      std::cout << "noiseLayers not initalized yet\n";
+void Terrain::setRenderSimplification(const bool enabled, const float maxError) {
+   if (enabled == renderSimplified && (!enabled || maxError == renderMaxError)) return;
+   renderSimplified = enabled;
+   renderMaxError = maxError;
+   applySimplification();
+}
+
+void Terrain::setFrustumCulling(const bool enabled) {
+   frustumCulling = enabled;
+   if (mesh.has_value()) {
+      mesh->setFrustumCulling(enabled);
    }
 }
 
-void Terrain::initializeNoise(const std::vector<layerP>& noiseParams) {
-   std::vector<perlin::PerlinLayer> layers;
-   const unsigned sizeX = configParams.sizeX;
-   const unsigned sizeY = configParams.sizeY;
-   noise.emplace(perlin::matrix(sizeX, std::vector<double>(sizeY, 0.0)));
-   int i = 0;
-   for (const auto& param : noiseParams) {
-      layers.emplace_back(sizeX, sizeY, param.first, param.second);
-      layers[i].fill(gradients);
-      layers[i++].accumulate(*noise, param.second); //weight
+void Terrain::setGraph(TerrainGraph&& newGraph) {
+   if (newGraph.getSizeX() != configParams.sizeX || newGraph.getSizeY() != configParams.sizeY) {
+      throw std::invalid_argument("The size of the graph must match the size of the terrain.");
    }
-   noiseLayers = std::move(layers);
+   graphNodeCount = newGraph.numNodes();
+   graphJson = newGraph.toJson();
+   graph = std::make_shared<TerrainGraph>(std::move(newGraph));
+   scheduleBuild();
 }
 
-void Terrain::initializeBaseline(const std::vector<layerP>& noiseParams) {
-   std::vector<perlin::PerlinLayer> layers;
-   const unsigned sizeX = configParams.sizeX;
-   const unsigned sizeY = configParams.sizeY;
-   baseline.emplace(perlin::matrix(sizeX, std::vector<double>(sizeY, 0.0)));
-   int i = 0;
-   for (const auto& param : noiseParams) {
-      layers.emplace_back(sizeX, sizeY, param.first, param.second);
-      layers[i].fill(gradients);
-      layers[i++].accumulate(*baseline, param.second); //weight
+void Terrain::clearGraph() {
+   if (graph) {
+      graph.reset();
+      graphNodeCount = 0;
+      graphJson = nlohmann::json();
+      scheduleBuild();
    }
-   baselineLayers = std::move(layers);
 }
 
-void Terrain::computeMesh(const double flattenFactor) {
-   // the max of noise and baseline, as well as the normalization should be done here.
-   // then the mesh is constructed.
-   // create a new constructor for mesh which passes both matrices.
-   // as Mesh only need the y-value and iterates over the entire final result matrix anyway,
-   // we can move the computation of the y-value inside the new constructor.
-   // check for optionals
-   configParams.flattenFactor = flattenFactor;
-   double normalizingFactor = 0.0;
-   for (auto& layer : *noiseLayers) {
-      normalizingFactor += layer.getWeight();
+/// @brief Chunk size, weight and warp of every layer of a stack, the format of the settings files
+static nlohmann::json layersToJson(const std::vector<layerP>& params, const std::vector<perlin::WarpParams>& warps) {
+   nlohmann::json layers = nlohmann::json::array();
+   for (std::size_t i = 0; i < params.size(); ++i) {
+      const perlin::WarpParams warp = i < warps.size() ? warps[i] : perlin::WarpParams{};
+      layers.push_back({{"chunkSize", params[i].first}, {"weight", params[i].second}, {"warpChunkSize", warp.chunkSize}, {"warpAmplitude", warp.amplitude}});
    }
-   normalizingFactor *= flattenFactor;
-   auto& noiseMatrix = *noise;
-   auto& baselineMatrix = *baseline;
-   unsigned numX = noiseMatrix.size() - 1;
-   unsigned numY = noiseMatrix[0].size() - 1;
-   unsigned numVertices = (numX + 1) * (numY + 1);
-   unsigned numFaces = numX * numY;
-   std::vector<Vertex> _vertices(numVertices);
-   std::vector<GLuint> _indices(numFaces * 6);
-   float invNumX = 1.0f / numX;
-   float invNumY = 1.0f / numY;
+   return layers;
+}
 
-   for (unsigned j = 0; j <= numY; ++j) {
-      for (unsigned i = 0; i <= numX; ++i) {
-         const double yValue = std::max(baselineMatrix[i][j], noiseMatrix[i][j]) / normalizingFactor;
+static void layersFromJson(const nlohmann::json& layers, std::vector<layerP>& params, std::vector<perlin::WarpParams>& warps) {
+   params.clear();
+   warps.clear();
+   for (const auto& layer : layers) {
+      params.emplace_back(layer.at("chunkSize").get<unsigned>(), layer.at("weight").get<double>());
+      warps.push_back({layer.value("warpChunkSize", 0u), layer.value("warpAmplitude", 0.0)});
+   }
+}
 
-         glm::vec3 coordinates = glm::vec3(i * invNumX - 0.5f, yValue, j * invNumY - 0.5f);
-         glm::vec3 normal = glm::vec3(0.0f);
-         glm::vec2 texCoordinates = glm::vec2(i * invNumX, j * invNumY);
+bool Terrain::saveSnapshot(const std::string& filename, const nlohmann::json& extra, const bool withMesh) {
+   if (!mesh.has_value() || isBuilding()) {
+      std::cerr << "Failed to save snapshot " << filename << ": the terrain is still being built" << std::endl;
+      return false;
+   }
+   auto start = std::chrono::high_resolution_clock::now();
+   nlohmann::json parameters;
+   nlohmann::json& settings = parameters["terrain"];
+   settings["seed"] = configParams.seed;
+   settings["sizeX"] = configParams.sizeX;
+   settings["sizeY"] = configParams.sizeY;
+   settings["flattenFactor"] = configParams.flattenFactor;
+   settings["noiseParams"] = layersToJson(noiseParams, noiseWarps);
+   settings["baselineParams"] = layersToJson(baselineParams, baselineWarps);
+   postProcessToJson(postProcessParams, settings);
+   if (graph) {
+      settings["graph"] = graphJson;
+   }
+   parameters["extra"] = extra;
 
-         _vertices[j * (numX + 1) + i] = Vertex{coordinates, normal, glm::vec3(0.3f, 0.70f, 0.44f), texCoordinates};
-      }
+   // No build is running, so the generator is not in use
+   SnapshotWriter writer;
+   parameters["generator"] = generator.addToSnapshot(writer);
+   std::vector<float> heights(mesh->vertices.size());
+   std::transform(mesh->vertices.begin(), mesh->vertices.end(), heights.begin(), [](const TerrainVertex& vertex) {
+      return vertex.height;
+   });
+   writer.add(SnapshotSection::HEIGHTS, 0, heights.data(), heights.size() * sizeof(float));
+   if (withMesh) {
+      writer.add(SnapshotSection::MESH_VERTICES, 0, mesh->vertices.data(), mesh->vertices.size() * sizeof(TerrainVertex));
    }
-   for (unsigned j = 0, k = 0; j < numY; ++j) {
-      for (unsigned i = 0; i < numX; ++i) {
-         _indices[k] = j * (numX + 1) + i;
-         _indices[k + 1] = j * (numX + 1) + i + 1;
-         _indices[k + 2] = (j + 1) * (numX + 1) + i + 1;
-         _indices[k + 3] = (j + 1) * (numX + 1) + i + 1;
-         _indices[k + 4] = (j + 1) * (numX + 1) + i;
-         _indices[k + 5] = j * (numX + 1) + i;
-         k += 6;
+   if (!writer.write(filename, parameters)) return false;
+   std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+   std::cout << "Snapshot saved to " << filename << " in " << seconds.count() << "s\n";
+   return true;
+}
+
+nlohmann::json Terrain::loadSnapshot(const std::string& filename) {
+   auto start = std::chrono::high_resolution_clock::now();
+   const Snapshot snapshot(filename);
+   const nlohmann::json& parameters = snapshot.getParameters();
+
+   // Everything is read before the terrain is changed
+   int seed;
+   double flattenFactor;
+   std::vector<layerP> newNoiseParams, newBaselineParams;
+   std::vector<perlin::WarpParams> newNoiseWarps, newBaselineWarps;
+   PostProcessParams newPostProcessParams;
+   std::optional<TerrainGraph> newGraph;
+   const nlohmann::json* generatorState = nullptr;
+   try {
+      const nlohmann::json& settings = parameters.at("terrain");
+      if (settings.at("sizeX").get<unsigned>() != configParams.sizeX || settings.at("sizeY").get<unsigned>() != configParams.sizeY) {
+         throw std::runtime_error("Failed to load snapshot " + filename + ": it was saved from a terrain of another size");
       }
+      seed = settings.at("seed").get<int>();
+      flattenFactor = settings.at("flattenFactor").get<double>();
+      layersFromJson(settings.at("noiseParams"), newNoiseParams, newNoiseWarps);
+      layersFromJson(settings.at("baselineParams"), newBaselineParams, newBaselineWarps);
+      newPostProcessParams = postProcessFromJson(settings, {});
+      if (settings.contains("graph")) {
+         newGraph.emplace(TerrainGraph::fromJson(settings["graph"], configParams.sizeX, configParams.sizeY));
+      }
+      generatorState = &parameters.at("generator");
+   } catch (const nlohmann::json::exception& e) {
+      throw std::runtime_error("Invalid snapshot " + filename + ": " + e.what());
+   } catch (const std::invalid_argument& e) {
+      throw std::runtime_error("Invalid terrain graph in snapshot " + filename + ": " + e.what());
+   }
+   auto restored = std::make_shared<TerrainGenerator>(configParams.sizeX, configParams.sizeY);
+   restored->restore(snapshot, *generatorState);
+
+   auto data = std::make_shared<GridMeshData>();
+   const std::size_t count = std::size_t(configParams.sizeX) * configParams.sizeY;
+   if (snapshot.find(SnapshotSection::MESH_VERTICES).data) {
+      const FilePart vertices = snapshot.require(SnapshotSection::MESH_VERTICES, 0, count * sizeof(TerrainVertex));
+      const TerrainVertex* first = static_cast<const TerrainVertex*>(vertices.data);
+      data->sizeX = configParams.sizeX;
+      data->sizeY = configParams.sizeY;
+      data->vertices.assign(first, first + count);
+      data->pyramid.build(data->vertices, data->sizeX, data->sizeY);
+   } else {
+      const FilePart heights = snapshot.require(SnapshotSection::HEIGHTS, 0, count * sizeof(float));
+      const float* first = static_cast<const float*>(heights.data);
+      *data = buildGridMeshData(std::vector<float>(first, first + count), configParams.sizeX - 1, configParams.sizeY - 1);
    }
-   mesh.emplace(_vertices, _indices);
+
+   configParams.seed = seed;
+   configParams.flattenFactor = flattenFactor;
+   layerStorage = restored->getLayerStorage(); // the next build keeps the restored layers as they are
+   noiseParams = std::move(newNoiseParams);
+   baselineParams = std::move(newBaselineParams);
+   noiseWarps = std::move(newNoiseWarps);
+   baselineWarps = std::move(newBaselineWarps);
+   postProcessParams = newPostProcessParams;
+   if (newGraph) {
+      graphNodeCount = newGraph->numNodes();
+      graphJson = parameters["terrain"]["graph"];
+      graph = std::make_shared<TerrainGraph>(std::move(*newGraph));
+   } else {
+      graph.reset();
+      graphNodeCount = 0;
+      graphJson = nlohmann::json();
+   }
+   scheduler.cancel();
+#ifdef TERRAIN_NO_THREADS
+   generator = std::move(*restored);
+   ready = Build{std::move(*data), std::nullopt, {}, 0.0f};
+#else
+   // The generator belongs to the jobs of the worker, the running one is cancelled
+   worker.submit([this, restored, data](const perlin::CancelToken&) {
+      generator = std::move(*restored);
+      std::lock_guard<std::mutex> lock(readyMutex);
+      ready = Build{std::move(*data), std::nullopt, {}, 0.0f};
+   });
+#endif
+   std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+   std::cout << "Snapshot loaded from " << filename << " in " << seconds.count() << "s\n";
+   return parameters.value("extra", nlohmann::json());
+}
+
+void Terrain::updateView(const Camera& camera) {
+   if (!graph) return; // only graph builds use it
+   const QuadRegion quads = mesh->viewBounds(camera.frustum());
+   view = quads.x0 < quads.x1 ? GridRegion{quads.x0, quads.z0, quads.x1 + 1, quads.z1 + 1} : GridRegion{};
 }
 
 void Terrain::Draw(Shader& shader, Camera& camera) {
    if (mesh.has_value()) {
+      updateView(camera);
       (*mesh).Draw(shader, camera);
    }
 }
 
-void Terrain::recomputeLayers(std::vector<UpdateState>& noiseLayerUpdate, std::vector<UpdateState>& baselineLayerUpdate) {
-   for (unsigned i = 0; i < noiseLayerUpdate.size(); ++i) {
-      switch (noiseLayerUpdate[i]) {
-         case WEIGHT:
-            adjustNoiseLayerWeight(i, noiseParams[i].second);
-            break;
-         case CHUNK_SIZE:
-            adjustNoiseLayerChunkSize(i, noiseParams[i].first);
-            break;
-         case BOTH:
-            adjustNoiseBoth(i, noiseParams[i]);
-         default:
-            break;
-      }
-      noiseLayerUpdate[i] = NONE;
-   }
-   for (unsigned i = 0; i < baselineLayerUpdate.size(); ++i) {
-      switch (baselineLayerUpdate[i]) {
-         case WEIGHT:
-            adjustBaselineLayerWeight(i, baselineParams[i].second);
-            break;
-         case CHUNK_SIZE:
-            adjustBaselineLayerChunkSize(i, baselineParams[i].first);
-            break;
-         case BOTH:
-            adjustBaselineBoth(i, baselineParams[i]);
-         default:
-            break;
-      }
-      baselineLayerUpdate[i] = NONE;
+void Terrain::DrawLod(Shader& shader, Camera& camera) {
+   if (!mesh.has_value()) return;
+   updateView(camera);
+   if (!lod.has_value()) {
+      lod.emplace(*mesh);
    }
-   computeMesh(configParams.flattenFactor);
+   lod->setDetailDistance(lodDetailDistance);
+   lod->Draw(shader, camera);
 }
@@ -11,9 +11,7 @@ Terrain3D::Terrain3D(const unsigned sizeX, const unsigned sizeY, const int seed,
      baseline(sizeX, sizeY, baselineLayerParams) {
    noise.fill();
    baseline.fill();
-   noise.filterMatrix(baseline);
-   noise.normalizeMatrixSUM(flattenFactor);
-   mesh.emplace(noise.getResult());
+   computeMesh();
 }
 
 Terrain3D::Terrain3D(const unsigned sizeX, const unsigned sizeY, std::vector<std::pair<unsigned, double>>& noiseLayerParams,
@@ -24,9 +22,7 @@ Terrain3D::Terrain3D(const unsigned sizeX, const unsigned sizeY, std::vector<std
      noise(sizeX, sizeY, noiseLayerParams), baseline(sizeX, sizeY, baselineLayerParams) {
    noise.fill();
    baseline.fill();
-   noise.filterMatrix(baseline);
-   noise.normalizeMatrixSUM(flattenFactor);
-   mesh.emplace(noise.getResult());
+   computeMesh();
 }
 
 void Terrain3D::adjustLayer(const bool isFilterLayer, const unsigned index, const unsigned newChunkSize, const double newWeight) {
@@ -53,10 +49,14 @@ void Terrain3D::recompute(const int new_seed, const double new_flattenFactor) {
    std::cout << "Filled 1\n";
    baseline.fill();
    std::cout << "Filled 2\n";
-   noise.filterMatrix(baseline);
+   computeMesh();
+}
 
-   noise.normalizeMatrixSUM(flattenFactor);
-   mesh.emplace(noise.getResult());
+void Terrain3D::computeMesh() {
+   // max(noise, baseline) / (weightSum * flattenFactor) in a single pass, without modifying the noise matrix
+   const double normalizingFactor = noise.getWeightSum() * flattenFactor;
+   const auto heights = perlin::hf::max(perlin::hf::field(noise.getResultRef()), perlin::hf::field(baseline.getResultRef())) / normalizingFactor;
+   mesh.emplace(perlin::hf::evaluate(heights));
 }
 
 void Terrain3D::Draw(Shader& shader, Camera& camera) {
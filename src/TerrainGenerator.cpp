@@ -0,0 +1,640 @@
+#include "TerrainGenerator.hpp"
+#include "AppConfig.hpp"
+#include "GridNormals.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+void postProcessToJson(const PostProcessParams& params, nlohmann::json& j) {
+   j["erosion"] = {{"enabled", params.hydraulic.enabled},
+                   {"droplets", params.hydraulic.droplets},
+                   {"seed", params.hydraulic.seed},
+                   {"maxLifetime", params.hydraulic.maxLifetime},
+                   {"radius", params.hydraulic.radius},
+                   {"inertia", params.hydraulic.inertia},
+                   {"sedimentCapacity", params.hydraulic.sedimentCapacity},
+                   {"minSedimentCapacity", params.hydraulic.minSedimentCapacity},
+                   {"erodeSpeed", params.hydraulic.erodeSpeed},
+                   {"depositSpeed", params.hydraulic.depositSpeed},
+                   {"evaporateSpeed", params.hydraulic.evaporateSpeed},
+                   {"gravity", params.hydraulic.gravity}};
+   j["thermalErosion"] = {{"enabled", params.thermal.enabled},
+                          {"iterations", params.thermal.iterations},
+                          {"talusSlope", params.thermal.talusSlope},
+                          {"rate", params.thermal.rate}};
+   j["smoothing"] = {{"enabled", params.smoothing.enabled},
+                     {"filter", static_cast<int>(params.smoothing.filter)},
+                     {"iterations", params.smoothing.iterations},
+                     {"slopeLimit", params.smoothing.slopeLimit}};
+}
+
+PostProcessParams postProcessFromJson(const nlohmann::json& j, PostProcessParams params) {
+   if (j.contains("erosion")) {
+      const auto& e = j["erosion"];
+      params.hydraulic.enabled = e.value("enabled", false);
+      params.hydraulic.droplets = e.value("droplets", params.hydraulic.droplets);
+      params.hydraulic.seed = e.value("seed", params.hydraulic.seed);
+      params.hydraulic.maxLifetime = e.value("maxLifetime", params.hydraulic.maxLifetime);
+      params.hydraulic.radius = e.value("radius", params.hydraulic.radius);
+      params.hydraulic.inertia = e.value("inertia", params.hydraulic.inertia);
+      params.hydraulic.sedimentCapacity = e.value("sedimentCapacity", params.hydraulic.sedimentCapacity);
+      params.hydraulic.minSedimentCapacity = e.value("minSedimentCapacity", params.hydraulic.minSedimentCapacity);
+      params.hydraulic.erodeSpeed = e.value("erodeSpeed", params.hydraulic.erodeSpeed);
+      params.hydraulic.depositSpeed = e.value("depositSpeed", params.hydraulic.depositSpeed);
+      params.hydraulic.evaporateSpeed = e.value("evaporateSpeed", params.hydraulic.evaporateSpeed);
+      params.hydraulic.gravity = e.value("gravity", params.hydraulic.gravity);
+   } else {
+      params.hydraulic.enabled = false;
+   }
+   if (j.contains("thermalErosion")) {
+      const auto& t = j["thermalErosion"];
+      params.thermal.enabled = t.value("enabled", false);
+      params.thermal.iterations = t.value("iterations", params.thermal.iterations);
+      params.thermal.talusSlope = t.value("talusSlope", params.thermal.talusSlope);
+      params.thermal.rate = t.value("rate", params.thermal.rate);
+   } else {
+      params.thermal.enabled = false;
+   }
+   if (j.contains("smoothing")) {
+      const auto& f = j["smoothing"];
+      params.smoothing.enabled = f.value("enabled", false);
+      params.smoothing.filter = static_cast<perlin::SmoothingFilter>(std::clamp(f.value("filter", 0), 0, 2));
+      params.smoothing.iterations = f.value("iterations", params.smoothing.iterations);
+      params.smoothing.slopeLimit = f.value("slopeLimit", params.smoothing.slopeLimit);
+   } else {
+      params.smoothing.enabled = false;
+   }
+   return params;
+}
+
+TerrainGenerator::TerrainGenerator(const unsigned sizeX, const unsigned sizeY) : sizeX(sizeX), sizeY(sizeY) {
+}
+
+std::vector<perlin::vec2d> TerrainGenerator::gradientsFor(const int seed) {
+   // Own generator, the same sequence as AppConfig::setGenerator(seed) gives, so tiles can be computed during a build
+   perlin::UniformUnitGenerator unif(seed);
+   std::vector<perlin::vec2d> gradients(128);
+   for (auto& vec : gradients) {
+      vec = perlin::random2DGrad(unif);
+   }
+   return gradients;
+}
+
+void TerrainGenerator::reseed(const int newSeed) {
+   // The layers of the old seed stay in the cache, in case it is used again
+   for (auto* layers : {&noiseLayers, &baselineLayers}) {
+      for (perlin::PerlinLayer& layer : *layers) {
+         retire(layer);
+      }
+   }
+   seed = newSeed;
+   seeded = true;
+   gradients = gradientsFor(seed);
+   noiseLayers.clear();
+   baselineLayers.clear();
+   noise.clear();
+   baseline.clear();
+   if (graph) {
+      graph->setGradients(gradients, seed);
+   }
+}
+
+void TerrainGenerator::setLayerStorage(const perlin::LayerStorage storage) {
+   if (storage == layerStorage) return;
+   layerStorage = storage;
+   // Every filled layer leaves its sum with the values it was added with, so the sums stay exact sums of their layers
+   for (auto [layers, sum] : {std::pair{&noiseLayers, &noise}, std::pair{&baselineLayers, &baseline}}) {
+      for (perlin::PerlinLayer& layer : *layers) {
+         const double weight = layer.getWeight();
+         if (!layer.isFilled()) {
+            layer.setStorage(storage); // out of the sum, stored as set once it is filled
+            continue;
+         }
+         if (weight != 0.0) {
+            layer.accumulate(*sum, -weight);
+         }
+         if (layer.isQuantized()) {
+            // The exact values are gone, the next build fills the layer again (or takes it from the cache)
+            layer.changeWeight(0.0);
+            retire(layer);
+            layer.setStorage(storage);
+         } else {
+            layer.setStorage(storage);
+            if (weight != 0.0) {
+               layer.accumulate(*sum, weight);
+            }
+         }
+      }
+   }
+}
+
+void TerrainGenerator::applySettings(const TerrainSettings& settings) {
+   if (settings.graph != graph) {
+      graph = settings.graph;
+      if (graph && seeded) {
+         graph->setGradients(gradients, seed);
+      }
+   }
+   if (!seeded || settings.seed != seed) {
+      reseed(settings.seed);
+   }
+   setLayerStorage(settings.layerStorage);
+   if (graph) {
+      // The flatten factor applies to every normalize node. Only those nodes and their dependents are recomputed.
+      for (unsigned i = 0; i < graph->numNodes(); ++i) {
+         GraphNode node = graph->getNode(i);
+         if (node.type == GraphNodeType::NORMALIZE && node.flatten != settings.flattenFactor) {
+            node.flatten = settings.flattenFactor;
+            graph->updateNode(i, node);
+         }
+      }
+   }
+}
+
+double TerrainGenerator::normalizingFactor(const TerrainSettings& settings) {
+   double factor = 0.0;
+   for (const auto& param : settings.noiseParams) {
+      factor += param.second;
+   }
+   return factor * settings.flattenFactor;
+}
+
+/// @brief Warp of layer index, layers without an entry are not warped
+static perlin::WarpParams warpOf(const std::vector<perlin::WarpParams>& warps, const std::size_t index) {
+   return index < warps.size() ? warps[index] : perlin::WarpParams{};
+}
+
+void TerrainGenerator::regionHeights(const TerrainSettings& settings, const std::vector<perlin::vec2d>& gradients, const unsigned x0,
+                                     const unsigned y0, const unsigned x1, const unsigned y1, float* out) {
+   if (settings.graph || settings.postProcessParams.anyEnabled()) {
+      throw std::invalid_argument("Regions of a terrain can only be computed from its layers, without graph and post-processing.");
+   }
+   if (x0 >= x1 || y0 >= y1) return;
+   const std::size_t width = x1 - x0;
+   // Weighted sums of the stacks, in the same order as the layers are accumulated
+   std::vector<double> noiseSum(width * (y1 - y0), 0.0), baselineSum(width * (y1 - y0), 0.0);
+   auto addStack = [&](std::vector<double>& sum, const std::vector<layerP>& params, const std::vector<perlin::WarpParams>& warps) {
+      for (std::size_t i = 0; i < params.size(); ++i) {
+         const double weight = params[i].second;
+         perlin::PerlinLayer::fillRegion(gradients, params[i].first, warpOf(warps, i), x0, y0, x1, y1, [&](const unsigned x, const unsigned y, const double value) {
+            sum[(y - y0) * width + x - x0] += weight * value;
+         });
+      }
+   };
+   addStack(noiseSum, settings.noiseParams, settings.noiseWarps);
+   addStack(baselineSum, settings.baselineParams, settings.baselineWarps);
+   const double normalizing = normalizingFactor(settings);
+   for (std::size_t k = 0; k < noiseSum.size(); ++k) {
+      out[k] = std::max(baselineSum[k], noiseSum[k]) / normalizing;
+   }
+}
+
+nlohmann::json TerrainGenerator::addToSnapshot(SnapshotWriter& writer) const {
+   nlohmann::json state;
+   state["seed"] = seed;
+   state["quantizedLayers"] = layerStorage == perlin::LayerStorage::QUANTIZED16;
+   writer.add(SnapshotSection::GRADIENTS, 0, gradients.data(), gradients.size() * sizeof(perlin::vec2d));
+   auto addStack = [&](const std::vector<perlin::PerlinLayer>& layers, const perlin::matrix& sum, const SnapshotSection layerSection,
+                       const SnapshotSection codesSection, const SnapshotSection sumSection, const char* key) {
+      nlohmann::json& saved = state[key] = nlohmann::json::array();
+      const bool complete = sum.size() == sizeX && !sum.back().empty() && std::all_of(layers.begin(), layers.end(), [](const perlin::PerlinLayer& layer) {
+         return layer.isFilled();
+      });
+      if (!complete) return;
+      for (std::size_t i = 0; i < layers.size(); ++i) {
+         const perlin::PerlinLayer& layer = layers[i];
+         saved.push_back({{"chunkSize", layer.getChunkSize()},
+                          {"weight", layer.getWeight()},
+                          {"warpChunkSize", layer.getWarp().chunkSize},
+                          {"warpAmplitude", layer.getWarp().amplitude}});
+         if (layer.isQuantized()) {
+            // The codes as they are, so the restored layer has exactly the values its cache key stands for
+            const perlin::QuantizedMatrix& quantized = layer.getQuantized();
+            saved.back()["offset"] = quantized.offset;
+            saved.back()["scale"] = quantized.scale;
+            writer.addCodes(codesSection, i, quantized.codes);
+         } else {
+            writer.addMatrix(layerSection, i, layer.getResult());
+         }
+      }
+      writer.addMatrix(sumSection, 0, sum);
+   };
+   addStack(noiseLayers, noise, SnapshotSection::NOISE_LAYER, SnapshotSection::NOISE_LAYER_CODES, SnapshotSection::NOISE_SUM, "noiseLayers");
+   addStack(baselineLayers, baseline, SnapshotSection::BASELINE_LAYER, SnapshotSection::BASELINE_LAYER_CODES, SnapshotSection::BASELINE_SUM,
+            "baselineLayers");
+   return state;
+}
+
+void TerrainGenerator::restore(const Snapshot& snapshot, const nlohmann::json& state) {
+   const FilePart saved = snapshot.find(SnapshotSection::GRADIENTS);
+   if (!saved.data || saved.size == 0 || saved.size % sizeof(perlin::vec2d) != 0) {
+      throw std::runtime_error("Invalid snapshot: the gradients are missing.");
+   }
+   std::vector<perlin::vec2d> restoredGradients(saved.size / sizeof(perlin::vec2d));
+   std::memcpy(restoredGradients.data(), saved.data, saved.size);
+
+   perlin::LayerStorage restoredStorage = perlin::LayerStorage::DOUBLE;
+   auto readStack = [&](std::vector<perlin::PerlinLayer>& layers, perlin::matrix& sum, const SnapshotSection layerSection,
+                        const SnapshotSection codesSection, const SnapshotSection sumSection, const nlohmann::json& saved) {
+      layers.clear();
+      sum.clear();
+      if (saved.empty()) return; // computed from scratch by the next build
+      for (std::size_t i = 0; i < saved.size(); ++i) {
+         const nlohmann::json& layer = saved.at(i);
+         const perlin::WarpParams warp{layer.at("warpChunkSize").get<unsigned>(), layer.at("warpAmplitude").get<double>()};
+         layers.emplace_back(sizeX, sizeY, layer.at("chunkSize").get<unsigned>(), layer.at("weight").get<double>(), warp, restoredStorage);
+         if (layer.contains("scale")) {
+            perlin::LayerValues values;
+            values.quantized = {snapshot.readCodes(codesSection, i, sizeX, sizeY), layer.at("offset").get<double>(), layer.at("scale").get<double>()};
+            layers.back().assign(std::move(values));
+         } else {
+            layers.back().assign(snapshot.readMatrix(layerSection, i, sizeX, sizeY));
+         }
+      }
+      sum = snapshot.readMatrix(sumSection, 0, sizeX, sizeY);
+   };
+   std::vector<perlin::PerlinLayer> restoredNoise, restoredBaseline;
+   perlin::matrix restoredNoiseSum, restoredBaselineSum;
+   try {
+      restoredStorage = state.value("quantizedLayers", false) ? perlin::LayerStorage::QUANTIZED16 : perlin::LayerStorage::DOUBLE;
+      readStack(restoredNoise, restoredNoiseSum, SnapshotSection::NOISE_LAYER, SnapshotSection::NOISE_LAYER_CODES, SnapshotSection::NOISE_SUM,
+                state.at("noiseLayers"));
+      readStack(restoredBaseline, restoredBaselineSum, SnapshotSection::BASELINE_LAYER, SnapshotSection::BASELINE_LAYER_CODES,
+                SnapshotSection::BASELINE_SUM, state.at("baselineLayers"));
+      seed = state.at("seed").get<int>();
+   } catch (const nlohmann::json::exception& e) {
+      throw std::runtime_error(std::string("Invalid snapshot: ") + e.what());
+   } catch (const std::invalid_argument& e) { // e.g. a layer with chunk size 0
+      throw std::runtime_error(std::string("Invalid snapshot: ") + e.what());
+   }
+
+   // Nothing is changed before everything was read
+   seeded = true;
+   gradients = std::move(restoredGradients);
+   noiseLayers = std::move(restoredNoise);
+   baselineLayers = std::move(restoredBaseline);
+   noise = std::move(restoredNoiseSum);
+   baseline = std::move(restoredBaselineSum);
+   layerStorage = restoredStorage;
+   graph.reset(); // the graph of the next build gets the restored gradients
+   stepping.reset();
+   layerCache.clear(); // the restored gradients may come from another build of the program
+}
+
+void TerrainGenerator::prepareStack(std::vector<perlin::PerlinLayer>& layers, perlin::matrix& sum, const std::vector<layerP>& params,
+                                    const std::vector<perlin::WarpParams>& warps) {
+   if (layers.size() == params.size()) return;
+   // New layers start out of the sum (weight 0), they are filled by fillProgressive or updateStack.
+   // The sum is allocated by updateStack, so a preview does not wait for it.
+   // Layers found in the cache are filled but still out of the sum as well, updateStack adds them with their weight.
+   sum.clear();
+   for (perlin::PerlinLayer& layer : layers) {
+      retire(layer);
+   }
+   layers.clear();
+   for (std::size_t i = 0; i < params.size(); ++i) {
+      layers.emplace_back(sizeX, sizeY, params[i].first, 0.0, warpOf(warps, i), layerStorage);
+      reuse(layers.back());
+   }
+}
+
+perlin::LayerKey TerrainGenerator::keyOf(const perlin::PerlinLayer& layer) const {
+   return {seed, sizeX, sizeY, layer.getChunkSize(), layer.getWarp(), layer.getStorage()};
+}
+
+void TerrainGenerator::retire(perlin::PerlinLayer& layer) {
+   if (layer.isFilled()) {
+      layerCache.put(keyOf(layer), layer.release());
+   }
+}
+
+bool TerrainGenerator::reuse(perlin::PerlinLayer& layer) {
+   std::optional<perlin::LayerValues> values = layerCache.take(keyOf(layer));
+   if (!values) return false;
+   layer.assign(std::move(*values));
+   return true;
+}
+
+bool TerrainGenerator::allocateSum(perlin::matrix& sum, const unsigned maxRows) const {
+   sum.resize(sizeX);
+   unsigned allocated = 0;
+   for (auto& row : sum) {
+      if (!row.empty()) continue;
+      if (allocated++ == maxRows) return false;
+      row.assign(sizeY, 0.0);
+   }
+   return true;
+}
+
+void TerrainGenerator::fillProgressive(const TerrainSettings& settings, const perlin::CancelToken& cancel, const PreviewCallback& preview) {
+   const double normalizing = normalizingFactor(settings);
+
+   for (unsigned stride = coarsestPreviewStride; stride >= 1; stride /= 2) {
+      for (auto* layers : {&noiseLayers, &baselineLayers}) {
+         for (perlin::PerlinLayer& layer : *layers) {
+            layer.fillLattice(gradients, stride, stride == coarsestPreviewStride, cancel);
+         }
+      }
+      const unsigned numX = (sizeX - 1) / stride;
+      const unsigned numY = (sizeY - 1) / stride;
+      if (stride == 1 || numX == 0 || numY == 0) continue; // the full mesh is built from the sums, as after any other update
+
+      // Heights of every stride-th point, the same combination as in generate. If the size is not a multiple of
+      // the stride, the last points are left out and the preview is stretched by less than a stride.
+      std::vector<float> heights(std::size_t(numX + 1) * (numY + 1));
+      perlin::parallelFor(0, numY + 1, 16, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t j = begin; j < end; ++j) {
+            for (unsigned i = 0; i <= numX; ++i) {
+               const unsigned x = i * stride;
+               const unsigned y = j * stride;
+               double noiseValue = 0.0, baselineValue = 0.0;
+               for (std::size_t k = 0; k < noiseLayers.size(); ++k) {
+                  noiseValue += settings.noiseParams[k].second * noiseLayers[k].value(x, y);
+               }
+               for (std::size_t k = 0; k < baselineLayers.size(); ++k) {
+                  baselineValue += settings.baselineParams[k].second * baselineLayers[k].value(x, y);
+               }
+               heights[j * (numX + 1) + i] = std::max(baselineValue, noiseValue) / normalizing;
+            }
+         }
+      });
+      cancel.check();
+      preview(buildGridMeshData(heights, numX, numY), stride);
+   }
+}
+
+void TerrainGenerator::updateStack(std::vector<perlin::PerlinLayer>& layers, perlin::matrix& sum, const std::vector<layerP>& params,
+                                   const std::vector<perlin::WarpParams>& warps, const perlin::CancelToken& cancel) {
+   prepareStack(layers, sum, params, warps);
+   allocateSum(sum);
+   for (std::size_t i = 0; i < params.size(); ++i) {
+      perlin::PerlinLayer& layer = layers[i];
+      const auto [chunkSize, weight] = params[i];
+      if (!layer.isFilled() || layer.getChunkSize() != chunkSize || !(layer.getWarp() == warpOf(warps, i))) {
+         // Take the old layer out of the sum, recompute it and add it back with the new weight.
+         // If the fill is cancelled the layer stays out of the sum with weight 0 and unfilled.
+         if (layer.getWeight() != 0.0) {
+            layer.accumulate(sum, -layer.getWeight());
+            layer.changeWeight(0.0);
+         }
+         retire(layer);
+         layer.setWarp(warpOf(warps, i));
+         layer.setChunkSize(chunkSize);
+         if (!reuse(layer)) {
+            layer.fill(gradients, cancel);
+         }
+         layer.changeWeight(weight);
+         layer.accumulate(sum, weight);
+      } else if (layer.getWeight() != weight) {
+         layer.accumulate(sum, weight - layer.getWeight());
+         layer.changeWeight(weight);
+      }
+   }
+}
+
+/// @brief Side of the square tiles in which gridHeights transposes the heights
+static constexpr std::size_t heightTile = 32;
+
+inline void setHeight(float& out, const float height) {
+   out = height;
+}
+
+inline void setHeight(TerrainVertex& out, const float height) {
+   out.height = height;
+}
+
+/**
+ * Evaluate the tile rows [begin, end) of a heightfield expression (indexed [x][y]) into the vertex order of the mesh
+ * (vertex (i, j) at j * sizeX + i), as plain heights or into the vertices themselves. Tile row t covers the vertex rows
+ * t * heightTile up to (t + 1) * heightTile, result must hold them.
+ * This is a transpose, so it is done in square tiles: every tile reads its matrix rows contiguously and writes
+ * rows of vertices that stay in cache.
+ */
+template <typename E, typename T>
+static void gridHeightTiles(const E& heights, std::vector<T>& result, const std::size_t begin, const std::size_t end) {
+   const std::size_t sizeX = heights.rows();
+   const std::size_t sizeY = heights.cols();
+   for (std::size_t j0 = begin * heightTile; j0 < std::min(end * heightTile, sizeY); j0 += heightTile) {
+      const std::size_t j1 = std::min(j0 + heightTile, sizeY);
+      for (std::size_t i0 = 0; i0 < sizeX; i0 += heightTile) {
+         const std::size_t i1 = std::min(i0 + heightTile, sizeX);
+         for (std::size_t i = i0; i < i1; ++i) {
+            const auto heightRow = heights.row(i);
+            T* out = result.data() + i;
+            for (std::size_t j = j0; j < j1; ++j) {
+               setHeight(out[j * sizeX], heightRow[j]);
+            }
+         }
+      }
+   }
+}
+
+/// @brief All heights of an expression in vertex order, bands of tile rows are processed in parallel
+template <typename E>
+static std::vector<float> gridHeights(const E& heights) {
+   std::vector<float> result(heights.rows() * heights.cols());
+   const std::size_t tileRows = (heights.cols() + heightTile - 1) / heightTile;
+   perlin::parallelFor(0, tileRows, 1, [&](std::size_t begin, std::size_t end) {
+      gridHeightTiles(heights, result, begin, end);
+   });
+   return result;
+}
+
+GridMeshData TerrainGenerator::generate(const TerrainSettings& settings, const perlin::CancelToken& cancel, const PreviewCallback& preview) {
+   applySettings(settings);
+   if (graph) {
+      cancel.check();
+      perlin::matrix heights;
+      const GridRegion& view = settings.view;
+      if (preview && !view.empty() && graphHeights.size() == sizeX && !graph->needsWholeMap(graph->getOutput())) {
+         // The tiles in view first, drawn on the last heights. The evaluation of the whole terrain takes them from the cache.
+         heights = std::move(graphHeights);
+         graph->evaluateRegion(heights, view.x0, view.y0, std::min(view.x1, sizeX), std::min(view.y1, sizeY), cancel);
+         preview(buildMesh(perlin::hf::field(heights)), 1);
+      } else {
+         heights.assign(sizeX, std::vector<double>(sizeY, 0.0));
+      }
+      graph->evaluateRegion(heights, 0, 0, sizeX, sizeY, cancel);
+      // Kept before the post-processing, which the previews skip
+      graphHeights = preview ? heights : perlin::matrix();
+      postProcess(heights, settings.postProcessParams, cancel);
+      return buildMesh(perlin::hf::field(heights));
+   }
+   graphHeights = perlin::matrix();
+
+   prepareStack(noiseLayers, noise, settings.noiseParams, settings.noiseWarps);
+   prepareStack(baselineLayers, baseline, settings.baselineParams, settings.baselineWarps);
+   auto filled = [](const perlin::PerlinLayer& layer) {
+      return layer.isFilled();
+   };
+   if (preview && std::none_of(noiseLayers.begin(), noiseLayers.end(), filled) && std::none_of(baselineLayers.begin(), baselineLayers.end(), filled)) {
+      fillProgressive(settings, cancel, preview);
+   }
+   updateStack(noiseLayers, noise, settings.noiseParams, settings.noiseWarps, cancel);
+   updateStack(baselineLayers, baseline, settings.baselineParams, settings.baselineWarps, cancel);
+   cancel.check();
+
+   // max(baseline, noise) / normalizingFactor, evaluated lazily one matrix row at a time
+   const auto heightExpr = perlin::hf::max(perlin::hf::field(baseline), perlin::hf::field(noise)) / normalizingFactor(settings);
+   if (settings.postProcessParams.anyEnabled()) {
+      // Erosion and smoothing need the whole heightfield, so it is materialized once
+      perlin::matrix heights = perlin::hf::evaluate(heightExpr);
+      postProcess(heights, settings.postProcessParams, cancel);
+      return buildMesh(perlin::hf::field(heights));
+   }
+   return buildMesh(heightExpr);
+}
+
+void TerrainGenerator::begin(const TerrainSettings& settings) {
+   applySettings(settings);
+   stepping.emplace();
+   stepping->settings = settings;
+}
+
+bool TerrainGenerator::stepLayers(StepState& state) {
+   const TerrainSettings& settings = state.settings;
+   prepareStack(noiseLayers, noise, settings.noiseParams, settings.noiseWarps);
+   prepareStack(baselineLayers, baseline, settings.baselineParams, settings.baselineWarps);
+   // Sums of new stacks first, a band of rows per unit
+   for (perlin::matrix* sum : {&noise, &baseline}) {
+      if (sum->size() != sizeX || sum->back().empty()) {
+         allocateSum(*sum, sumRowsPerStep);
+         return true;
+      }
+   }
+
+   const std::size_t numNoise = settings.noiseParams.size();
+   if (state.layer >= numNoise + settings.baselineParams.size()) return false;
+   const bool inNoise = state.layer < numNoise;
+   const std::size_t i = inNoise ? state.layer : state.layer - numNoise;
+   perlin::PerlinLayer& layer = inNoise ? noiseLayers[i] : baselineLayers[i];
+   perlin::matrix& sum = inNoise ? noise : baseline;
+   const auto [chunkSize, weight] = inNoise ? settings.noiseParams[i] : settings.baselineParams[i];
+   const perlin::WarpParams warp = warpOf(inNoise ? settings.noiseWarps : settings.baselineWarps, i);
+
+   if (state.row == 0 && layer.isFilled() && layer.getChunkSize() == chunkSize && layer.getWarp() == warp) {
+      if (layer.getWeight() != weight) {
+         layer.accumulate(sum, weight - layer.getWeight());
+         layer.changeWeight(weight);
+      }
+      ++state.layer;
+      return true;
+   }
+   if (state.row == 0) {
+      // As in updateStack, the layer stays out of the sum until it is filled again
+      if (layer.getWeight() != 0.0) {
+         layer.accumulate(sum, -layer.getWeight());
+         layer.changeWeight(0.0);
+      }
+      retire(layer);
+      layer.setWarp(warp);
+      layer.setChunkSize(chunkSize);
+      if (reuse(layer)) {
+         layer.changeWeight(weight);
+         layer.accumulate(sum, weight);
+         ++state.layer;
+         return true;
+      }
+   }
+   layer.fillRows(gradients, state.row, state.row + 1);
+   if (++state.row == sizeX) {
+      layer.changeWeight(weight);
+      layer.accumulate(sum, weight);
+      state.row = 0;
+      ++state.layer;
+   }
+   return true;
+}
+
+std::optional<GridMeshData> TerrainGenerator::step(const Clock::time_point deadline) {
+   if (!stepping) return std::nullopt;
+   StepState& state = *stepping;
+   const TerrainSettings& settings = state.settings;
+   do {
+      switch (state.stage) {
+         case Stage::LAYERS:
+            if (graph || !stepLayers(state)) {
+               state.stage = Stage::COMBINE;
+            }
+            break;
+         case Stage::COMBINE:
+            if (graph) {
+               state.heights = graph->evaluate();
+            } else if (settings.postProcessParams.anyEnabled()) {
+               state.heights = perlin::hf::evaluate(perlin::hf::max(perlin::hf::field(baseline), perlin::hf::field(noise)) / normalizingFactor(settings));
+            }
+            if (!state.heights.empty()) {
+               postProcess(state.heights, settings.postProcessParams, {});
+            }
+            // Reserved only, the vertices grow by a tile row per unit so their pages are not all touched at once
+            state.mesh.sizeX = sizeX;
+            state.mesh.sizeY = sizeY;
+            state.mesh.vertices.reserve(std::size_t(sizeX) * sizeY);
+            state.stage = Stage::HEIGHTS;
+            break;
+         case Stage::HEIGHTS: {
+            const std::size_t endRow = std::min<std::size_t>((state.row + 1) * heightTile, sizeY);
+            state.mesh.vertices.resize(endRow * sizeX);
+            if (state.heights.empty()) {
+               gridHeightTiles(perlin::hf::max(perlin::hf::field(baseline), perlin::hf::field(noise)) / normalizingFactor(settings), state.mesh.vertices, state.row, state.row + 1);
+            } else {
+               gridHeightTiles(perlin::hf::field(state.heights), state.mesh.vertices, state.row, state.row + 1);
+            }
+            ++state.row;
+            if (endRow == sizeY) {
+               state.heights = {};
+               state.row = 0;
+               state.stage = Stage::NORMALS;
+            }
+            break;
+         }
+         case Stage::NORMALS: {
+            const unsigned end = std::min<unsigned long>(state.row + gridNormalBandRows(sizeX), sizeY);
+            computeGridNormalRows(state.mesh.vertices, sizeX, sizeY, state.row, end);
+            state.row = end;
+            if (end == sizeY) {
+               state.mesh.pyramid.build(state.mesh.vertices, sizeX, sizeY);
+               GridMeshData mesh = std::move(state.mesh);
+               stepping.reset();
+               return mesh;
+            }
+            break;
+         }
+      }
+   } while (Clock::now() < deadline);
+   return std::nullopt;
+}
+
+/// @brief Time a post-processing stage and report its throughput
+template <typename Stage>
+static void timedStage(const char* name, const char* unit, Stage&& stage) {
+   auto start = std::chrono::high_resolution_clock::now();
+   const double items = stage();
+   auto end = std::chrono::high_resolution_clock::now();
+   std::chrono::duration<double> seconds = end - start;
+   std::cout << name << ": " << items << " " << unit << " in " << seconds.count() << "s (" << items / seconds.count() << " " << unit << "/s)\n";
+}
+
+void TerrainGenerator::postProcess(perlin::matrix& heights, const PostProcessParams& params, const perlin::CancelToken& cancel) {
+   if (params.hydraulic.enabled) {
+      cancel.check();
+      timedStage("Hydraulic erosion", "droplets", [&] { return double(perlin::hydraulicErosion(heights, params.hydraulic)); });
+   }
+   if (params.thermal.enabled) {
+      cancel.check();
+      timedStage("Thermal erosion", "iterations", [&] { return double(perlin::thermalErosion(heights, params.thermal)); });
+   }
+   if (params.smoothing.enabled) {
+      cancel.check();
+      timedStage("Smoothing", "iterations", [&] { return double(perlin::smooth(heights, params.smoothing)); });
+   }
+   cancel.check();
+}
+
+template <typename E>
+GridMeshData TerrainGenerator::buildMesh(const perlin::hf::Expr<E>& heightExpr) {
+   const E& heights = heightExpr.self();
+   return buildGridMeshData(gridHeights(heights), heights.rows() - 1, heights.cols() - 1);
+}
@@ -0,0 +1,600 @@
+#include "TerrainGraph.hpp"
+#include "Parallel.hpp"
+#include "TerrainGenerator.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+/// @brief FNV-1a style mixing of a 64 bit value into a running hash
+std::uint64_t mix(std::uint64_t hash, std::uint64_t value) {
+   for (int byte = 0; byte < 8; ++byte) {
+      hash ^= (value >> (8 * byte)) & 0xFF;
+      hash *= 0x100000001B3ull;
+   }
+   return hash;
+}
+
+std::uint64_t mix(std::uint64_t hash, double value) {
+   std::uint64_t bits;
+   std::memcpy(&bits, &value, sizeof(bits));
+   return mix(hash, bits);
+}
+
+const char* typeName(const GraphNodeType type) {
+   switch (type) {
+      case GraphNodeType::NOISE: return "noise";
+      case GraphNodeType::COMBINE: return "combine";
+      case GraphNodeType::MAX: return "max";
+      case GraphNodeType::NORMALIZE: return "normalize";
+      case GraphNodeType::HYDRAULIC_EROSION: return "hydraulicErosion";
+      case GraphNodeType::THERMAL_EROSION: return "thermalErosion";
+      case GraphNodeType::SMOOTH: return "smooth";
+   }
+   return "";
+}
+
+GraphNodeType typeFromName(const std::string& name) {
+   if (name == "noise") return GraphNodeType::NOISE;
+   if (name == "combine") return GraphNodeType::COMBINE;
+   if (name == "max") return GraphNodeType::MAX;
+   if (name == "normalize") return GraphNodeType::NORMALIZE;
+   if (name == "hydraulicErosion") return GraphNodeType::HYDRAULIC_EROSION;
+   if (name == "thermalErosion") return GraphNodeType::THERMAL_EROSION;
+   if (name == "smooth") return GraphNodeType::SMOOTH;
+   throw std::invalid_argument("Unknown graph node type: " + name);
+}
+
+/// @brief Whether the node needs the whole heightfield of its input
+bool isFilter(const GraphNodeType type) {
+   return type == GraphNodeType::HYDRAULIC_EROSION || type == GraphNodeType::THERMAL_EROSION || type == GraphNodeType::SMOOTH;
+}
+
+} // namespace
+
+TerrainGraph::TerrainGraph(const unsigned sizeX, const unsigned sizeY, const unsigned tileSize, const std::size_t maxCachedTiles)
+   : sizeX(sizeX), sizeY(sizeY), tileSize(tileSize), maxCachedTiles(maxCachedTiles) {
+   if (tileSize == 0) {
+      throw std::invalid_argument("The tile size must be positive.");
+   }
+}
+
+TerrainGraph::TerrainGraph(TerrainGraph&& other) noexcept
+   : sizeX(other.sizeX), sizeY(other.sizeY), tileSize(other.tileSize), maxCachedTiles(other.maxCachedTiles),
+     seed(other.seed), gradients(std::move(other.gradients)), nodes(std::move(other.nodes)), hashes(std::move(other.hashes)),
+     output(other.output), cache(std::move(other.cache)), lru(std::move(other.lru)), wholeMaps(std::move(other.wholeMaps)) {}
+
+TerrainGraph& TerrainGraph::operator=(TerrainGraph&& other) noexcept {
+   if (this != &other) {
+      sizeX = other.sizeX;
+      sizeY = other.sizeY;
+      tileSize = other.tileSize;
+      maxCachedTiles = other.maxCachedTiles;
+      seed = other.seed;
+      gradients = std::move(other.gradients);
+      nodes = std::move(other.nodes);
+      hashes = std::move(other.hashes);
+      output = other.output;
+      cache = std::move(other.cache);
+      lru = std::move(other.lru);
+      wholeMaps = std::move(other.wholeMaps);
+   }
+   return *this;
+}
+
+TerrainGraph TerrainGraph::fromLayers(const unsigned sizeX, const unsigned sizeY, const std::vector<std::pair<unsigned, double>>& noiseParams,
+                                      const std::vector<std::pair<unsigned, double>>& baselineParams, const double flatten,
+                                      const std::vector<perlin::WarpParams>& noiseWarps, const std::vector<perlin::WarpParams>& baselineWarps) {
+   TerrainGraph graph(sizeX, sizeY);
+   auto addStack = [&graph](const std::vector<std::pair<unsigned, double>>& params, const std::vector<perlin::WarpParams>& warps) {
+      std::vector<unsigned> inputs;
+      std::vector<double> weights;
+      for (unsigned i = 0; i < params.size(); ++i) {
+         inputs.push_back(graph.addNoise(params[i].first, i < warps.size() ? warps[i] : perlin::WarpParams{}));
+         weights.push_back(params[i].second);
+      }
+      return graph.addCombine(inputs, weights);
+   };
+   const unsigned noise = addStack(noiseParams, noiseWarps);
+   const unsigned baseline = addStack(baselineParams, baselineWarps);
+   const unsigned combined = graph.addMax({noise, baseline});
+   graph.addNormalize(combined, flatten);
+   return graph;
+}
+
+// --- Building and editing ---
+
+void TerrainGraph::validate(const GraphNode& node, const unsigned index) const {
+   for (const unsigned input : node.inputs) {
+      if (input >= index) {
+         throw std::invalid_argument("Graph node inputs must refer to previously added nodes.");
+      }
+   }
+   switch (node.type) {
+      case GraphNodeType::NOISE:
+         if (node.chunkSize == 0 || !node.inputs.empty()) {
+            throw std::invalid_argument("Noise nodes need a positive chunk size and no inputs.");
+         }
+         break;
+      case GraphNodeType::COMBINE:
+         if (node.inputs.empty() || node.weights.size() != node.inputs.size()) {
+            throw std::invalid_argument("Combine nodes need one weight per input.");
+         }
+         break;
+      case GraphNodeType::MAX:
+         if (node.inputs.empty()) {
+            throw std::invalid_argument("Max nodes need at least one input.");
+         }
+         break;
+      case GraphNodeType::NORMALIZE:
+         if (node.inputs.size() != 1 || node.flatten == 0.0) {
+            throw std::invalid_argument("Normalize nodes need exactly one input and a non-zero flatten factor.");
+         }
+         break;
+      case GraphNodeType::HYDRAULIC_EROSION:
+      case GraphNodeType::THERMAL_EROSION:
+      case GraphNodeType::SMOOTH:
+         if (node.inputs.size() != 1) {
+            throw std::invalid_argument("Erosion and smoothing nodes need exactly one input.");
+         }
+         break;
+   }
+}
+
+unsigned TerrainGraph::addNode(const GraphNode& node) {
+   const unsigned index = nodes.size();
+   validate(node, index);
+   nodes.push_back(node);
+   output = index;
+   rehash();
+   return index;
+}
+
+unsigned TerrainGraph::addNoise(const unsigned chunkSize, const perlin::WarpParams& warp) {
+   GraphNode node;
+   node.type = GraphNodeType::NOISE;
+   node.chunkSize = chunkSize;
+   node.warp = warp;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addCombine(const std::vector<unsigned>& inputs, const std::vector<double>& weights) {
+   GraphNode node;
+   node.type = GraphNodeType::COMBINE;
+   node.inputs = inputs;
+   node.weights = weights;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addMax(const std::vector<unsigned>& inputs) {
+   GraphNode node;
+   node.type = GraphNodeType::MAX;
+   node.inputs = inputs;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addNormalize(const unsigned input, const double flatten) {
+   GraphNode node;
+   node.type = GraphNodeType::NORMALIZE;
+   node.inputs = {input};
+   node.flatten = flatten;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addHydraulicErosion(const unsigned input, const perlin::HydraulicErosionParams& params) {
+   GraphNode node;
+   node.type = GraphNodeType::HYDRAULIC_EROSION;
+   node.inputs = {input};
+   node.hydraulic = params;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addThermalErosion(const unsigned input, const perlin::ThermalErosionParams& params) {
+   GraphNode node;
+   node.type = GraphNodeType::THERMAL_EROSION;
+   node.inputs = {input};
+   node.thermal = params;
+   return addNode(node);
+}
+
+unsigned TerrainGraph::addSmooth(const unsigned input, const perlin::SmoothingParams& params) {
+   GraphNode node;
+   node.type = GraphNodeType::SMOOTH;
+   node.inputs = {input};
+   node.smoothing = params;
+   return addNode(node);
+}
+
+void TerrainGraph::updateNode(const unsigned index, const GraphNode& node) {
+   if (index >= nodes.size()) {
+      throw std::invalid_argument("Index out of bounds");
+   }
+   validate(node, index);
+   nodes[index] = node;
+   rehash(); // stale tiles of this node and its dependents are no longer reachable and age out of the LRU
+}
+
+void TerrainGraph::setOutput(const unsigned index) {
+   if (index >= nodes.size()) {
+      throw std::invalid_argument("Index out of bounds");
+   }
+   output = index;
+}
+
+void TerrainGraph::setGradients(const std::vector<perlin::vec2d>& newGradients, const int newSeed) {
+   gradients = newGradients;
+   seed = newSeed;
+   rehash();
+}
+
+void TerrainGraph::rehash() {
+   hashes.resize(nodes.size());
+   for (unsigned i = 0; i < nodes.size(); ++i) {
+      const GraphNode& node = nodes[i];
+      std::uint64_t hash = 0xCBF29CE484222325ull;
+      hash = mix(hash, static_cast<std::uint64_t>(node.type));
+      switch (node.type) {
+         case GraphNodeType::NOISE:
+            hash = mix(hash, static_cast<std::uint64_t>(node.chunkSize));
+            hash = mix(hash, static_cast<std::uint64_t>(static_cast<std::uint32_t>(seed)));
+            hash = mix(hash, static_cast<std::uint64_t>(gradients.size()));
+            if (node.warp.enabled()) {
+               hash = mix(hash, static_cast<std::uint64_t>(node.warp.chunkSize));
+               hash = mix(hash, node.warp.amplitude);
+            }
+            break;
+         case GraphNodeType::COMBINE:
+            for (const double weight : node.weights) {
+               hash = mix(hash, weight);
+            }
+            break;
+         case GraphNodeType::MAX:
+            break;
+         case GraphNodeType::NORMALIZE:
+            hash = mix(hash, node.flatten * referenceWeight(node.inputs[0]));
+            break;
+         case GraphNodeType::HYDRAULIC_EROSION: {
+            const perlin::HydraulicErosionParams& p = node.hydraulic;
+            for (const unsigned value : {p.droplets, p.seed, p.maxLifetime, p.radius}) {
+               hash = mix(hash, static_cast<std::uint64_t>(value));
+            }
+            for (const double value : {p.inertia, p.sedimentCapacity, p.minSedimentCapacity, p.erodeSpeed, p.depositSpeed, p.evaporateSpeed, p.gravity}) {
+               hash = mix(hash, value);
+            }
+            break;
+         }
+         case GraphNodeType::THERMAL_EROSION:
+            hash = mix(hash, static_cast<std::uint64_t>(node.thermal.iterations));
+            hash = mix(hash, node.thermal.talusSlope);
+            hash = mix(hash, node.thermal.rate);
+            break;
+         case GraphNodeType::SMOOTH:
+            hash = mix(hash, static_cast<std::uint64_t>(node.smoothing.filter));
+            hash = mix(hash, static_cast<std::uint64_t>(node.smoothing.iterations));
+            hash = mix(hash, node.smoothing.slopeLimit);
+            break;
+      }
+      for (const unsigned input : node.inputs) {
+         hash = mix(hash, hashes[input]);
+      }
+      hashes[i] = hash;
+   }
+
+   // Whole maps of edited nodes can never be asked for again
+   std::lock_guard<std::mutex> lock(cacheMutex);
+   for (auto it = wholeMaps.begin(); it != wholeMaps.end();) {
+      if (std::find(hashes.begin(), hashes.end(), it->first) == hashes.end()) {
+         it = wholeMaps.erase(it);
+      } else {
+         ++it;
+      }
+   }
+}
+
+double TerrainGraph::referenceWeight(const unsigned index) const {
+   // The weight a NORMALIZE node divides by. A MAX node takes the weight of its first input,
+   // which matches Terrain where the baseline only acts as a lower bound for the noise.
+   const GraphNode& node = nodes[index];
+   switch (node.type) {
+      case GraphNodeType::COMBINE: {
+         double sum = 0.0;
+         for (const double weight : node.weights) {
+            sum += weight;
+         }
+         return sum;
+      }
+      case GraphNodeType::MAX:
+      case GraphNodeType::HYDRAULIC_EROSION:
+      case GraphNodeType::THERMAL_EROSION:
+      case GraphNodeType::SMOOTH:
+         return referenceWeight(node.inputs[0]); // the filters keep the scale of their input
+      default:
+         return 1.0;
+   }
+}
+
+// --- Evaluation ---
+
+void TerrainGraph::computeTile(const unsigned index, GraphTile& tile) {
+   const GraphNode& node = nodes[index];
+   std::vector<double>& values = tile.values;
+   switch (node.type) {
+      case GraphNodeType::NOISE:
+         perlin::PerlinLayer::fillRegion(gradients, node.chunkSize, node.warp, tile.x0, tile.y0, tile.x0 + tile.width, tile.y0 + tile.height,
+                                         [&tile](unsigned x, unsigned y, double value) {
+                                            tile.values[(x - tile.x0) * tile.height + (y - tile.y0)] = value;
+                                         });
+         break;
+      case GraphNodeType::COMBINE:
+         // same accumulation order as PerlinLayer::accumulate into a zero matrix
+         for (unsigned k = 0; k < node.inputs.size(); ++k) {
+            const auto input = evaluateTile(node.inputs[k], tile.x0 / tileSize, tile.y0 / tileSize);
+            const double weight = node.weights[k];
+            for (std::size_t i = 0; i < values.size(); ++i) {
+               values[i] = values[i] + weight * input->values[i];
+            }
+         }
+         break;
+      case GraphNodeType::MAX: {
+         const auto first = evaluateTile(node.inputs[0], tile.x0 / tileSize, tile.y0 / tileSize);
+         values = first->values;
+         for (unsigned k = 1; k < node.inputs.size(); ++k) {
+            const auto input = evaluateTile(node.inputs[k], tile.x0 / tileSize, tile.y0 / tileSize);
+            for (std::size_t i = 0; i < values.size(); ++i) {
+               values[i] = std::max(input->values[i], values[i]);
+            }
+         }
+         break;
+      }
+      case GraphNodeType::NORMALIZE: {
+         const auto input = evaluateTile(node.inputs[0], tile.x0 / tileSize, tile.y0 / tileSize);
+         const double divisor = referenceWeight(node.inputs[0]) * node.flatten;
+         for (std::size_t i = 0; i < values.size(); ++i) {
+            values[i] = input->values[i] / divisor;
+         }
+         break;
+      }
+      case GraphNodeType::HYDRAULIC_EROSION:
+      case GraphNodeType::THERMAL_EROSION:
+      case GraphNodeType::SMOOTH: {
+         const auto map = wholeMap(index);
+         for (unsigned x = 0; x < tile.width; ++x) {
+            const auto& column = map->values[tile.x0 + x];
+            std::copy(column.begin() + tile.y0, column.begin() + tile.y0 + tile.height, values.begin() + std::size_t(x) * tile.height);
+         }
+         break;
+      }
+   }
+}
+
+std::shared_ptr<const TerrainGraph::WholeMap> TerrainGraph::wholeMap(const unsigned index) {
+   std::shared_ptr<WholeMap> map;
+   {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      auto& entry = wholeMaps[hashes[index]];
+      if (!entry) {
+         entry = std::make_shared<WholeMap>();
+      }
+      map = entry;
+   }
+   // Every tile of the node asks for the same map, the first one computes it while the others wait
+   std::call_once(map->computed, [&]() {
+      const GraphNode& node = nodes[index];
+      perlin::matrix heights(sizeX, std::vector<double>(sizeY, 0.0));
+      evaluateNodeRegion(node.inputs[0], heights, 0, 0, sizeX, sizeY, {}); // not cancellable, the map is shared by all builds
+      switch (node.type) {
+         case GraphNodeType::HYDRAULIC_EROSION:
+            perlin::hydraulicErosion(heights, node.hydraulic);
+            break;
+         case GraphNodeType::THERMAL_EROSION: {
+            perlin::ThermalErosionParams params = node.thermal;
+            params.enabled = true;
+            perlin::thermalErosion(heights, params);
+            break;
+         }
+         case GraphNodeType::SMOOTH: {
+            perlin::SmoothingParams params = node.smoothing;
+            params.enabled = true;
+            perlin::smooth(heights, params);
+            break;
+         }
+         default:
+            break;
+      }
+      map->values = std::move(heights);
+   });
+   return map;
+}
+
+std::shared_ptr<const GraphTile> TerrainGraph::evaluateTile(const unsigned index, const unsigned tileX, const unsigned tileY) {
+   if (index >= nodes.size()) {
+      throw std::invalid_argument("Index out of bounds");
+   }
+   const CacheKey key{hashes[index], tileX, tileY};
+   {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      auto it = cache.find(key);
+      if (it != cache.end()) {
+         lru.splice(lru.begin(), lru, it->second.lruPosition);
+         return it->second.tile;
+      }
+   }
+
+   // Compute outside the lock, so that independent tiles can be evaluated concurrently
+   auto tile = std::make_shared<GraphTile>();
+   tile->x0 = tileX * tileSize;
+   tile->y0 = tileY * tileSize;
+   tile->width = std::min(tileSize, sizeX - tile->x0);
+   tile->height = std::min(tileSize, sizeY - tile->y0);
+   tile->values.assign(std::size_t(tile->width) * tile->height, 0.0);
+   computeTile(index, *tile);
+
+   std::lock_guard<std::mutex> lock(cacheMutex);
+   auto it = cache.find(key);
+   if (it != cache.end()) { // computed concurrently by another thread
+      return it->second.tile;
+   }
+   lru.push_front(key);
+   cache.emplace(key, CacheEntry{tile, lru.begin()});
+   while (cache.size() > maxCachedTiles) {
+      cache.erase(lru.back());
+      lru.pop_back();
+   }
+   return tile;
+}
+
+void TerrainGraph::evaluateRegion(perlin::matrix& out, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1,
+                                  const perlin::CancelToken& cancel) {
+   if (nodes.empty()) {
+      throw std::logic_error("The terrain graph has no nodes.");
+   }
+   evaluateNodeRegion(output, out, x0, y0, x1, y1, cancel);
+}
+
+void TerrainGraph::evaluateNodeRegion(const unsigned index, perlin::matrix& out, const unsigned x0, const unsigned y0, const unsigned x1, const unsigned y1,
+                                      const perlin::CancelToken& cancel) {
+   if (out.size() != sizeX || out.empty() || out[0].size() != sizeY || x1 > sizeX || y1 > sizeY) {
+      throw std::runtime_error("Dimension mismatch between graph and output matrix.");
+   }
+   if (x0 >= x1 || y0 >= y1) return;
+
+   const unsigned firstTileX = x0 / tileSize;
+   const unsigned firstTileY = y0 / tileSize;
+   const unsigned tilesX = (x1 - 1) / tileSize + 1 - firstTileX;
+   const unsigned tilesY = (y1 - 1) / tileSize + 1 - firstTileY;
+
+   // Every output tile writes a disjoint part of `out`
+   perlin::parallelFor(0, std::size_t(tilesX) * tilesY, 1, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t t = begin; t < end && !cancel.isCancelled(); ++t) {
+         const unsigned tileX = firstTileX + t / tilesY;
+         const unsigned tileY = firstTileY + t % tilesY;
+         const auto tile = evaluateTile(index, tileX, tileY);
+         const unsigned beginX = std::max(x0, tile->x0);
+         const unsigned endX = std::min(x1, tile->x0 + tile->width);
+         const unsigned beginY = std::max(y0, tile->y0);
+         const unsigned endY = std::min(y1, tile->y0 + tile->height);
+         for (unsigned x = beginX; x < endX; ++x) {
+            const double* src = &tile->values[(x - tile->x0) * tile->height + (beginY - tile->y0)];
+            std::copy(src, src + (endY - beginY), out[x].begin() + beginY);
+         }
+      }
+   });
+   cancel.check();
+}
+
+perlin::matrix TerrainGraph::evaluate(const perlin::CancelToken& cancel) {
+   perlin::matrix result(sizeX, std::vector<double>(sizeY, 0.0));
+   evaluateRegion(result, 0, 0, sizeX, sizeY, cancel);
+   return result;
+}
+
+bool TerrainGraph::needsWholeMap(const unsigned index) const {
+   if (index >= nodes.size()) {
+      throw std::invalid_argument("Index out of bounds");
+   }
+   if (isFilter(nodes[index].type)) {
+      return true;
+   }
+   for (const unsigned input : nodes[index].inputs) {
+      if (needsWholeMap(input)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void TerrainGraph::clearCache() {
+   std::lock_guard<std::mutex> lock(cacheMutex);
+   cache.clear();
+   lru.clear();
+   wholeMaps.clear();
+}
+
+std::size_t TerrainGraph::cachedTiles() const {
+   std::lock_guard<std::mutex> lock(cacheMutex);
+   return cache.size();
+}
+
+// --- Serialization ---
+
+nlohmann::json TerrainGraph::toJson() const {
+   nlohmann::json j;
+   j["tileSize"] = tileSize;
+   j["output"] = output;
+   j["nodes"] = nlohmann::json::array();
+   for (const auto& node : nodes) {
+      nlohmann::json jn;
+      jn["type"] = typeName(node.type);
+      switch (node.type) {
+         case GraphNodeType::NOISE:
+            jn["chunkSize"] = node.chunkSize;
+            if (node.warp.enabled()) {
+               jn["warpChunkSize"] = node.warp.chunkSize;
+               jn["warpAmplitude"] = node.warp.amplitude;
+            }
+            break;
+         case GraphNodeType::COMBINE:
+            jn["inputs"] = node.inputs;
+            jn["weights"] = node.weights;
+            break;
+         case GraphNodeType::MAX:
+            jn["inputs"] = node.inputs;
+            break;
+         case GraphNodeType::NORMALIZE:
+            jn["inputs"] = node.inputs;
+            jn["flatten"] = node.flatten;
+            break;
+         case GraphNodeType::HYDRAULIC_EROSION:
+         case GraphNodeType::THERMAL_EROSION:
+         case GraphNodeType::SMOOTH: {
+            // same keys as the post-processing of the layer pipeline, only the node's own stage
+            jn["inputs"] = node.inputs;
+            nlohmann::json stages;
+            postProcessToJson(PostProcessParams{node.hydraulic, node.thermal, node.smoothing}, stages);
+            const char* key = node.type == GraphNodeType::HYDRAULIC_EROSION ? "erosion"
+                              : node.type == GraphNodeType::THERMAL_EROSION ? "thermalErosion"
+                                                                              : "smoothing";
+            jn[key] = stages[key];
+            jn[key].erase("enabled");
+            break;
+         }
+      }
+      j["nodes"].push_back(jn);
+   }
+   return j;
+}
+
+TerrainGraph TerrainGraph::fromJson(const nlohmann::json& j, const unsigned sizeX, const unsigned sizeY) {
+   if (!j.is_object() || !j.contains("nodes") || !j["nodes"].is_array()) {
+      throw std::invalid_argument("A terrain graph needs a list of nodes.");
+   }
+   // Missing keys and values of the wrong type are reported like any other invalid graph
+   try {
+      TerrainGraph graph(sizeX, sizeY, j.value("tileSize", 128u));
+      for (const auto& jn : j["nodes"]) {
+         GraphNode node;
+         node.type = typeFromName(jn.at("type").get<std::string>());
+         node.inputs = jn.value("inputs", std::vector<unsigned>{});
+         node.chunkSize = jn.value("chunkSize", 1u);
+         node.warp.chunkSize = jn.value("warpChunkSize", 0u);
+         node.warp.amplitude = jn.value("warpAmplitude", 0.0);
+         node.weights = jn.value("weights", std::vector<double>{});
+         node.flatten = jn.value("flatten", 1.0);
+         if (isFilter(node.type)) {
+            const PostProcessParams stages = postProcessFromJson(jn, PostProcessParams{});
+            node.hydraulic = stages.hydraulic;
+            node.thermal = stages.thermal;
+            node.smoothing = stages.smoothing;
+         }
+         graph.addNode(node);
+      }
+      if (graph.nodes.empty()) {
+         throw std::invalid_argument("A terrain graph needs at least one node.");
+      }
+      graph.setOutput(j.value("output", graph.output));
+      return graph;
+   } catch (const nlohmann::json::exception& e) {
+      throw std::invalid_argument(std::string("Invalid terrain graph: ") + e.what());
+   }
+}
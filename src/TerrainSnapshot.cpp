@@ -0,0 +1,346 @@
+#include "TerrainSnapshot.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char magic[8] = {'T', 'E', 'R', 'R', 'S', 'N', 'A', 'P'};
+
+/// @brief Start of a snapshot file, followed by sectionCount table entries
+struct FileHeader {
+   char magic[8];
+   std::uint32_t version;
+   std::uint32_t sectionCount;
+   std::uint64_t fileSize;
+   std::uint64_t tableChecksum; // of the section table
+};
+
+/// @brief Entry of the section table
+struct TableEntry {
+   std::uint32_t type, index;
+   std::uint64_t offset, size, checksum;
+};
+
+static_assert(sizeof(FileHeader) == 32 && sizeof(TableEntry) == 32, "The file layout must not depend on the compiler");
+
+std::uint64_t alignUp(const std::uint64_t offset) {
+   return (offset + snapshotAlignment - 1) / snapshotAlignment * snapshotAlignment;
+}
+
+const std::uint64_t prime1 = 0x9E3779B185EBCA87ull, prime2 = 0xC2B2AE3D27D4EB4Full, prime3 = 0x165667B19E3779F9ull;
+
+inline std::uint64_t rotl(const std::uint64_t value, const int bits) {
+   return (value << bits) | (value >> (64 - bits));
+}
+
+inline std::uint64_t mix(const std::uint64_t lane, const std::uint64_t word) {
+   return rotl(lane + word * prime2, 31) * prime1;
+}
+
+/**
+ * 64-bit checksum in the style of xxHash64 (not compatible with it): four independent lanes take 32 bytes per round,
+ * so it runs at the speed of memory. Data can be added in pieces of any size, the result only depends on the bytes.
+ */
+class Checksum {
+   public:
+   void add(const void* data, std::size_t size) {
+      const unsigned char* bytes = static_cast<const unsigned char*>(data);
+      length += size;
+      if (pending > 0) {
+         const std::size_t taken = std::min(size, sizeof(stripe) - pending);
+         std::memcpy(stripe + pending, bytes, taken);
+         pending += taken;
+         bytes += taken;
+         size -= taken;
+         if (pending < sizeof(stripe)) return;
+         round(stripe);
+         pending = 0;
+      }
+      for (; size >= sizeof(stripe); bytes += sizeof(stripe), size -= sizeof(stripe)) {
+         round(bytes);
+      }
+      std::memcpy(stripe, bytes, size);
+      pending = size;
+   }
+
+   std::uint64_t value() const {
+      std::uint64_t hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+      hash ^= length * prime1;
+      for (std::size_t i = 0; i < pending; ++i) {
+         hash = rotl(hash ^ (stripe[i] * prime3), 11) * prime1;
+      }
+      hash ^= hash >> 33;
+      hash *= prime2;
+      hash ^= hash >> 29;
+      hash *= prime3;
+      hash ^= hash >> 32;
+      return hash;
+   }
+
+   private:
+   std::uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+   unsigned char stripe[32];
+   std::size_t pending = 0;
+   std::uint64_t length = 0;
+
+   void round(const unsigned char* bytes) {
+      for (int i = 0; i < 4; ++i) {
+         std::uint64_t word;
+         std::memcpy(&word, bytes + 8 * i, sizeof(word));
+         lanes[i] = mix(lanes[i], word);
+      }
+   }
+};
+
+/// @brief Zero bytes padding the sections to the alignment
+const unsigned char padding[snapshotAlignment] = {};
+
+} // namespace
+
+// --- SnapshotWriter ---
+
+void SnapshotWriter::add(const SnapshotSection type, const std::uint32_t index, const void* data, const std::size_t size) {
+   sections.push_back({type, index, {{data, size}}});
+}
+
+void SnapshotWriter::addMatrix(const SnapshotSection type, const std::uint32_t index, const perlin::matrix& rows) {
+   Section section{type, index, {}};
+   for (const std::vector<double>& row : rows) {
+      if (row.size() != rows[0].size()) {
+         throw std::invalid_argument("The rows of a matrix section must have the same length.");
+      }
+      section.parts.push_back({row.data(), row.size() * sizeof(double)});
+   }
+   sections.push_back(std::move(section));
+}
+
+void SnapshotWriter::addMatrix(const SnapshotSection type, const std::uint32_t index, perlin::matrix&& rows) {
+   owned.push_back(std::move(rows));
+   addMatrix(type, index, owned.back());
+}
+
+void SnapshotWriter::addCodes(const SnapshotSection type, const std::uint32_t index, const std::vector<std::vector<std::uint16_t>>& rows) {
+   Section section{type, index, {}};
+   for (const std::vector<std::uint16_t>& row : rows) {
+      if (row.size() != rows[0].size()) {
+         throw std::invalid_argument("The rows of a matrix section must have the same length.");
+      }
+      section.parts.push_back({row.data(), row.size() * sizeof(std::uint16_t)});
+   }
+   sections.push_back(std::move(section));
+}
+
+bool SnapshotWriter::write(const std::string& filename, const nlohmann::json& parameters) {
+   if (!littleEndianHost()) {
+      throw std::runtime_error("Snapshots need a little endian host.");
+   }
+   const std::string text = parameters.dump();
+   std::vector<Section> all = {{SnapshotSection::PARAMETERS, 0, {{text.data(), text.size()}}}};
+   all.insert(all.end(), sections.begin(), sections.end());
+
+   // Layout and checksums, one section per thread
+   std::vector<TableEntry> table(all.size());
+   std::uint64_t offset = alignUp(sizeof(FileHeader) + table.size() * sizeof(TableEntry));
+   for (std::size_t i = 0; i < all.size(); ++i) {
+      table[i].type = static_cast<std::uint32_t>(all[i].type);
+      table[i].index = all[i].index;
+      table[i].offset = offset;
+      table[i].size = 0;
+      for (const FilePart& part : all[i].parts) {
+         table[i].size += part.size;
+      }
+      offset = alignUp(offset + table[i].size);
+   }
+   perlin::parallelFor(0, all.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         Checksum checksum;
+         for (const FilePart& part : all[i].parts) {
+            checksum.add(part.data, part.size);
+         }
+         table[i].checksum = checksum.value();
+      }
+   });
+   Checksum tableChecksum;
+   tableChecksum.add(table.data(), table.size() * sizeof(TableEntry));
+   FileHeader header;
+   std::memcpy(header.magic, magic, sizeof(magic));
+   header.version = snapshotVersion;
+   header.sectionCount = static_cast<std::uint32_t>(table.size());
+   header.fileSize = offset;
+   header.tableChecksum = tableChecksum.value();
+
+   std::vector<FilePart> parts = {{&header, sizeof(header)}, {table.data(), table.size() * sizeof(TableEntry)}};
+   std::uint64_t written = sizeof(header) + table.size() * sizeof(TableEntry);
+   for (std::size_t i = 0; i < all.size(); ++i) {
+      parts.push_back({padding, table[i].offset - written});
+      parts.insert(parts.end(), all[i].parts.begin(), all[i].parts.end());
+      written = table[i].offset + table[i].size;
+   }
+   parts.push_back({padding, offset - written});
+   return writeFileParts(filename, parts);
+}
+
+// --- Snapshot ---
+
+Snapshot::Snapshot(const std::string& filename) : filename(filename) {
+   if (!littleEndianHost()) {
+      throw std::runtime_error("Snapshots need a little endian host.");
+   }
+#if defined(__unix__) || defined(__APPLE__)
+   const int fd = ::open(filename.c_str(), O_RDONLY);
+   if (fd < 0) {
+      fail("cannot open the file");
+   }
+   struct stat status;
+   if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+      size = static_cast<std::size_t>(status.st_size);
+      void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (address != MAP_FAILED) {
+         data = static_cast<const unsigned char*>(address);
+         mapped = true;
+      }
+   }
+   ::close(fd);
+   if (!mapped) {
+      fail("cannot map the file");
+   }
+#else
+   std::ifstream file(filename, std::ios::binary | std::ios::ate);
+   if (!file.is_open()) {
+      fail("cannot open the file");
+   }
+   size = static_cast<std::size_t>(file.tellg());
+   buffer.resize((size + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t));
+   file.seekg(0);
+   file.read(reinterpret_cast<char*>(buffer.data()), size);
+   if (!file) {
+      fail("cannot read the file");
+   }
+   data = reinterpret_cast<const unsigned char*>(buffer.data());
+#endif
+
+   FileHeader header;
+   if (size < sizeof(header)) {
+      fail("not a terrain snapshot");
+   }
+   std::memcpy(&header, data, sizeof(header));
+   if (std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+      fail("not a terrain snapshot");
+   }
+   if (header.version != snapshotVersion) {
+      fail("version " + std::to_string(header.version) + ", expected " + std::to_string(snapshotVersion));
+   }
+   if (header.fileSize != size || (size - sizeof(header)) / sizeof(TableEntry) < header.sectionCount) {
+      fail("the file is truncated");
+   }
+   Checksum tableChecksum;
+   tableChecksum.add(data + sizeof(header), header.sectionCount * sizeof(TableEntry));
+   if (tableChecksum.value() != header.tableChecksum) {
+      fail("the section table is corrupt");
+   }
+   for (std::uint32_t i = 0; i < header.sectionCount; ++i) {
+      TableEntry entry;
+      std::memcpy(&entry, data + sizeof(header) + i * sizeof(TableEntry), sizeof(entry));
+      entries.push_back({entry.type, entry.index, entry.offset, entry.size, entry.checksum});
+   }
+   for (const Entry& entry : entries) {
+      if (entry.offset % snapshotAlignment != 0 || entry.offset > size || entry.size > size - entry.offset) {
+         fail("a section lies outside of the file");
+      }
+   }
+   std::vector<char> valid(entries.size());
+   perlin::parallelFor(0, entries.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         Checksum checksum;
+         checksum.add(data + entries[i].offset, entries[i].size);
+         valid[i] = checksum.value() == entries[i].checksum;
+      }
+   });
+   if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+      fail("checksum mismatch, the file is corrupt");
+   }
+
+   const FilePart text = find(SnapshotSection::PARAMETERS);
+   if (!text.data) {
+      fail("the parameters are missing");
+   }
+   try {
+      const char* begin = static_cast<const char*>(text.data);
+      parameters = nlohmann::json::parse(begin, begin + text.size);
+   } catch (const nlohmann::json::exception& e) {
+      fail(std::string("invalid parameters: ") + e.what());
+   }
+}
+
+Snapshot::~Snapshot() {
+#if defined(__unix__) || defined(__APPLE__)
+   if (mapped) {
+      ::munmap(const_cast<unsigned char*>(data), size);
+   }
+#endif
+}
+
+void Snapshot::fail(const std::string& what) const {
+#if defined(__unix__) || defined(__APPLE__)
+   // Called from the constructor, so the destructor will not unmap
+   if (mapped) {
+      ::munmap(const_cast<unsigned char*>(data), size);
+   }
+#endif
+   throw std::runtime_error("Failed to load snapshot " + filename + ": " + what);
+}
+
+FilePart Snapshot::find(const SnapshotSection type, const std::uint32_t index) const {
+   for (const Entry& entry : entries) {
+      if (entry.type == static_cast<std::uint32_t>(type) && entry.index == index) {
+         return {data + entry.offset, static_cast<std::size_t>(entry.size)};
+      }
+   }
+   return {nullptr, 0};
+}
+
+FilePart Snapshot::require(const SnapshotSection type, const std::uint32_t index, const std::size_t expectedSize) const {
+   const FilePart section = find(type, index);
+   if (!section.data || section.size != expectedSize) {
+      throw std::runtime_error("Invalid snapshot " + filename + ": section " + std::to_string(static_cast<std::uint32_t>(type)) + "/" +
+                               std::to_string(index) + (section.data ? " has the wrong size" : " is missing"));
+   }
+   return section;
+}
+
+perlin::matrix Snapshot::readMatrix(const SnapshotSection type, const std::uint32_t index, const unsigned sizeX, const unsigned sizeY) const {
+   const FilePart section = require(type, index, std::size_t(sizeX) * sizeY * sizeof(double));
+   // Sections are aligned, so the values can be read in place
+   const double* values = static_cast<const double*>(section.data);
+   perlin::matrix rows(sizeX);
+   perlin::parallelFor(0, sizeX, 16, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t x = begin; x < end; ++x) {
+         rows[x].assign(values + x * sizeY, values + (x + 1) * sizeY);
+      }
+   });
+   return rows;
+}
+
+std::vector<std::vector<std::uint16_t>> Snapshot::readCodes(const SnapshotSection type, const std::uint32_t index, const unsigned sizeX,
+                                                            const unsigned sizeY) const {
+   const FilePart section = require(type, index, std::size_t(sizeX) * sizeY * sizeof(std::uint16_t));
+   const std::uint16_t* codes = static_cast<const std::uint16_t*>(section.data);
+   std::vector<std::vector<std::uint16_t>> rows(sizeX);
+   perlin::parallelFor(0, sizeX, 16, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t x = begin; x < end; ++x) {
+         rows[x].assign(codes + x * sizeY, codes + (x + 1) * sizeY);
+      }
+   });
+   return rows;
+}
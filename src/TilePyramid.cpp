@@ -0,0 +1,282 @@
+#include "TilePyramid.hpp"
+#include "FileParts.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <json.hpp>
+#include <stdexcept>
+
+namespace {
+
+/// @brief Heights of a tile, tileSize x tileSize row by row, the pixels beyond width and height repeat the last valid ones
+struct Tile {
+   std::vector<float> heights;
+   unsigned width = 0, height = 0; // valid pixels, less than the tile size on the right and bottom edge of a level
+};
+
+/// @brief Size of one zoom level of the pyramid
+struct Level {
+   unsigned width, height; // in pixels
+   unsigned tilesX, tilesY;
+};
+
+const char* extensionOf(const TileFormat format) {
+   switch (format) {
+      case TileFormat::PNG16: return ".png";
+      case TileFormat::R16: return ".r16";
+      default: return ".f32";
+   }
+}
+
+const char* nameOf(const TileFormat format) {
+   switch (format) {
+      case TileFormat::PNG16: return "png16";
+      case TileFormat::R16: return "r16";
+      default: return "f32";
+   }
+}
+
+class PyramidWriter {
+   public:
+   PyramidWriter(const TerrainSettings& settings, const unsigned sizeX, const unsigned sizeY, const std::string& directory,
+                 const TileExportOptions& options)
+      : settings(settings), gradients(TerrainGenerator::gradientsFor(settings.seed)), directory(directory), options(options) {
+      // Lowest zoom whose tiles cover the map at full resolution
+      const unsigned size = std::max(sizeX, sizeY);
+      unsigned maxZoom = 0;
+      while (static_cast<unsigned long long>(options.tileSize) << maxZoom < size) {
+         ++maxZoom;
+      }
+      levels.resize(maxZoom + 1);
+      for (unsigned z = 0; z <= maxZoom; ++z) {
+         const unsigned long long scale = 1ull << (maxZoom - z);
+         Level& level = levels[z];
+         level.width = static_cast<unsigned>((sizeX + scale - 1) / scale);
+         level.height = static_cast<unsigned>((sizeY + scale - 1) / scale);
+         level.tilesX = (level.width + options.tileSize - 1) / options.tileSize;
+         level.tilesY = (level.height + options.tileSize - 1) / options.tileSize;
+      }
+   }
+
+   bool run() {
+      if (!createDirectories()) return false;
+
+      // Subtrees below the first level with enough tiles for all threads are built in parallel, the levels above from their roots
+      const unsigned maxZoom = static_cast<unsigned>(levels.size() - 1);
+      unsigned split = 0;
+      while (split < maxZoom && tileCount(split) < 2ull * perlin::workerCount()) {
+         ++split;
+      }
+      std::vector<Tile> tiles(tileCount(split));
+      const unsigned tilesX = levels[split].tilesX;
+      perlin::parallelFor(0, tiles.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t k = begin; k < end && !failed; ++k) {
+            tiles[k] = build(split, k % tilesX, k / tilesX);
+         }
+      });
+      for (unsigned z = split; z-- > 0 && !failed;) {
+         std::vector<Tile> parents(tileCount(z));
+         for (std::size_t k = 0; k < parents.size() && !failed; ++k) {
+            const unsigned x = k % levels[z].tilesX, y = k / levels[z].tilesX;
+            parents[k] = parent(z, x, y, [&](const unsigned childX, const unsigned childY) -> const Tile& {
+               return tiles[childY * levels[z + 1].tilesX + childX];
+            });
+         }
+         tiles = std::move(parents);
+      }
+      return !failed && writeManifest();
+   }
+
+   std::size_t written() const {
+      return tilesWritten;
+   }
+
+   private:
+   const TerrainSettings& settings;
+   const std::vector<perlin::vec2d> gradients;
+   const std::filesystem::path directory;
+   const TileExportOptions& options;
+   std::vector<Level> levels; // by zoom
+   std::atomic<bool> failed{false};
+   std::atomic<std::size_t> tilesWritten{0};
+
+   std::size_t tileCount(const unsigned z) const {
+      return std::size_t(levels[z].tilesX) * levels[z].tilesY;
+   }
+
+   /// @brief Tile (x, y) of zoom z with its whole subtree, every tile is written when it is complete
+   Tile build(const unsigned z, const unsigned x, const unsigned y) {
+      if (z + 1 == levels.size()) {
+         return leaf(x, y);
+      }
+      Tile children[2][2];
+      for (unsigned dy = 0; dy < 2; ++dy) {
+         for (unsigned dx = 0; dx < 2; ++dx) {
+            if (2 * x + dx < levels[z + 1].tilesX && 2 * y + dy < levels[z + 1].tilesY && !failed) {
+               children[dy][dx] = build(z + 1, 2 * x + dx, 2 * y + dy);
+            }
+         }
+      }
+      if (failed) return {};
+      return parent(z, x, y, [&](const unsigned childX, const unsigned childY) -> const Tile& {
+         return children[childY - 2 * y][childX - 2 * x];
+      });
+   }
+
+   /// @brief Leaf tile (x, y) at full resolution, computed from the noise functions
+   Tile leaf(const unsigned x, const unsigned y) {
+      const unsigned size = options.tileSize;
+      const Level& level = levels.back();
+      const unsigned x0 = x * size, y0 = y * size;
+      Tile tile;
+      tile.width = std::min(size, level.width - x0);
+      tile.height = std::min(size, level.height - y0);
+      tile.heights.resize(std::size_t(size) * size);
+      TerrainGenerator::regionHeights(settings, gradients, x0, y0, x0 + tile.width, y0 + tile.height, tile.heights.data());
+      // Rows of the region are tile.width apart, spread them to the tile size from the last one on
+      for (unsigned row = tile.height; row-- > 0;) {
+         std::copy_backward(tile.heights.begin() + std::size_t(row) * tile.width, tile.heights.begin() + std::size_t(row + 1) * tile.width,
+                            tile.heights.begin() + std::size_t(row) * size + tile.width);
+      }
+      finish(static_cast<unsigned>(levels.size() - 1), x, y, tile);
+      return tile;
+   }
+
+   /// @brief Tile (x, y) of zoom z, each pixel the average of the valid pixels of the 2x2 block below it in zoom z + 1
+   template <typename Child>
+   Tile parent(const unsigned z, const unsigned x, const unsigned y, Child&& child) {
+      const unsigned size = options.tileSize, half = size / 2;
+      const Level& level = levels[z];
+      const Level& below = levels[z + 1];
+      Tile tile;
+      tile.width = std::min(size, level.width - x * size);
+      tile.height = std::min(size, level.height - y * size);
+      tile.heights.resize(std::size_t(size) * size);
+      for (unsigned py = 0; py < tile.height; ++py) {
+         for (unsigned px = 0; px < tile.width; ++px) {
+            // Pixel (2gx + dx, 2gy + dy) of the level below lies in its tile (2x + px / half, 2y + py / half)
+            const Tile& source = child(2 * x + px / half, 2 * y + py / half);
+            const unsigned cx = 2 * (px % half), cy = 2 * (py % half);
+            const unsigned gx = 2 * (x * size + px), gy = 2 * (y * size + py);
+            float sum = 0.0f;
+            unsigned count = 0;
+            for (unsigned dy = 0; dy < 2; ++dy) {
+               for (unsigned dx = 0; dx < 2; ++dx) {
+                  if (gx + dx < below.width && gy + dy < below.height) {
+                     sum += source.heights[std::size_t(cy + dy) * size + cx + dx];
+                     ++count;
+                  }
+               }
+            }
+            tile.heights[std::size_t(py) * size + px] = sum / count;
+         }
+      }
+      finish(z, x, y, tile);
+      return tile;
+   }
+
+   /// @brief Pad the edges of a tile with its last valid column and row, then write it
+   void finish(const unsigned z, const unsigned x, const unsigned y, Tile& tile) {
+      const unsigned size = options.tileSize;
+      for (unsigned row = 0; row < tile.height; ++row) {
+         float* line = tile.heights.data() + std::size_t(row) * size;
+         std::fill(line + tile.width, line + size, line[tile.width - 1]);
+      }
+      for (unsigned row = tile.height; row < size; ++row) {
+         std::copy_n(tile.heights.data() + std::size_t(tile.height - 1) * size, size, tile.heights.data() + std::size_t(row) * size);
+      }
+      if (failed) return;
+
+      const std::filesystem::path file = directory / std::to_string(z) / std::to_string(x) / (std::to_string(y) + extensionOf(options.format));
+      try {
+         const HeightGrid grid = HeightGrid::of(tile.heights, size, size);
+         const std::vector<unsigned char> bytes = options.format == TileFormat::PNG16 ? encodeHeightmapPng(grid, options.heightmap)
+                                                  : encodeHeightmapRaw(grid, options.format == TileFormat::R16 ? RawHeightFormat::R16 : RawHeightFormat::F32,
+                                                                       options.heightmap);
+         if (!writeFileParts(file.string(), {{bytes.data(), bytes.size()}})) {
+            failed = true;
+            return;
+         }
+      } catch (const std::runtime_error& e) {
+         std::cerr << "Failed to export " << file.string() << ": " << e.what() << std::endl;
+         failed = true;
+         return;
+      }
+      ++tilesWritten;
+   }
+
+   /// @brief The directories of all columns of tiles, made up front so the threads only write files
+   bool createDirectories() {
+      for (unsigned z = 0; z < levels.size(); ++z) {
+         for (unsigned x = 0; x < levels[z].tilesX; ++x) {
+            const std::filesystem::path column = directory / std::to_string(z) / std::to_string(x);
+            std::error_code error;
+            std::filesystem::create_directories(column, error);
+            if (error) {
+               std::cerr << "Failed to create directory " << column.string() << ": " << error.message() << std::endl;
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   bool writeManifest() {
+      nlohmann::json manifest;
+      manifest["width"] = levels.back().width;
+      manifest["height"] = levels.back().height;
+      manifest["tileSize"] = options.tileSize;
+      manifest["minZoom"] = 0;
+      manifest["maxZoom"] = levels.size() - 1;
+      manifest["format"] = nameOf(options.format);
+      if (options.format != TileFormat::F32) {
+         manifest["low"] = options.heightmap.low;
+         manifest["high"] = options.heightmap.high;
+      }
+      manifest["scheme"] = "xyz";
+      manifest["edge"] = "clamp";
+      manifest["levels"] = nlohmann::json::array();
+      for (unsigned z = 0; z < levels.size(); ++z) {
+         manifest["levels"].push_back({{"zoom", z},
+                                       {"width", levels[z].width},
+                                       {"height", levels[z].height},
+                                       {"tilesX", levels[z].tilesX},
+                                       {"tilesY", levels[z].tilesY}});
+      }
+      const std::string filename = (directory / "manifest.json").string();
+      std::ofstream file(filename);
+      file << manifest.dump(4) << std::endl;
+      if (!file) {
+         std::cerr << "Failed to write file: " << filename << std::endl;
+         return false;
+      }
+      return true;
+   }
+};
+
+} // namespace
+
+bool ExportTilePyramid(const TerrainSettings& settings, const unsigned sizeX, const unsigned sizeY, const std::string& directory,
+                       const TileExportOptions& options) {
+   if (sizeX == 0 || sizeY == 0) {
+      throw std::invalid_argument("Tile pyramid of an empty map.");
+   }
+   if (options.tileSize < 2 || options.tileSize % 2 != 0) {
+      throw std::invalid_argument("The tile size of a pyramid must be even.");
+   }
+   if (settings.graph || settings.postProcessParams.anyEnabled()) {
+      throw std::invalid_argument("Tile pyramids are computed from the layers, without graph and post-processing.");
+   }
+   auto start = std::chrono::high_resolution_clock::now();
+   PyramidWriter writer(settings, sizeX, sizeY, directory, options);
+   if (!writer.run()) return false;
+   std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+   std::cout << "Tile pyramid exported to " << directory << " (" << writer.written() << " tiles) successfully in " << seconds.count()
+             << "s." << std::endl;
+   return true;
+}
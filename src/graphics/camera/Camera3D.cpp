@@ -8,6 +8,7 @@ void Camera3D::updateMatrix(float FOVdeg, float nearPlane, float farPlane) {
    model = glm::rotate(model, glm::radians(yaw), Up);
    view = glm::lookAt(Position, Position + Orientation, Up);
    projection = glm::perspective(glm::radians(FOVdeg), (float) (*window.getRenderWidth() / *window.getRenderHeight()), nearPlane, farPlane);
+   modelMatrix = model;
    cameraMatrix = projection * view * model;
 }
 
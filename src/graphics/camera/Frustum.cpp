@@ -0,0 +1,26 @@
+#include "Frustum.hpp"
+
+Frustum::Frustum(const glm::mat4& matrix) {
+   // A point is inside if -w <= x, y, z <= w after the transformation (Gribb and Hartmann), glm matrices are column major
+   const glm::vec4 rowX(matrix[0][0], matrix[1][0], matrix[2][0], matrix[3][0]);
+   const glm::vec4 rowY(matrix[0][1], matrix[1][1], matrix[2][1], matrix[3][1]);
+   const glm::vec4 rowZ(matrix[0][2], matrix[1][2], matrix[2][2], matrix[3][2]);
+   const glm::vec4 rowW(matrix[0][3], matrix[1][3], matrix[2][3], matrix[3][3]);
+   planes[0] = rowW + rowX; // left
+   planes[1] = rowW - rowX; // right
+   planes[2] = rowW + rowY; // bottom
+   planes[3] = rowW - rowY; // top
+   planes[4] = rowW + rowZ; // near
+   planes[5] = rowW - rowZ; // far
+}
+
+bool Frustum::intersects(const glm::vec3& low, const glm::vec3& high) const {
+   for (const glm::vec4& plane : planes) {
+      // The corner furthest along the plane normal, if even that one is outside the whole box is
+      const glm::vec3 corner(plane.x >= 0.0f ? high.x : low.x, plane.y >= 0.0f ? high.y : low.y, plane.z >= 0.0f ? high.z : low.z);
+      if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+         return false;
+      }
+   }
+   return true;
+}
@@ -1,9 +1,15 @@
 #include "EBO.hpp"
 
 EBO::EBO(std::vector<GLuint>& indices) {
-   glGenBuffers(1, &ID);
+   Data(indices.data(), indices.size() * sizeof(GLuint), GL_DYNAMIC_DRAW);
+}
+
+void EBO::Data(const void* data, GLsizeiptr size, GLenum usage) {
+   if (ID == 0) {
+      glGenBuffers(1, &ID);
+   }
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
-   glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, data, usage);
 }
 
 void EBO::Bind() {
@@ -15,5 +21,8 @@ void EBO::Unbind() {
 }
 
 void EBO::Delete() {
-   glDeleteBuffers(1, &ID);
-}
\ No newline at end of file
+   if (ID != 0) {
+      glDeleteBuffers(1, &ID);
+      ID = 0;
+   }
+}
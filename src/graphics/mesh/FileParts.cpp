@@ -0,0 +1,138 @@
+#include "FileParts.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#if defined(__unix__) || defined(__APPLE__)
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+bool writeFileParts(const std::string& filename, const std::vector<FilePart>& parts) {
+#if defined(__unix__) || defined(__APPLE__)
+   const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      std::cerr << "Failed to open file: " << filename << std::endl;
+      return false;
+   }
+   std::vector<iovec> pending;
+   for (const FilePart& part : parts) {
+      if (part.size > 0) {
+         pending.push_back({const_cast<void*>(part.data), part.size});
+      }
+   }
+   std::size_t first = 0;
+   while (first < pending.size()) {
+      const int count = std::min<std::size_t>(pending.size() - first, IOV_MAX);
+      ssize_t written = ::writev(fd, pending.data() + first, count);
+      if (written < 0) {
+         std::cerr << "Failed to write file: " << filename << std::endl;
+         ::close(fd);
+         return false;
+      }
+      // Partial writes continue in the middle of a part
+      while (first < pending.size() && std::size_t(written) >= pending[first].iov_len) {
+         written -= pending[first].iov_len;
+         ++first;
+      }
+      if (first < pending.size()) {
+         pending[first].iov_base = static_cast<char*>(pending[first].iov_base) + written;
+         pending[first].iov_len -= written;
+      }
+   }
+   if (::close(fd) != 0) {
+      std::cerr << "Failed to write file: " << filename << std::endl;
+      return false;
+   }
+   return true;
+#else
+   std::ofstream file(filename, std::ios::binary);
+   if (!file.is_open()) {
+      std::cerr << "Failed to open file: " << filename << std::endl;
+      return false;
+   }
+   for (const FilePart& part : parts) {
+      file.write(static_cast<const char*>(part.data), part.size);
+   }
+   file.close();
+   if (!file) {
+      std::cerr << "Failed to write file: " << filename << std::endl;
+      return false;
+   }
+   return true;
+#endif
+}
+
+BlockFile::BlockFile(const std::string& filename) : filename(filename) {
+#if defined(__unix__) || defined(__APPLE__)
+   fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) {
+      fail("open");
+   }
+#else
+   file.open(filename, std::ios::binary);
+   if (!file.is_open()) {
+      fail("open");
+   }
+#endif
+}
+
+BlockFile::~BlockFile() {
+   close();
+}
+
+void BlockFile::fail(const char* what) {
+   if (ok) {
+      std::cerr << "Failed to " << what << " file: " << filename << std::endl;
+   }
+   ok = false;
+}
+
+bool BlockFile::write(const void* data, std::size_t size) {
+   if (!ok) return false;
+#if defined(__unix__) || defined(__APPLE__)
+   const char* next = static_cast<const char*>(data);
+   while (size > 0) {
+      const ssize_t written = ::write(fd, next, size);
+      if (written < 0) {
+         fail("write");
+         return false;
+      }
+      next += written;
+      size -= written;
+   }
+#else
+   if (!file.write(static_cast<const char*>(data), size)) {
+      fail("write");
+   }
+#endif
+   return ok;
+}
+
+bool BlockFile::close() {
+#if defined(__unix__) || defined(__APPLE__)
+   if (fd >= 0 && ::close(fd) != 0) {
+      fail("write");
+   }
+   fd = -1;
+#else
+   if (file.is_open()) {
+      file.close();
+      if (!file) {
+         fail("write");
+      }
+   }
+#endif
+   return ok;
+}
+
+bool littleEndianHost() {
+   const std::uint16_t probe = 1;
+   unsigned char first;
+   std::memcpy(&first, &probe, 1);
+   return first == 1;
+}
@@ -0,0 +1,137 @@
+#include "GridNormals.hpp"
+#include "Parallel.hpp"
+
+#include <cmath>
+
+namespace {
+
+/// @brief Normalized normals of the two triangles of a quad
+struct QuadNormals {
+   float lowerX, lowerY, lowerZ; // triangle (i, j), (i + 1, j), (i + 1, j + 1)
+   float upperX, upperY, upperZ; // triangle (i + 1, j + 1), (i, j + 1), (i, j)
+};
+
+/// @brief normalize(cross(v1 - v0, v2 - v0)), written out with the same operations as glm
+inline void faceNormal(const float x0, const float h0, const float z0, const float x1, const float h1, const float z1,
+                       const float x2, const float h2, const float z2, float& nx, float& ny, float& nz) {
+   const float ax = x1 - x0, ay = h1 - h0, az = z1 - z0;
+   const float bx = x2 - x0, by = h2 - h0, bz = z2 - z0;
+   const float cx = ay * bz - by * az;
+   const float cy = az * bx - bz * ax;
+   const float cz = ax * by - bx * ay;
+   const float invLength = 1.0f / std::sqrt(cx * cx + cy * cy + cz * cz);
+   nx = cx * invLength;
+   ny = cy * invLength;
+   nz = cz * invLength;
+}
+
+/// @brief Face normals of quad row j, i.e. between the vertex rows j and j + 1
+void computeQuadRow(const std::vector<TerrainVertex>& vertices, const std::size_t sizeX, const std::size_t sizeY, const std::size_t j,
+                    std::vector<QuadNormals>& quads) {
+   const float invNumX = 1.0f / (sizeX - 1);
+   const float invNumY = 1.0f / (sizeY - 1);
+   const float z0 = j * invNumY - 0.5f;
+   const float z1 = (j + 1) * invNumY - 0.5f;
+   const TerrainVertex* bottom = vertices.data() + j * sizeX;
+   const TerrainVertex* top = bottom + sizeX;
+   QuadNormals* out = quads.data();
+   for (std::size_t i = 0; i + 1 < sizeX; ++i) {
+      const float x0 = i * invNumX - 0.5f;
+      const float x1 = (i + 1) * invNumX - 0.5f;
+      const float h00 = bottom[i].height, h10 = bottom[i + 1].height;
+      const float h01 = top[i].height, h11 = top[i + 1].height;
+      QuadNormals& quad = out[i];
+      faceNormal(x0, h00, z0, x1, h10, z0, x1, h11, z1, quad.lowerX, quad.lowerY, quad.lowerZ);
+      faceNormal(x1, h11, z1, x0, h01, z1, x0, h00, z0, quad.upperX, quad.upperY, quad.upperZ);
+   }
+}
+
+/**
+ * Sum the face normals around vertex row j, then normalize and pack them.
+ * below: quad row j - 1 (if HasBelow), above: quad row j (if HasAbove).
+ * The faces are added in the order of the triangle list: quad i - 1 and i of the row below, then of the row above.
+ */
+template <bool HasBelow, bool HasAbove>
+void gatherRow(TerrainVertex* out, const std::size_t sizeX, const std::vector<QuadNormals>& below, const std::vector<QuadNormals>& above,
+               std::vector<glm::vec3>& sums) {
+   const QuadNormals* b = below.data();
+   const QuadNormals* a = above.data();
+   glm::vec3* sum = sums.data();
+   auto vertex = [&](const std::size_t i, const bool hasLeft, const bool hasRight) {
+      float x = 0.0f, y = 0.0f, z = 0.0f;
+      if (HasBelow && hasLeft) x += b[i - 1].lowerX, y += b[i - 1].lowerY, z += b[i - 1].lowerZ;
+      if (HasBelow && hasLeft) x += b[i - 1].upperX, y += b[i - 1].upperY, z += b[i - 1].upperZ;
+      if (HasBelow && hasRight) x += b[i].upperX, y += b[i].upperY, z += b[i].upperZ;
+      if (HasAbove && hasLeft) x += a[i - 1].lowerX, y += a[i - 1].lowerY, z += a[i - 1].lowerZ;
+      if (HasAbove && hasRight) x += a[i].lowerX, y += a[i].lowerY, z += a[i].lowerZ;
+      if (HasAbove && hasRight) x += a[i].upperX, y += a[i].upperY, z += a[i].upperZ;
+      sum[i] = glm::vec3(x, y, z);
+   };
+
+   // Border columns peeled off, so the interior loop has no branches
+   const std::size_t last = sizeX - 1;
+   vertex(0, false, true);
+   for (std::size_t i = 1; i < last; ++i) {
+      vertex(i, true, true);
+   }
+   vertex(last, true, false);
+
+   for (std::size_t i = 0; i < sizeX; ++i) {
+      packNormal(glm::normalize(-sum[i]), out[i].normal);
+   }
+}
+
+} // namespace
+
+void computeGridNormalRows(std::vector<TerrainVertex>& vertices, const unsigned long sizeX, const unsigned long sizeY, const unsigned long begin,
+                           const unsigned long end) {
+   // Rolling buffer of the quad rows below and above the current vertex row
+   std::vector<QuadNormals> below(sizeX - 1), above(sizeX - 1);
+   std::vector<glm::vec3> sums(sizeX);
+   if (begin > 0) {
+      computeQuadRow(vertices, sizeX, sizeY, begin - 1, below);
+   }
+   for (std::size_t j = begin; j < end; ++j) {
+      TerrainVertex* out = vertices.data() + j * sizeX;
+      const bool hasAbove = j + 1 < sizeY;
+      if (hasAbove) {
+         computeQuadRow(vertices, sizeX, sizeY, j, above);
+      }
+      if (j == 0) {
+         gatherRow<false, true>(out, sizeX, below, above, sums);
+      } else if (!hasAbove) {
+         gatherRow<true, false>(out, sizeX, below, above, sums);
+      } else {
+         gatherRow<true, true>(out, sizeX, below, above, sums);
+      }
+      std::swap(below, above);
+   }
+}
+
+void computeTriangleNormals(std::vector<TerrainVertex>& vertices, const unsigned long sizeX, const unsigned long sizeY,
+                            const std::vector<GLuint>& triangles) {
+   // Same positions as Mesh::position
+   auto position = [&](const std::size_t k) {
+      const unsigned i = k % sizeX;
+      const unsigned j = k / sizeX;
+      return glm::vec3(i * (1.0f / (sizeX - 1)) - 0.5f, vertices[k].height, j * (1.0f / (sizeY - 1)) - 0.5f);
+   };
+   std::vector<glm::vec3> normals(vertices.size(), glm::vec3(0.0f));
+   for (std::size_t t = 0; t < triangles.size(); t += 3) {
+      const GLuint i0 = triangles[t], i1 = triangles[t + 1], i2 = triangles[t + 2];
+      const glm::vec3 v0 = position(i0);
+      const glm::vec3 normal = glm::normalize(glm::cross(position(i1) - v0, position(i2) - v0));
+      normals[i0] += normal;
+      normals[i1] += normal;
+      normals[i2] += normal;
+   }
+   for (std::size_t k = 0; k < vertices.size(); ++k) {
+      packNormal(glm::normalize(-normals[k]), vertices[k].normal);
+   }
+}
+
+void computeGridNormals(std::vector<TerrainVertex>& vertices, const unsigned long sizeX, const unsigned long sizeY) {
+   perlin::parallelFor(0, sizeY, gridNormalBandRows(sizeX), [&](const std::size_t begin, const std::size_t end) {
+      computeGridNormalRows(vertices, sizeX, sizeY, begin, end);
+   });
+}
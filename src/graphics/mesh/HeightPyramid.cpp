@@ -0,0 +1,76 @@
+#include "HeightPyramid.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void HeightPyramid::build(const std::vector<TerrainVertex>& vertices, const unsigned long sizeX, const unsigned long sizeY) {
+   HeightPyramid::sizeX = sizeX;
+   HeightPyramid::sizeY = sizeY;
+   const unsigned long numX = sizeX - 1;
+   const unsigned long numY = sizeY - 1;
+   levels.assign(1, Level{});
+
+   Level& finest = levels[0];
+   finest.cellsX = (numX + cellSize - 1) / cellSize;
+   finest.cellsZ = (numY + cellSize - 1) / cellSize;
+   finest.minHeights.resize(std::size_t(finest.cellsX) * finest.cellsZ);
+   finest.maxHeights.resize(finest.minHeights.size());
+   // Every row of cells is scanned by one thread, the vertex rows on the border between two rows of cells are read twice
+   perlin::parallelFor(0, finest.cellsZ, 4, [&](std::size_t begin, std::size_t end) {
+      for (std::size_t cellZ = begin; cellZ < end; ++cellZ) {
+         float* minRow = finest.minHeights.data() + cellZ * finest.cellsX;
+         float* maxRow = finest.maxHeights.data() + cellZ * finest.cellsX;
+         std::fill(minRow, minRow + finest.cellsX, std::numeric_limits<float>::infinity());
+         std::fill(maxRow, maxRow + finest.cellsX, -std::numeric_limits<float>::infinity());
+         const std::size_t lastRow = std::min<std::size_t>((cellZ + 1) * cellSize, numY);
+         for (std::size_t j = cellZ * cellSize; j <= lastRow; ++j) {
+            const TerrainVertex* row = vertices.data() + j * sizeX;
+            for (unsigned cellX = 0; cellX < finest.cellsX; ++cellX) {
+               const std::size_t lastColumn = std::min<std::size_t>((cellX + 1) * cellSize, numX);
+               float low = minRow[cellX], high = maxRow[cellX];
+               for (std::size_t i = cellX * cellSize; i <= lastColumn; ++i) {
+                  low = std::min(low, row[i].height);
+                  high = std::max(high, row[i].height);
+               }
+               minRow[cellX] = low;
+               maxRow[cellX] = high;
+            }
+         }
+      }
+   });
+
+   while (levels.back().cellsX > 1 || levels.back().cellsZ > 1) {
+      const Level& fine = levels.back();
+      Level coarse;
+      coarse.cellsX = (fine.cellsX + 1) / 2;
+      coarse.cellsZ = (fine.cellsZ + 1) / 2;
+      coarse.minHeights.resize(std::size_t(coarse.cellsX) * coarse.cellsZ);
+      coarse.maxHeights.resize(coarse.minHeights.size());
+      for (unsigned z = 0; z < coarse.cellsZ; ++z) {
+         for (unsigned x = 0; x < coarse.cellsX; ++x) {
+            float low = fine.minHeights[2 * z * fine.cellsX + 2 * x];
+            float high = fine.maxHeights[2 * z * fine.cellsX + 2 * x];
+            for (unsigned fineZ = 2 * z; fineZ < std::min(2 * z + 2, fine.cellsZ); ++fineZ) {
+               for (unsigned fineX = 2 * x; fineX < std::min(2 * x + 2, fine.cellsX); ++fineX) {
+                  low = std::min(low, fine.minHeights[fineZ * fine.cellsX + fineX]);
+                  high = std::max(high, fine.maxHeights[fineZ * fine.cellsX + fineX]);
+               }
+            }
+            coarse.minHeights[z * coarse.cellsX + x] = low;
+            coarse.maxHeights[z * coarse.cellsX + x] = high;
+         }
+      }
+      levels.push_back(std::move(coarse));
+   }
+}
+
+void HeightPyramid::bounds(const unsigned level, const unsigned cellX, const unsigned cellZ, glm::vec3& low, glm::vec3& high) const {
+   const Level& cells = levels[level];
+   const unsigned long size = static_cast<unsigned long>(cellSize) << level;
+   const float scaleX = 1.0f / (sizeX - 1);
+   const float scaleZ = 1.0f / (sizeY - 1);
+   low = glm::vec3(cellX * size * scaleX - 0.5f, cells.minHeights[cellZ * cells.cellsX + cellX], cellZ * size * scaleZ - 0.5f);
+   high = glm::vec3(std::min(cellX * size + size, sizeX - 1) * scaleX - 0.5f, cells.maxHeights[cellZ * cells.cellsX + cellX],
+                    std::min(cellZ * size + size, sizeY - 1) * scaleZ - 0.5f);
+}
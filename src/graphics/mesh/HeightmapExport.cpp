@@ -0,0 +1,559 @@
+#include "HeightmapExport.hpp"
+#include "FileParts.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <json.hpp>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+HeightGrid HeightGrid::of(const Mesh& mesh) {
+   static_assert(offsetof(TerrainVertex, height) == 0 && sizeof(TerrainVertex) % sizeof(float) == 0,
+                 "the heights are read in place with a stride of whole floats");
+   return {&mesh.vertices.data()->height, mesh.sizeX, mesh.sizeY, sizeof(TerrainVertex) / sizeof(float)};
+}
+
+HeightGrid HeightGrid::of(const GridMeshData& data) {
+   return {&data.vertices.data()->height, data.sizeX, data.sizeY, sizeof(TerrainVertex) / sizeof(float)};
+}
+
+HeightGrid HeightGrid::of(const std::vector<float>& heights, const unsigned long sizeX, const unsigned long sizeY) {
+   if (heights.size() != sizeX * sizeY) {
+      throw std::invalid_argument("HeightGrid: expected " + std::to_string(sizeX * sizeY) + " heights, got " + std::to_string(heights.size()));
+   }
+   return {heights.data(), sizeX, sizeY, 1};
+}
+
+std::pair<float, float> heightRange(const HeightGrid& grid) {
+   const std::size_t workers = perlin::workerCount();
+   std::vector<float> lows(workers, std::numeric_limits<float>::infinity());
+   std::vector<float> highs(workers, -std::numeric_limits<float>::infinity());
+   // One band per worker, band b only touches its own slot
+   perlin::parallelFor(0, workers, 1, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t band = begin; band < end; ++band) {
+         const unsigned long firstRow = grid.sizeY * band / workers, lastRow = grid.sizeY * (band + 1) / workers;
+         for (unsigned long y = firstRow; y < lastRow; ++y) {
+            for (unsigned long x = 0; x < grid.sizeX; ++x) {
+               lows[band] = std::min(lows[band], grid.at(x, y));
+               highs[band] = std::max(highs[band], grid.at(x, y));
+            }
+         }
+      }
+   });
+   return {*std::min_element(lows.begin(), lows.end()), *std::max_element(highs.begin(), highs.end())};
+}
+
+namespace {
+
+/// @brief Maps heights in [low, high] to the integers [0, maxValue]
+struct Quantizer {
+   float low, scale, maxValue;
+
+   Quantizer(const HeightmapOptions& options, const unsigned maxValue)
+      : low(options.low), scale(options.high > options.low ? maxValue / (options.high - options.low) : 0.0f), maxValue(maxValue) {}
+
+   std::uint16_t operator()(const float height) const {
+      return static_cast<std::uint16_t>(std::lround(std::clamp((height - low) * scale, 0.0f, maxValue)));
+   }
+};
+
+/**
+ * Row y of the grid as integer samples.
+ * @param bigEndian Byte order of 16-bit samples, big endian for PNG and Netpbm, little endian for raw files
+ * @param channels Copies of every sample, 3 for gray RGB pixels
+ * @param sampleBytes 1 or 2
+ */
+void quantizeRow(const HeightGrid& grid, const Quantizer& quantize, const unsigned long y, unsigned char* out,
+                 const bool bigEndian = true, const unsigned channels = 1, const unsigned sampleBytes = 2) {
+   for (unsigned long x = 0; x < grid.sizeX; ++x) {
+      const std::uint16_t value = quantize(grid.at(x, y));
+      for (unsigned channel = 0; channel < channels; ++channel, out += sampleBytes) {
+         if (sampleBytes == 1) {
+            out[0] = static_cast<unsigned char>(value);
+         } else {
+            out[bigEndian ? 0 : 1] = static_cast<unsigned char>(value >> 8);
+            out[bigEndian ? 1 : 0] = static_cast<unsigned char>(value & 0xFF);
+         }
+      }
+   }
+}
+
+/// @brief Bytes per band of rows processed by one thread, about 256 kB, so small images (e.g. tiles) stay on the calling thread
+const std::size_t bandBytes = 1 << 18;
+
+/// @brief Rows of a band of bandBytes
+inline unsigned long bandRows(const std::size_t rowBytes) {
+   return std::max<std::size_t>(1, bandBytes / rowBytes);
+}
+
+/// @brief Fill the bytes of every row on all threads, row y at out + y * rowBytes
+template <typename Row>
+void fillRows(const unsigned long rows, const std::size_t rowBytes, unsigned char* out, Row&& row) {
+   perlin::parallelFor(0, rows, bandRows(rowBytes), [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t y = begin; y < end; ++y) {
+         row(y, out + y * rowBytes);
+      }
+   });
+}
+
+/// @brief Size of the buffer the Netpbm rows are streamed through
+const std::size_t netpbmBlockBytes = 1 << 22;
+
+/// @brief Report a finished export with its duration
+void reportExport(const std::string& filename, const std::chrono::high_resolution_clock::time_point start) {
+   std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+   std::cout << "Heightmap exported to " << filename << " successfully in " << seconds.count() << "s." << std::endl;
+}
+
+// --- PNG ---
+
+/// @brief Bytes per pixel of a 16-bit grayscale image, the distance of the Sub and Paeth filters
+const std::size_t pixelBytes = 2;
+
+enum PngFilter : unsigned char { NONE, SUB, UP, AVERAGE, PAETH };
+
+inline unsigned char paethPredictor(const int left, const int above, const int aboveLeft) {
+   const int p = left + above - aboveLeft;
+   const int pa = std::abs(p - left), pb = std::abs(p - above), pc = std::abs(p - aboveLeft);
+   if (pa <= pb && pa <= pc) return static_cast<unsigned char>(left);
+   return static_cast<unsigned char>(pb <= pc ? above : aboveLeft);
+}
+
+/**
+ * Filter one row against the row above (zeros for the first row).
+ * @param out The filter type followed by the filtered bytes, 1 + bytes long
+ */
+void filterRow(const PngFilter filter, const unsigned char* row, const unsigned char* above, const std::size_t bytes, unsigned char* out) {
+   *out++ = filter;
+   for (std::size_t i = 0; i < bytes; ++i) {
+      const unsigned char left = i >= pixelBytes ? row[i - pixelBytes] : 0;
+      const unsigned char aboveLeft = i >= pixelBytes ? above[i - pixelBytes] : 0;
+      switch (filter) {
+         case NONE: out[i] = row[i]; break;
+         case SUB: out[i] = row[i] - left; break;
+         case UP: out[i] = row[i] - above[i]; break;
+         case AVERAGE: out[i] = row[i] - static_cast<unsigned char>((left + above[i]) / 2); break;
+         case PAETH: out[i] = row[i] - paethPredictor(left, above[i], aboveLeft); break;
+      }
+   }
+}
+
+/// @brief Sum of the filtered bytes taken as signed values, the smaller the better the row compresses
+std::size_t filterCost(const unsigned char* filtered, const std::size_t bytes) {
+   std::size_t sum = 0;
+   for (std::size_t i = 1; i <= bytes; ++i) {
+      sum += std::abs(static_cast<int>(static_cast<signed char>(filtered[i])));
+   }
+   return sum;
+}
+
+/**
+ * Quantize and filter the rows [begin, end) of the grid.
+ * @param fast Paeth filter on every row instead of trying all filters
+ * @param out (end - begin) filtered rows of 1 + 2 * sizeX bytes
+ */
+void filterRows(const HeightGrid& grid, const Quantizer& quantize, const unsigned long begin, const unsigned long end, const bool fast, unsigned char* out) {
+   const std::size_t bytes = 2 * grid.sizeX;
+   std::vector<unsigned char> row(bytes), above(bytes, 0), candidate(1 + bytes), best(1 + bytes);
+   if (begin > 0) {
+      quantizeRow(grid, quantize, begin - 1, above.data());
+   }
+   for (unsigned long y = begin; y < end; ++y, out += 1 + bytes) {
+      quantizeRow(grid, quantize, y, row.data());
+      if (fast) {
+         filterRow(PAETH, row.data(), above.data(), bytes, out);
+      } else {
+         std::size_t bestCost = std::numeric_limits<std::size_t>::max();
+         for (const PngFilter filter : {NONE, SUB, UP, AVERAGE, PAETH}) {
+            filterRow(filter, row.data(), above.data(), bytes, candidate.data());
+            const std::size_t cost = filterCost(candidate.data(), bytes);
+            if (cost < bestCost) {
+               bestCost = cost;
+               best.swap(candidate);
+            }
+         }
+         std::memcpy(out, best.data(), 1 + bytes);
+      }
+      row.swap(above);
+   }
+}
+
+/// @brief Deflate bit stream, values are appended starting at their least significant bit
+class BitWriter {
+   public:
+   explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+   /// @param count at most 16 bits
+   void put(const std::uint32_t value, const unsigned count) {
+      buffer |= std::uint64_t(value) << filled;
+      filled += count;
+      if (filled >= 32) {
+         for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<unsigned char>(buffer >> (8 * i)));
+         }
+         buffer >>= 32;
+         filled -= 32;
+      }
+   }
+
+   /// @brief Pad with zero bits to the next byte boundary and flush everything
+   void align() {
+      for (; filled > 0; filled = filled > 8 ? filled - 8 : 0) {
+         out.push_back(static_cast<unsigned char>(buffer));
+         buffer >>= 8;
+      }
+   }
+
+   private:
+   std::vector<unsigned char>& out;
+   std::uint64_t buffer = 0;
+   unsigned filled = 0;
+};
+
+/// @brief Canonical Huffman codes of the code lengths (RFC 1951, 3.2.2), bit reversed since deflate writes them from the top bit
+void canonicalCodes(const unsigned* lengths, const std::size_t count, std::uint32_t* codes) {
+   unsigned lengthCount[16] = {};
+   for (std::size_t n = 0; n < count; ++n) {
+      if (lengths[n] > 0) ++lengthCount[lengths[n]];
+   }
+   std::uint32_t next[16] = {};
+   std::uint32_t code = 0;
+   for (unsigned bits = 1; bits < 16; ++bits) {
+      code = (code + lengthCount[bits - 1]) << 1;
+      next[bits] = code;
+   }
+   for (std::size_t n = 0; n < count; ++n) {
+      if (lengths[n] == 0) continue;
+      std::uint32_t reversed = 0;
+      for (std::uint32_t value = next[lengths[n]]++, bit = 0; bit < lengths[n]; ++bit, value >>= 1) {
+         reversed = (reversed << 1) | (value & 1);
+      }
+      codes[n] = reversed;
+   }
+}
+
+/**
+ * One deflate block with a dynamic Huffman code for the bytes and no LZ77 matches.
+ * The distance code is never used, it has two codes of one bit so that all decoders accept it.
+ */
+void huffmanBlock(BitWriter& bits, const unsigned char* data, const std::size_t size, const bool final) {
+   const std::size_t literals = 257; // the bytes and the end of the block
+   unsigned frequencies[literals] = {};
+   for (std::size_t i = 0; i < size; ++i) {
+      ++frequencies[data[i]];
+   }
+   frequencies[256] = 1;
+   unsigned lengths[literals + 2];
+   lodepng_huffman_code_lengths(lengths, frequencies, literals, 15);
+   lengths[literals] = lengths[literals + 1] = 1;
+
+   // The code lengths themselves are Huffman coded, without run lengths
+   unsigned lengthFrequencies[19] = {};
+   for (const unsigned length : lengths) {
+      ++lengthFrequencies[length];
+   }
+   unsigned lengthLengths[19];
+   lodepng_huffman_code_lengths(lengthLengths, lengthFrequencies, 19, 7);
+   static const unsigned order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+   unsigned lengthCodesUsed = 19;
+   while (lengthCodesUsed > 4 && lengthLengths[order[lengthCodesUsed - 1]] == 0) {
+      --lengthCodesUsed;
+   }
+
+   bits.put(final, 1);
+   bits.put(2, 2); // dynamic Huffman codes
+   bits.put(literals - 257, 5);
+   bits.put(2 - 1, 5);
+   bits.put(lengthCodesUsed - 4, 4);
+   for (unsigned i = 0; i < lengthCodesUsed; ++i) {
+      bits.put(lengthLengths[order[i]], 3);
+   }
+   std::uint32_t lengthCodes[19];
+   canonicalCodes(lengthLengths, 19, lengthCodes);
+   for (const unsigned length : lengths) {
+      bits.put(lengthCodes[length], lengthLengths[length]);
+   }
+
+   std::uint32_t codes[literals];
+   canonicalCodes(lengths, literals, codes);
+   for (std::size_t i = 0; i < size; ++i) {
+      bits.put(codes[data[i]], lengths[data[i]]);
+   }
+   bits.put(codes[256], lengths[256]);
+}
+
+/// @brief Adler-32 checksum of zlib, continued from a previous value
+std::uint32_t adler32(const unsigned char* data, std::size_t size, const std::uint32_t previous = 1) {
+   const std::uint32_t base = 65521;
+   std::uint32_t a = previous & 0xFFFF, b = previous >> 16;
+   while (size > 0) {
+      // The largest run without overflowing b
+      const std::size_t run = std::min<std::size_t>(size, 5552);
+      for (std::size_t i = 0; i < run; ++i) {
+         a += data[i];
+         b += a;
+      }
+      a %= base;
+      b %= base;
+      data += run;
+      size -= run;
+   }
+   return (b << 16) | a;
+}
+
+/// @brief Adler-32 of two pieces joined, from their checksums and the length of the second (as adler32_combine of zlib)
+std::uint32_t adler32Combine(const std::uint32_t first, const std::uint32_t second, const std::size_t secondSize) {
+   const std::uint32_t base = 65521;
+   const std::uint32_t remainder = secondSize % base;
+   std::uint32_t a = first & 0xFFFF;
+   std::uint32_t b = std::uint32_t((std::uint64_t(remainder) * a) % base);
+   a += (second & 0xFFFF) + base - 1;
+   b += (first >> 16) + (second >> 16) + base - remainder;
+   if (a >= base) a -= base;
+   if (a >= base) a -= base;
+   if (b >= 2 * base) b -= 2 * base;
+   if (b >= base) b -= base;
+   return (b << 16) | a;
+}
+
+void putBigEndian32(std::vector<unsigned char>& out, const std::uint32_t value) {
+   for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<unsigned char>(value >> shift));
+   }
+}
+
+/// @brief Start a PNG chunk: room for the length, then the type. The data is appended after it.
+void beginChunk(std::vector<unsigned char>& chunk, const char* type) {
+   chunk.insert(chunk.end(), 4, 0);
+   chunk.insert(chunk.end(), type, type + 4);
+}
+
+/// @brief Fill in the length of the chunk started at offset and append its CRC
+void endChunk(std::vector<unsigned char>& chunk, const std::size_t offset = 0) {
+   const std::size_t length = chunk.size() - offset - 8;
+   for (int i = 0; i < 4; ++i) {
+      chunk[offset + i] = static_cast<unsigned char>(length >> (24 - 8 * i));
+   }
+   putBigEndian32(chunk, lodepng_crc32(chunk.data() + offset + 4, length + 4));
+}
+
+/// @brief A PNG file in pieces: signature and header, the IDAT chunks, the end
+struct PngParts {
+   std::vector<unsigned char> head;
+   std::vector<std::vector<unsigned char>> bands;
+   std::vector<unsigned char> tail;
+
+   std::vector<FilePart> parts() const {
+      std::vector<FilePart> parts = {{head.data(), head.size()}};
+      for (const std::vector<unsigned char>& chunk : bands) {
+         parts.push_back({chunk.data(), chunk.size()});
+      }
+      parts.push_back({tail.data(), tail.size()});
+      return parts;
+   }
+};
+
+/// @brief The 16-bit grayscale PNG of ExportHeightmapPng
+/// @return 0 or the error code of lodepng
+unsigned encodePng(const HeightGrid& grid, const HeightmapOptions& options, PngParts& png) {
+   const Quantizer quantize(options, 65535);
+   const std::size_t rowBytes = 1 + 2 * grid.sizeX;
+
+   // Signature and header
+   png.head = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+   beginChunk(png.head, "IHDR");
+   putBigEndian32(png.head, grid.sizeX);
+   putBigEndian32(png.head, grid.sizeY);
+   png.head.insert(png.head.end(), {16, 0, 0, 0, 0}); // 16-bit grayscale, deflate, adaptive filtering, no interlacing
+   endChunk(png.head, 8);
+
+   // One IDAT chunk per band of rows, the zlib stream runs through all of them
+   std::vector<std::vector<unsigned char>>& bands = png.bands;
+   std::vector<unsigned char>& tail = png.tail;
+   if (options.fast) {
+      const unsigned long rowsPerBand = bandRows(rowBytes);
+      bands.resize((grid.sizeY + rowsPerBand - 1) / rowsPerBand);
+      std::vector<std::uint32_t> checksums(bands.size());
+      perlin::parallelFor(0, bands.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+         std::vector<unsigned char> filtered;
+         for (std::size_t band = begin; band < end; ++band) {
+            const unsigned long firstRow = band * rowsPerBand;
+            const unsigned long lastRow = std::min<unsigned long>(firstRow + rowsPerBand, grid.sizeY);
+            filtered.resize((lastRow - firstRow) * rowBytes);
+            filterRows(grid, quantize, firstRow, lastRow, true, filtered.data());
+            checksums[band] = adler32(filtered.data(), filtered.size());
+
+            std::vector<unsigned char>& chunk = bands[band];
+            chunk.reserve(filtered.size() + filtered.size() / 8 + 256);
+            beginChunk(chunk, "IDAT");
+            if (band == 0) {
+               chunk.insert(chunk.end(), {0x78, 0x01}); // zlib header: deflate with a 32 kB window, fastest level
+            }
+            BitWriter bits(chunk);
+            const bool last = band + 1 == bands.size();
+            huffmanBlock(bits, filtered.data(), filtered.size(), last);
+            if (!last) {
+               // Empty stored block: the next band starts at a byte boundary
+               bits.put(0, 3);
+               bits.align();
+               chunk.insert(chunk.end(), {0x00, 0x00, 0xFF, 0xFF});
+            }
+            bits.align();
+            endChunk(chunk);
+         }
+      });
+      std::uint32_t checksum = checksums[0];
+      for (std::size_t band = 1; band < bands.size(); ++band) {
+         const unsigned long rows = std::min<unsigned long>(rowsPerBand, grid.sizeY - band * rowsPerBand);
+         checksum = adler32Combine(checksum, checksums[band], rows * rowBytes);
+      }
+      beginChunk(tail, "IDAT");
+      putBigEndian32(tail, checksum);
+      endChunk(tail);
+   } else {
+      std::vector<unsigned char> filtered(grid.sizeY * rowBytes);
+      perlin::parallelFor(0, grid.sizeY, bandRows(rowBytes), [&](const std::size_t begin, const std::size_t end) {
+         filterRows(grid, quantize, begin, end, false, filtered.data() + begin * rowBytes);
+      });
+      LodePNGCompressSettings settings;
+      lodepng_compress_settings_init(&settings);
+      unsigned char* compressed = nullptr;
+      std::size_t compressedSize = 0;
+      const unsigned error = lodepng_zlib_compress(&compressed, &compressedSize, filtered.data(), filtered.size(), &settings);
+      if (error) {
+         std::free(compressed);
+         return error;
+      }
+      bands.resize(1);
+      beginChunk(bands[0], "IDAT");
+      bands[0].insert(bands[0].end(), compressed, compressed + compressedSize);
+      std::free(compressed);
+      endChunk(bands[0]);
+   }
+   beginChunk(tail, "IEND");
+   endChunk(tail, tail.size() - 8);
+   return 0;
+}
+
+/// @brief The samples of a raw heightmap, little endian, see ExportHeightmapRaw
+void rawSamples(const HeightGrid& grid, const RawHeightFormat format, const HeightmapOptions& options, unsigned char* out) {
+   if (format == RawHeightFormat::R16) {
+      const Quantizer quantize(options, 65535);
+      fillRows(grid.sizeY, 2 * grid.sizeX, out, [&](const unsigned long y, unsigned char* row) {
+         quantizeRow(grid, quantize, y, row, false);
+      });
+      return;
+   }
+   fillRows(grid.sizeY, 4 * grid.sizeX, out, [&](const unsigned long y, unsigned char* row) {
+      for (unsigned long x = 0; x < grid.sizeX; ++x) {
+         std::uint32_t bits;
+         const float height = grid.at(x, y);
+         std::memcpy(&bits, &height, sizeof(bits));
+         for (int i = 0; i < 4; ++i) {
+            row[4 * x + i] = static_cast<unsigned char>(bits >> (8 * i));
+         }
+      }
+   });
+}
+
+} // namespace
+
+void ExportHeightmapPng(const HeightGrid& grid, const std::string& filename, const HeightmapOptions& options) {
+   auto start = std::chrono::high_resolution_clock::now();
+   PngParts png;
+   if (const unsigned error = encodePng(grid, options, png)) {
+      std::cerr << "Failed to export " << filename << ": encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+      return;
+   }
+   if (writeFileParts(filename, png.parts())) {
+      reportExport(filename, start);
+   }
+}
+
+std::vector<unsigned char> encodeHeightmapPng(const HeightGrid& grid, const HeightmapOptions& options) {
+   PngParts png;
+   if (const unsigned error = encodePng(grid, options, png)) {
+      throw std::runtime_error(std::string("PNG encoder error: ") + lodepng_error_text(error));
+   }
+   std::vector<unsigned char> bytes;
+   for (const FilePart& part : png.parts()) {
+      const unsigned char* data = static_cast<const unsigned char*>(part.data);
+      bytes.insert(bytes.end(), data, data + part.size);
+   }
+   return bytes;
+}
+
+void ExportHeightmapNetpbm(const HeightGrid& grid, const std::string& filename, const NetpbmFormat format, const unsigned bits, const HeightmapOptions& options) {
+   if (bits != 8 && bits != 16) {
+      throw std::invalid_argument("Netpbm samples have 8 or 16 bits, not " + std::to_string(bits));
+   }
+   auto start = std::chrono::high_resolution_clock::now();
+   const unsigned maxValue = (1u << bits) - 1;
+   const unsigned channels = format == NetpbmFormat::PPM ? 3 : 1;
+   const Quantizer quantize(options, maxValue);
+   const std::size_t rowBytes = grid.sizeX * channels * (bits / 8);
+   const std::string header = std::string(format == NetpbmFormat::PPM ? "P6\n" : "P5\n") + std::to_string(grid.sizeX) + " "
+                              + std::to_string(grid.sizeY) + "\n" + std::to_string(maxValue) + "\n";
+
+   BlockFile file(filename);
+   if (!file.write(header.data(), header.size())) return;
+   const unsigned long blockRows = std::max<std::size_t>(1, netpbmBlockBytes / rowBytes);
+   std::unique_ptr<unsigned char[]> block(new unsigned char[std::min<unsigned long>(blockRows, grid.sizeY) * rowBytes]);
+   for (unsigned long first = 0; first < grid.sizeY; first += blockRows) {
+      const unsigned long rows = std::min(blockRows, grid.sizeY - first);
+      fillRows(rows, rowBytes, block.get(), [&](const unsigned long row, unsigned char* out) {
+         quantizeRow(grid, quantize, first + row, out, true, channels, bits / 8);
+      });
+      if (!file.write(block.get(), rows * rowBytes)) return;
+   }
+   if (file.close()) {
+      reportExport(filename, start);
+   }
+}
+
+void ExportHeightmapRaw(const HeightGrid& grid, const std::string& filename, const RawHeightFormat format, const HeightmapOptions& options) {
+   auto start = std::chrono::high_resolution_clock::now();
+   const std::size_t count = grid.sizeX * grid.sizeY;
+   std::unique_ptr<unsigned char[]> samples;
+   // Contiguous heights of a little endian host are written in place
+   FilePart data{grid.heights, count * sizeof(float)};
+   if (format == RawHeightFormat::R16 || grid.stride != 1 || !littleEndianHost()) {
+      data.size = count * (format == RawHeightFormat::R16 ? 2 : 4);
+      samples.reset(new unsigned char[data.size]);
+      rawSamples(grid, format, options, samples.get());
+      data.data = samples.get();
+   }
+   if (!writeFileParts(filename, {data})) return;
+
+   nlohmann::json sidecar;
+   sidecar["width"] = grid.sizeX;
+   sidecar["height"] = grid.sizeY;
+   sidecar["format"] = format == RawHeightFormat::R16 ? "r16" : "f32";
+   sidecar["byteOrder"] = "little";
+   if (format == RawHeightFormat::R16) {
+      sidecar["low"] = options.low;
+      sidecar["high"] = options.high;
+   }
+   std::ofstream file(filename + ".json");
+   file << sidecar.dump(4) << std::endl;
+   if (!file) {
+      std::cerr << "Failed to write file: " << filename << ".json" << std::endl;
+      return;
+   }
+   reportExport(filename, start);
+}
+
+std::vector<unsigned char> encodeHeightmapRaw(const HeightGrid& grid, const RawHeightFormat format, const HeightmapOptions& options) {
+   std::vector<unsigned char> bytes(grid.sizeX * grid.sizeY * (format == RawHeightFormat::R16 ? 2 : 4));
+   rawSamples(grid, format, options, bytes.data());
+   return bytes;
+}
@@ -0,0 +1,222 @@
+#include "IndexCache.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+const GLuint restartIndex = std::numeric_limits<GLuint>::max();
+
+/// @brief 6 indices per quad, the same triangles as always used for the terrain grid
+template <typename Index>
+void appendQuads(std::vector<Index>& out, const unsigned numX, const unsigned rows) {
+   const unsigned stride = numX + 1;
+   for (unsigned j = 0; j < rows; ++j) {
+      for (unsigned i = 0; i < numX; ++i) {
+         out.push_back(j * stride + i);
+         out.push_back(j * stride + i + 1);
+         out.push_back((j + 1) * stride + i + 1);
+         out.push_back((j + 1) * stride + i + 1);
+         out.push_back((j + 1) * stride + i);
+         out.push_back(j * stride + i);
+      }
+   }
+}
+
+} // namespace
+
+GridIndices::GridIndices(const unsigned numX, const unsigned numY, const IndexMode mode) : numX(numX), numY(numY), mode(mode) {
+   switch (mode) {
+      case IndexMode::TRIANGLES:
+         buildTriangles();
+         break;
+      case IndexMode::STRIPS:
+         buildStrips();
+         break;
+      case IndexMode::PATCHES16:
+         buildPatches();
+         break;
+   }
+   indexCount = indices32.size();
+   indexBytes = indices32.size() * sizeof(GLuint) + indices16.size() * sizeof(GLushort);
+}
+
+GridIndices::~GridIndices() {
+   ebo.Delete();
+}
+
+void GridIndices::buildTriangles() {
+   indices32.reserve(std::size_t(numX) * numY * 6);
+   appendQuads(indices32, numX, numY);
+}
+
+void GridIndices::buildStrips() {
+   // Row j: (j+1, 0), (j, 0), (j+1, 1), (j, 1), ... splits every quad along the same diagonal as the triangle list
+   const unsigned stride = numX + 1;
+   indices32.reserve(std::size_t(numY) * (2 * stride + 1));
+   for (unsigned j = 0; j < numY; ++j) {
+      for (unsigned i = 0; i <= numX; ++i) {
+         indices32.push_back((j + 1) * stride + i);
+         indices32.push_back(j * stride + i);
+      }
+      indices32.push_back(restartIndex);
+   }
+}
+
+void GridIndices::buildPatches() {
+   // A band of rows is addressed relative to its first vertex, the largest local index is rows * (numX + 1) + numX
+   const unsigned stride = numX + 1;
+   const unsigned maxLocal = std::numeric_limits<GLushort>::max();
+   if (numX > maxLocal || maxLocal - numX < stride) {
+      throw std::invalid_argument("Grid rows are too long for 16-bit indices.");
+   }
+   bandRows = std::min(numY, (maxLocal - numX) / stride);
+   const unsigned lastRows = numY % bandRows;
+
+   // Two variants: a full band and the remaining rows
+   appendQuads(indices16, numX, bandRows);
+   const std::size_t fullCount = indices16.size();
+   fullBandCount = fullCount;
+   appendQuads(indices16, numX, lastRows);
+
+   for (unsigned j = 0; j < numY; j += bandRows) {
+      const bool last = j + bandRows > numY;
+      bandCounts.push_back(last ? indices16.size() - fullCount : fullCount);
+      bandOffsets.push_back(reinterpret_cast<const void*>(last ? fullCount * sizeof(GLushort) : 0));
+      bandBaseVertices.push_back(j * stride);
+   }
+}
+
+void GridIndices::Bind() {
+   if (ebo.ID == 0) {
+      if (mode == IndexMode::PATCHES16) {
+         ebo.Data(indices16.data(), indices16.size() * sizeof(GLushort), GL_STATIC_DRAW);
+      } else {
+         ebo.Data(indices32.data(), indices32.size() * sizeof(GLuint), GL_STATIC_DRAW);
+      }
+      // Drawing only needs the counts and offsets from here on
+      std::vector<GLuint>().swap(indices32);
+      std::vector<GLushort>().swap(indices16);
+   } else {
+      ebo.Bind();
+   }
+}
+
+void GridIndices::Draw() const {
+   switch (mode) {
+      case IndexMode::TRIANGLES:
+         glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+         break;
+      case IndexMode::STRIPS:
+         glEnable(GL_PRIMITIVE_RESTART);
+         glPrimitiveRestartIndex(restartIndex);
+         glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
+         glDisable(GL_PRIMITIVE_RESTART);
+         break;
+      case IndexMode::PATCHES16:
+         glMultiDrawElementsBaseVertex(GL_TRIANGLES, bandCounts.data(), GL_UNSIGNED_SHORT, const_cast<const void* const*>(bandOffsets.data()),
+                                       bandCounts.size(), const_cast<GLint*>(bandBaseVertices.data()));
+         break;
+   }
+}
+
+void GridIndices::DrawRegions(const std::vector<QuadRegion>& regions) {
+   rangeCounts.clear();
+   rangeOffsets.clear();
+   rangeBaseVertices.clear();
+   const std::size_t stride = numX + 1;
+   for (const QuadRegion& region : regions) {
+      const std::size_t quads = region.x1 - region.x0;
+      for (std::size_t j = region.z0; j < region.z1; ++j) {
+         // Each quad row is contiguous in every format, so a row of the region is one range
+         switch (mode) {
+            case IndexMode::TRIANGLES:
+               rangeCounts.push_back(6 * quads);
+               rangeOffsets.push_back(reinterpret_cast<const void*>((j * numX + region.x0) * 6 * sizeof(GLuint)));
+               break;
+            case IndexMode::STRIPS:
+               rangeCounts.push_back(2 * (quads + 1));
+               rangeOffsets.push_back(reinterpret_cast<const void*>((j * (2 * stride + 1) + 2 * region.x0) * sizeof(GLuint)));
+               break;
+            case IndexMode::PATCHES16: {
+               const std::size_t band = j / bandRows;
+               const std::size_t bandStart = (band + 1) * bandRows > numY ? fullBandCount : 0;
+               rangeCounts.push_back(6 * quads);
+               rangeOffsets.push_back(reinterpret_cast<const void*>((bandStart + ((j % bandRows) * numX + region.x0) * 6) * sizeof(GLushort)));
+               rangeBaseVertices.push_back(band * bandRows * stride);
+               break;
+            }
+         }
+      }
+   }
+   if (rangeCounts.empty()) return;
+
+   switch (mode) {
+      case IndexMode::TRIANGLES:
+         glMultiDrawElements(GL_TRIANGLES, rangeCounts.data(), GL_UNSIGNED_INT, rangeOffsets.data(), rangeCounts.size());
+         break;
+      case IndexMode::STRIPS:
+         // The ranges end before the restart index, so every range is a strip on its own
+         glMultiDrawElements(GL_TRIANGLE_STRIP, rangeCounts.data(), GL_UNSIGNED_INT, rangeOffsets.data(), rangeCounts.size());
+         break;
+      case IndexMode::PATCHES16:
+         glMultiDrawElementsBaseVertex(GL_TRIANGLES, rangeCounts.data(), GL_UNSIGNED_SHORT, rangeOffsets.data(), rangeCounts.size(),
+                                       rangeBaseVertices.data());
+         break;
+   }
+}
+
+std::map<std::pair<unsigned, unsigned>, std::weak_ptr<const std::vector<GLuint>>>& IndexCache::triangleCache() {
+   static std::map<std::pair<unsigned, unsigned>, std::weak_ptr<const std::vector<GLuint>>> cache;
+   return cache;
+}
+
+std::map<IndexCache::Key, std::shared_ptr<GridIndices>>& IndexCache::gpuCache() {
+   static std::map<Key, std::shared_ptr<GridIndices>> cache;
+   return cache;
+}
+
+std::shared_ptr<const std::vector<GLuint>> IndexCache::triangles(const unsigned numX, const unsigned numY) {
+   auto& cache = triangleCache();
+   auto& entry = cache[{numX, numY}];
+   if (auto shared = entry.lock()) {
+      return shared;
+   }
+   // Drop the entries of the shapes no mesh uses anymore
+   for (auto it = cache.begin(); it != cache.end();) {
+      if (it->second.expired() && &it->second != &entry) {
+         it = cache.erase(it);
+      } else {
+         ++it;
+      }
+   }
+   auto indices = std::make_shared<std::vector<GLuint>>();
+   indices->reserve(std::size_t(numX) * numY * 6);
+   appendQuads(*indices, numX, numY);
+   entry = indices;
+   return indices;
+}
+
+std::shared_ptr<GridIndices> IndexCache::gpu(const unsigned numX, const unsigned numY, const IndexMode mode) {
+   auto& cache = gpuCache();
+   auto it = cache.find({numX, numY, mode});
+   if (it != cache.end()) {
+      return it->second;
+   }
+   std::shared_ptr<GridIndices> indices;
+   try {
+      indices = std::make_shared<GridIndices>(numX, numY, mode);
+   } catch (const std::invalid_argument& e) {
+      std::cout << e.what() << " Using 32-bit triangles instead.\n";
+      return gpu(numX, numY, IndexMode::TRIANGLES);
+   }
+   cache.emplace(Key{numX, numY, mode}, indices);
+   return indices;
+}
+
+void IndexCache::release() {
+   triangleCache().clear();
+   gpuCache().clear();
+}
@@ -0,0 +1,207 @@
+#include "LodQuadtree.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+/// @brief Fraction of the range of a level (measured from the previous range) after which its patches start to morph
+const float morphStartRatio = 0.66f;
+
+/// @brief Texture units of the height and normal textures, see TerrainVertex.glsl
+const GLint heightUnit = 0;
+const GLint normalUnit = 1;
+
+GLuint createTexture() {
+   GLuint texture = 0;
+   glGenTextures(1, &texture);
+   glBindTexture(GL_TEXTURE_2D, texture);
+   // Morphed vertices lie between grid points, so the textures are filtered
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glBindTexture(GL_TEXTURE_2D, 0);
+   return texture;
+}
+
+} // namespace
+
+LodQuadtree::LodQuadtree(const Mesh& mesh) : sizeX(mesh.sizeX), sizeY(mesh.sizeY) {
+   // One level per level of the pyramid, the coarsest has a single node covering the grid
+   levels = mesh.getPyramid().getLevels();
+   ranges.resize(levels);
+
+   heightTexture = createTexture();
+   normalTexture = createTexture();
+   backHeightTexture = createTexture();
+   backNormalTexture = createTexture();
+   // Nothing is drawn yet, so all rows at once
+   beginUpdate(mesh);
+   continueUpload(mesh, std::numeric_limits<std::size_t>::max());
+
+   // A patch has at most (patchSize + 1)^2 vertices, 16-bit indices are always enough
+   fullIndices = IndexCache::gpu(patchSize, patchSize, IndexMode::PATCHES16);
+   quarterIndices = IndexCache::gpu(patchSize / 2, patchSize / 2, IndexMode::PATCHES16);
+   fullVAO.Bind();
+   fullIndices->Bind();
+   quarterVAO.Bind();
+   quarterIndices->Bind();
+   quarterVAO.Unbind();
+}
+
+LodQuadtree::~LodQuadtree() {
+   glDeleteTextures(1, &heightTexture);
+   glDeleteTextures(1, &normalTexture);
+   glDeleteTextures(1, &backHeightTexture);
+   glDeleteTextures(1, &backNormalTexture);
+   fullVAO.Delete();
+   quarterVAO.Delete();
+}
+
+void LodQuadtree::beginUpdate(const Mesh& mesh) {
+   if (mesh.sizeX != sizeX || mesh.sizeY != sizeY) {
+      throw std::invalid_argument("The grid of the mesh must not change when updating the LOD quadtree.");
+   }
+   uploading = true;
+   uploadedRows = 0;
+}
+
+bool LodQuadtree::continueUpload(const Mesh& mesh, const std::size_t maxBytes) {
+   if (!uploading) return false;
+   if (uploadedRows == 0) {
+      // New storage, the previous frames may still sample the old one when it was the front texture
+      glBindTexture(GL_TEXTURE_2D, backHeightTexture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, sizeX, sizeY, 0, GL_RED, GL_FLOAT, nullptr);
+      glBindTexture(GL_TEXTURE_2D, backNormalTexture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16_SNORM, sizeX, sizeY, 0, GL_RG, GL_SHORT, nullptr);
+   }
+   const std::size_t rowBytes = sizeX * (sizeof(float) + 2 * sizeof(GLshort));
+   const unsigned long rows = std::min<std::size_t>(std::max<std::size_t>(maxBytes / rowBytes, 1), sizeY - uploadedRows);
+   uploadRows(mesh, uploadedRows, rows);
+   uploadedRows += rows;
+   if (uploadedRows < sizeY) return false;
+
+   std::swap(heightTexture, backHeightTexture);
+   std::swap(normalTexture, backNormalTexture);
+   pyramid = mesh.getPyramid();
+   uploading = false;
+   return true;
+}
+
+void LodQuadtree::uploadRows(const Mesh& mesh, const unsigned long first, const unsigned long count) {
+   const std::size_t begin = first * sizeX;
+   const std::size_t size = count * sizeX;
+   rowHeights.resize(size);
+   rowNormals.resize(2 * size);
+   for (std::size_t k = 0; k < size; ++k) {
+      const TerrainVertex& vertex = mesh.vertices[begin + k];
+      rowHeights[k] = vertex.height;
+      rowNormals[2 * k] = vertex.normal[0];
+      rowNormals[2 * k + 1] = vertex.normal[1];
+   }
+
+   glBindTexture(GL_TEXTURE_2D, backHeightTexture);
+   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, sizeX, count, GL_RED, GL_FLOAT, rowHeights.data());
+   glBindTexture(GL_TEXTURE_2D, backNormalTexture);
+   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first, sizeX, count, GL_RG, GL_SHORT, rowNormals.data());
+   glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+bool LodQuadtree::inRange(const glm::vec3& low, const glm::vec3& high, const glm::vec3& camera, const float range) {
+   const glm::vec3 offset = camera - glm::clamp(camera, low, high);
+   return glm::dot(offset, offset) <= range * range;
+}
+
+bool LodQuadtree::select(const unsigned x, const unsigned z, const unsigned level, const glm::vec3& camera, const Frustum& frustum) {
+   const unsigned size = patchSize << level;
+   glm::vec3 low, high;
+   pyramid.bounds(level, x / size, z / size, low, high);
+   if (!inRange(low, high, camera, ranges[level])) {
+      return false; // the parent covers this area with its own level
+   }
+   if (!frustum.intersects(low, high)) {
+      ++stats.culledPatches;
+      stats.culledTriangles += 2ul * patchSize * patchSize;
+      return true;
+   }
+   if (level == 0 || !inRange(low, high, camera, ranges[level - 1])) {
+      selection.push_back({x, z, level, false});
+      return true;
+   }
+   // Children closer than the next finer range are refined, the others are drawn as a quarter of this node
+   const unsigned half = size / 2;
+   for (unsigned k = 0; k < 4; ++k) {
+      const unsigned childX = x + (k & 1) * half;
+      const unsigned childZ = z + (k >> 1) * half;
+      if (childX >= sizeX - 1 || childZ >= sizeY - 1) continue; // beyond the grid
+      if (select(childX, childZ, level - 1, camera, frustum)) continue;
+      pyramid.bounds(level - 1, childX / half, childZ / half, low, high);
+      if (frustum.intersects(low, high)) {
+         selection.push_back({childX, childZ, level, true});
+      } else {
+         ++stats.culledPatches;
+         stats.culledTriangles += 2ul * (patchSize / 2) * (patchSize / 2);
+      }
+   }
+   return true;
+}
+
+void LodQuadtree::Draw(Shader& shader, Camera& camera) {
+   // The camera rotates the terrain through its model matrix, the selection works in mesh coordinates
+   const glm::vec3 eye = glm::vec3(glm::inverse(camera.modelMatrix) * glm::vec4(camera.Position, 1.0f));
+
+   for (unsigned level = 0; level < levels; ++level) {
+      ranges[level] = detailDistance * float(1u << level);
+   }
+   ranges[levels - 1] = std::numeric_limits<float>::max(); // the roots are always drawn
+
+   selection.clear();
+   stats = PatchStats{};
+   const Frustum frustum = camera.frustum();
+   select(0, 0, levels - 1, eye, frustum);
+
+   shader.Activate();
+   glUniform3f(glGetUniformLocation(shader.ID, "camPos"), camera.Position.x, camera.Position.y, camera.Position.z);
+   glUniform3f(glGetUniformLocation(shader.ID, "lodCamera"), eye.x, eye.y, eye.z);
+   glUniform2i(glGetUniformLocation(shader.ID, "gridSize"), sizeX, sizeY);
+   glUniform1i(glGetUniformLocation(shader.ID, "heightMap"), heightUnit);
+   glUniform1i(glGetUniformLocation(shader.ID, "normalMap"), normalUnit);
+   camera.Matrix(shader, "camMatrix");
+   const GLint strideLocation = glGetUniformLocation(shader.ID, "lodStride");
+   const GLint patchLocation = glGetUniformLocation(shader.ID, "lodPatchSize");
+   const GLint originLocation = glGetUniformLocation(shader.ID, "lodOrigin");
+   const GLint morphLocation = glGetUniformLocation(shader.ID, "lodMorph");
+
+   glActiveTexture(GL_TEXTURE0 + heightUnit);
+   glBindTexture(GL_TEXTURE_2D, heightTexture);
+   glActiveTexture(GL_TEXTURE0 + normalUnit);
+   glBindTexture(GL_TEXTURE_2D, normalTexture);
+   glActiveTexture(GL_TEXTURE0);
+
+   // Full patches first, then the quarters, so every element buffer is bound once
+   for (const bool quarter : {false, true}) {
+      VAO& vao = quarter ? quarterVAO : fullVAO;
+      const GridIndices& indices = quarter ? *quarterIndices : *fullIndices;
+      const unsigned quads = quarter ? patchSize / 2 : patchSize;
+      vao.Bind();
+      glUniform1i(patchLocation, quads);
+      for (const Patch& patch : selection) {
+         if (patch.quarter != quarter) continue;
+         const float previous = patch.level == 0 ? 0.0f : ranges[patch.level - 1];
+         const float range = ranges[patch.level];
+         if (patch.level + 1 < levels) {
+            glUniform2f(morphLocation, previous + (range - previous) * morphStartRatio, range);
+         } else {
+            glUniform2f(morphLocation, 1e30f, 2e30f); // nothing coarser to morph to
+         }
+         glUniform1i(strideLocation, 1 << patch.level);
+         glUniform2i(originLocation, patch.x, patch.z);
+         indices.Draw();
+         ++stats.patches;
+         stats.triangles += 2ul * quads * quads;
+      }
+   }
+   quarterVAO.Unbind();
+}
@@ -1,10 +1,13 @@
 #include "Mesh.hpp"
+#include "GridNormals.hpp"
+#include "HeightmapExport.hpp"
 
+#include <algorithm>
+#include <cstddef>
 #include <filesystem>
 
 Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
-   Mesh::vertices = vertices;
-   Mesh::indices = indices;
+   Mesh::indices = std::make_shared<const std::vector<GLuint>>(indices);
 
    // Calculate size of the mesh by counting the vertices on the x axis, assuming the mesh is a rectangle and the vertices are ordered in a grid.
    sizeX = 0;
@@ -19,42 +22,21 @@ Mesh::Mesh(std::vector<Vertex>& vertices, std::vector<GLuint>& indices) {
 
    sizeY = vertices.size() / sizeX;
 
-   // Compute normals per face
-   for (size_t i = 0; i < indices.size(); i += 3) {
-      GLuint i0 = indices[i];
-      GLuint i1 = indices[i + 1];
-      GLuint i2 = indices[i + 2];
-
-      glm::vec3 v0 = vertices[i0].position;
-      glm::vec3 v1 = vertices[i1].position;
-      glm::vec3 v2 = vertices[i2].position;
-
-      // Compute the face normal
-      glm::vec3 normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
-
-      // Add the face normal to each vertex normal
-      vertices[i0].normal += normal;
-      vertices[i1].normal += normal;
-      vertices[i2].normal += normal;
+   // Only the heights are kept, the other coordinates follow from the grid
+   Mesh::vertices.resize(vertices.size());
+   for (size_t k = 0; k < vertices.size(); ++k) {
+      Mesh::vertices[k].height = vertices[k].position.y;
    }
 
-   // Normalize the vertex normals
-   for (auto& vertex : vertices) {
-      vertex.normal = glm::normalize(-vertex.normal);
-   }
+   computeNormals();
+   pyramid.build(Mesh::vertices, sizeX, sizeY);
+   setupBuffers();
 
+   // Arbitrary connectivity, so the mesh keeps its own index buffer
    myVAO.Bind();
-   VBO VBO(vertices);
-   EBO EBO(indices);
-
-   myVAO.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*) 0); // coordinates
-   myVAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*) (3 * sizeof(float))); // normal
-   myVAO.LinkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void*) (6 * sizeof(float))); // color
-   myVAO.LinkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*) (9 * sizeof(float))); // texture coordinates
-
+   myEBO.Data(Mesh::indices->data(), Mesh::indices->size() * sizeof(GLuint), GL_STATIC_DRAW);
    myVAO.Unbind();
-   VBO.Unbind();
-   EBO.Unbind();
+   myEBO.Unbind();
 }
 
 Mesh::Mesh(const std::vector<std::vector<double>>& matrix) {
@@ -64,115 +46,289 @@ Mesh::Mesh(const std::vector<std::vector<double>>& matrix) {
 
    unsigned numX = matrix.size() - 1;
    unsigned numY = matrix[0].size() - 1;
-   unsigned numVertices = (numX + 1) * (numY + 1);
-   unsigned numFaces = numX * numY;
-   std::vector<Vertex> _vertices(numVertices);
-   std::vector<GLuint> _indices(numFaces * 6);
-   float invNumX = 1.0f / numX;
-   float invNumY = 1.0f / numY;
+   vertices.resize(sizeX * sizeY);
 
    for (unsigned j = 0; j <= numY; ++j) {
       for (unsigned i = 0; i <= numX; ++i) {
-         glm::vec3 coordinates = glm::vec3(i * invNumX - 0.5f, matrix[i][j], j * invNumY - 0.5f);
-         glm::vec3 normal = glm::vec3(0.0f); //TODO: compute normal
-         glm::vec2 texCoordinates = glm::vec2(i * invNumX, j * invNumY);
-
-         _vertices[j * (numX + 1) + i] = Vertex{coordinates, normal, glm::vec3(0.3f, 0.70f, 0.44f), texCoordinates};
+         vertices[j * (numX + 1) + i].height = matrix[i][j];
       }
    }
-   for (unsigned j = 0, k = 0; j < numY; ++j) {
-      for (unsigned i = 0; i < numX; ++i) {
-         _indices[k] = j * (numX + 1) + i;
-         _indices[k + 1] = j * (numX + 1) + i + 1;
-         _indices[k + 2] = (j + 1) * (numX + 1) + i + 1;
-         _indices[k + 3] = (j + 1) * (numX + 1) + i + 1;
-         _indices[k + 4] = (j + 1) * (numX + 1) + i;
-         _indices[k + 5] = j * (numX + 1) + i;
-         k += 6;
-      }
+
+   computeGridNormals(vertices, sizeX, sizeY);
+   pyramid.build(vertices, sizeX, sizeY);
+   setupBuffers();
+   setupGridIndices(IndexMode::TRIANGLES);
+}
+
+GridMeshData buildGridMeshData(const std::vector<float>& heights, const unsigned numX, const unsigned numY) {
+   if (heights.size() != std::size_t(numX + 1) * (numY + 1)) {
+      throw std::invalid_argument("The number of heights does not match the grid.");
    }
+   GridMeshData data;
+   data.sizeX = numX + 1;
+   data.sizeY = numY + 1;
+   data.vertices.resize(heights.size());
+   for (size_t k = 0; k < heights.size(); ++k) {
+      data.vertices[k].height = heights[k];
+   }
+   computeGridNormals(data.vertices, data.sizeX, data.sizeY);
+   data.pyramid.build(data.vertices, data.sizeX, data.sizeY);
+   return data;
+}
 
-   Mesh::vertices = _vertices;
-   Mesh::indices = _indices;
+Mesh::Mesh(const std::vector<float>& heights, const unsigned numX, const unsigned numY, const IndexMode mode)
+   : Mesh(buildGridMeshData(heights, numX, numY), mode) {
+}
 
-   // Compute normals per face
-   for (size_t i = 0; i < indices.size(); i += 3) {
-      GLuint i0 = indices[i];
-      GLuint i1 = indices[i + 1];
-      GLuint i2 = indices[i + 2];
+Mesh::Mesh(GridMeshData&& data, const IndexMode mode) : vertices(std::move(data.vertices)), sizeX(data.sizeX), sizeY(data.sizeY), pyramid(std::move(data.pyramid)) {
+   setupBuffers();
+   setupGridIndices(mode);
+}
 
-      glm::vec3 v0 = vertices[i0].position;
-      glm::vec3 v1 = vertices[i1].position;
-      glm::vec3 v2 = vertices[i2].position;
+Mesh::~Mesh() {
+   myVAO.Delete();
+   myVBO.Delete();
+   backVBO.Delete();
+   myEBO.Delete();
+}
 
-      // Compute the face normal
-      glm::vec3 normal = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+std::shared_ptr<const std::vector<GLuint>> Mesh::triangles() const {
+   return gridIndices ? IndexCache::triangles(sizeX - 1, sizeY - 1) : indices;
+}
 
-      // Add the face normal to each vertex normal
-      vertices[i0].normal += normal;
-      vertices[i1].normal += normal;
-      vertices[i2].normal += normal;
-   }
+glm::vec3 Mesh::position(const size_t k) const {
+   const glm::vec2 uv = texUV(k);
+   return glm::vec3(uv.x - 0.5f, vertices[k].height, uv.y - 0.5f);
+}
 
-   // Normalize the vertex normals
-   for (auto& vertex : vertices) {
-      vertex.normal = glm::normalize(-vertex.normal);
-   }
+glm::vec3 Mesh::normal(const size_t k) const {
+   return unpackNormal(vertices[k].normal);
+}
 
+glm::vec2 Mesh::texUV(const size_t k) const {
+   // Same as TerrainVertex.glsl
+   const unsigned i = k % sizeX;
+   const unsigned j = k / sizeX;
+   return glm::vec2(i * (1.0f / (sizeX - 1)), j * (1.0f / (sizeY - 1)));
+}
+
+void Mesh::computeNormals() {
+   // In GridNormals.cpp, built with the same floating point flags as computeGridNormals
+   computeTriangleNormals(vertices, sizeX, sizeY, *indices);
+}
+
+void Mesh::setupBuffers() {
+   myVBO.Data(nullptr, vertices.size() * sizeof(TerrainVertex), GL_DYNAMIC_DRAW);
+   upload();
+   linkAttributes();
+}
+
+void Mesh::linkAttributes() {
+   myVAO.Bind();
+   myVAO.LinkAttrib(myVBO, 0, 1, GL_FLOAT, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, height)); // height
+   myVAO.LinkAttrib(myVBO, 1, 2, GL_SHORT, sizeof(TerrainVertex), (void*) offsetof(TerrainVertex, normal), GL_TRUE); // packed normal
+   myVAO.Unbind();
+}
+
+void Mesh::setupGridIndices(const IndexMode mode) {
+   gridIndices = IndexCache::gpu(sizeX - 1, sizeY - 1, mode);
+   if (customCount > 0) return; // bound again when the custom triangles are dropped
    myVAO.Bind();
-   VBO VBO(vertices);
-   EBO EBO(indices);
+   gridIndices->Bind();
+   myVAO.Unbind();
+   myEBO.Unbind();
+}
 
-   myVAO.LinkAttrib(VBO, 0, 3, GL_FLOAT, sizeof(Vertex), (void*) 0); // coordinates
-   myVAO.LinkAttrib(VBO, 1, 3, GL_FLOAT, sizeof(Vertex), (void*) (3 * sizeof(float))); // normal
-   myVAO.LinkAttrib(VBO, 2, 3, GL_FLOAT, sizeof(Vertex), (void*) (6 * sizeof(float))); // color
-   myVAO.LinkAttrib(VBO, 3, 2, GL_FLOAT, sizeof(Vertex), (void*) (9 * sizeof(float))); // texture coordinates
+void Mesh::setIndexMode(const IndexMode mode) {
+   if (!gridIndices || gridIndices->getMode() == mode) return;
+   setupGridIndices(mode);
+}
 
+void Mesh::setTriangles(const std::vector<GLuint>& triangles) {
+   if (!gridIndices) {
+      throw std::runtime_error("Only grid meshes can draw a different triangulation.");
+   }
+   const bool wasCustom = customCount > 0;
+   customCount = triangles.size();
+   if (customCount == 0) {
+      if (wasCustom) {
+         setupGridIndices(gridIndices->getMode());
+      }
+      return;
+   }
+   myVAO.Bind();
+   myEBO.Data(triangles.data(), triangles.size() * sizeof(GLuint), GL_DYNAMIC_DRAW);
    myVAO.Unbind();
-   VBO.Unbind();
-   EBO.Unbind();
+   myEBO.Unbind();
+}
+
+void Mesh::upload() {
+   const GLsizeiptr size = vertices.size() * sizeof(TerrainVertex);
+   // Orphan the old storage first, so the driver does not wait for frames still drawing from it
+   myVBO.Data(nullptr, size, GL_DYNAMIC_DRAW);
+   myVBO.SubData(0, size, vertices.data());
+   myVBO.Unbind();
+}
+
+void Mesh::updateHeights(const std::vector<float>& heights) {
+   if (heights.size() != vertices.size()) {
+      throw std::invalid_argument("The number of vertices must not change when updating a mesh.");
+   }
+   for (size_t k = 0; k < heights.size(); ++k) {
+      vertices[k].height = heights[k];
+   }
+   if (gridIndices) {
+      computeGridNormals(vertices, sizeX, sizeY);
+   } else {
+      computeNormals();
+   }
+   pyramid.build(vertices, sizeX, sizeY);
+   upload();
+}
+
+void Mesh::beginUpdate(GridMeshData&& data) {
+   if (!gridIndices) {
+      throw std::invalid_argument("Only grid meshes can be updated from prepared vertices.");
+   }
+   pending.emplace(std::move(data));
+   uploadedBytes = 0;
+}
+
+bool Mesh::continueUpload(const std::size_t maxBytes) {
+   if (!pending.has_value()) return false;
+   const std::size_t size = pending->vertices.size() * sizeof(TerrainVertex);
+   if (uploadedBytes == 0) {
+      // Orphan the storage, the previous frames may still draw from it when it was the front buffer
+      backVBO.Data(nullptr, size, GL_DYNAMIC_DRAW);
+   }
+   const std::size_t count = std::min(std::max<std::size_t>(maxBytes, 1), size - uploadedBytes);
+   backVBO.SubData(uploadedBytes, count, reinterpret_cast<const char*>(pending->vertices.data()) + uploadedBytes);
+   backVBO.Unbind();
+   uploadedBytes += count;
+   if (uploadedBytes < size) return false;
+
+   std::swap(myVBO, backVBO);
+   linkAttributes();
+   const bool reshaped = pending->sizeX != sizeX || pending->sizeY != sizeY;
+   sizeX = pending->sizeX;
+   sizeY = pending->sizeY;
+   vertices = std::move(pending->vertices);
+   pyramid = std::move(pending->pyramid);
+   pending.reset();
+   if (reshaped) {
+      // The custom triangles belong to the old grid
+      customCount = 0;
+      setupGridIndices(gridIndices->getMode());
+   }
+   return true;
 }
 
 void Mesh::Draw(Shader& shader, Camera& camera) {
    shader.Activate();
    myVAO.Bind();
    glUniform3f(glGetUniformLocation(shader.ID, "camPos"), camera.Position.x, camera.Position.y, camera.Position.z);
+   glUniform2i(glGetUniformLocation(shader.ID, "gridSize"), sizeX, sizeY);
+   glUniform1i(glGetUniformLocation(shader.ID, "lodStride"), 0); // the whole grid, not a patch of the LodQuadtree
    camera.Matrix(shader, "camMatrix");
-   glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-}
+   stats = PatchStats{};
+   if (!gridIndices) {
+      glDrawElements(GL_TRIANGLES, indices->size(), GL_UNSIGNED_INT, 0);
+      stats.triangles = indices->size() / 3;
+      return;
+   }
+   if (customCount > 0) {
+      glDrawElements(GL_TRIANGLES, customCount, GL_UNSIGNED_INT, 0);
+      stats.triangles = customCount / 3;
+      return;
+   }
+   if (!frustumCulling) {
+      gridIndices->Draw();
+      stats.patches = pyramid.cellsX(0) * pyramid.cellsZ(0);
+      stats.triangles = 2ul * (sizeX - 1) * (sizeY - 1);
+      return;
+   }
 
-void ExportToObj(const Mesh& mesh, const std::string& filename) {
-   std::ofstream file(filename);
+   // Walk down the pyramid from the cell covering the whole grid, then merge visible cells next to each other into one region
+   visibleCells.assign(std::size_t(pyramid.cellsX(0)) * pyramid.cellsZ(0), 0);
+   cullCell(camera.frustum(), pyramid.getLevels() - 1, 0, 0);
+   visibleRegions.clear();
+   const unsigned cellSize = HeightPyramid::cellSize;
+   for (unsigned cellZ = 0; cellZ < pyramid.cellsZ(0); ++cellZ) {
+      const char* row = visibleCells.data() + std::size_t(cellZ) * pyramid.cellsX(0);
+      for (unsigned cellX = 0; cellX < pyramid.cellsX(0);) {
+         if (!row[cellX]) {
+            ++cellX;
+            continue;
+         }
+         const unsigned first = cellX;
+         while (cellX < pyramid.cellsX(0) && row[cellX]) {
+            ++cellX;
+         }
+         const QuadRegion region{first * cellSize, cellZ * cellSize, std::min<unsigned>(cellX * cellSize, sizeX - 1),
+                                 std::min<unsigned>((cellZ + 1) * cellSize, sizeY - 1)};
+         visibleRegions.push_back(region);
+         stats.patches += cellX - first;
+         stats.triangles += 2ul * (region.x1 - region.x0) * (region.z1 - region.z0);
+      }
+   }
+   gridIndices->DrawRegions(visibleRegions);
+}
 
-   if (!file.is_open()) {
-      std::cerr << "Failed to open file: " << filename << std::endl;
+void Mesh::cullCell(const Frustum& frustum, const unsigned level, const unsigned cellX, const unsigned cellZ) {
+   glm::vec3 low, high;
+   pyramid.bounds(level, cellX, cellZ, low, high);
+   if (!frustum.intersects(low, high)) {
+      // Everything below is culled, count its level 0 cells and quads
+      const unsigned firstX = cellX << level, firstZ = cellZ << level;
+      const unsigned lastX = std::min((cellX + 1) << level, pyramid.cellsX(0));
+      const unsigned lastZ = std::min((cellZ + 1) << level, pyramid.cellsZ(0));
+      const unsigned long quadsX = std::min<unsigned long>(lastX * HeightPyramid::cellSize, sizeX - 1) - firstX * HeightPyramid::cellSize;
+      const unsigned long quadsZ = std::min<unsigned long>(lastZ * HeightPyramid::cellSize, sizeY - 1) - firstZ * HeightPyramid::cellSize;
+      stats.culledPatches += (lastX - firstX) * (lastZ - firstZ);
+      stats.culledTriangles += 2 * quadsX * quadsZ;
       return;
    }
-
-   // Write vertex positions
-   for (const auto& vertex : mesh.vertices) {
-      file << "v " << vertex.position.x << " " << vertex.position.y << " " << vertex.position.z << "\n";
+   if (level == 0) {
+      visibleCells[std::size_t(cellZ) * pyramid.cellsX(0) + cellX] = 1;
+      return;
    }
-   // Write normals
-   for (const auto& vertex : mesh.vertices) {
-      file << "vn " << vertex.normal.x << " " << vertex.normal.y << " " << vertex.normal.z << "\n";
+   for (unsigned childZ = 2 * cellZ; childZ < std::min(2 * cellZ + 2, pyramid.cellsZ(level - 1)); ++childZ) {
+      for (unsigned childX = 2 * cellX; childX < std::min(2 * cellX + 2, pyramid.cellsX(level - 1)); ++childX) {
+         cullCell(frustum, level - 1, childX, childZ);
+      }
    }
+}
 
-   // Write texture coordinates
-   for (const auto& vertex : mesh.vertices) {
-      file << "vt " << vertex.texUV.x << " " << vertex.texUV.y << "\n";
+QuadRegion Mesh::viewBounds(const Frustum& frustum) const {
+   if (!gridIndices) {
+      return QuadRegion{0, 0, unsigned(sizeX - 1), unsigned(sizeY - 1)};
    }
-
-   // Write faces
-   for (size_t i = 0; i < mesh.indices.size(); i += 3) {
-      file << "f "
-           << (mesh.indices[i] + 1) << "/" << (mesh.indices[i] + 1) << "/" << (mesh.indices[i] + 1) << " "
-           << (mesh.indices[i + 1] + 1) << "/" << (mesh.indices[i + 1] + 1) << "/" << (mesh.indices[i + 1] + 1) << " "
-           << (mesh.indices[i + 2] + 1) << "/" << (mesh.indices[i + 2] + 1) << "/" << (mesh.indices[i + 2] + 1) << "\n";
+   QuadRegion cells{~0u, ~0u, 0, 0};
+   boundCell(frustum, pyramid.getLevels() - 1, 0, 0, cells);
+   if (cells.x0 >= cells.x1) {
+      return QuadRegion{0, 0, 0, 0};
    }
+   const unsigned cellSize = HeightPyramid::cellSize;
+   return QuadRegion{cells.x0 * cellSize, cells.z0 * cellSize, std::min<unsigned>(cells.x1 * cellSize, sizeX - 1),
+                     std::min<unsigned>(cells.z1 * cellSize, sizeY - 1)};
+}
 
-   file.close();
-   std::cout << "Mesh exported to " << filename << " successfully." << std::endl;
+void Mesh::boundCell(const Frustum& frustum, const unsigned level, const unsigned cellX, const unsigned cellZ, QuadRegion& cells) const {
+   glm::vec3 low, high;
+   pyramid.bounds(level, cellX, cellZ, low, high);
+   if (!frustum.intersects(low, high)) return;
+   if (level == 0) {
+      cells.x0 = std::min(cells.x0, cellX);
+      cells.z0 = std::min(cells.z0, cellZ);
+      cells.x1 = std::max(cells.x1, cellX + 1);
+      cells.z1 = std::max(cells.z1, cellZ + 1);
+      return;
+   }
+   for (unsigned childZ = 2 * cellZ; childZ < std::min(2 * cellZ + 2, pyramid.cellsZ(level - 1)); ++childZ) {
+      for (unsigned childX = 2 * cellX; childX < std::min(2 * cellX + 2, pyramid.cellsX(level - 1)); ++childX) {
+         boundCell(frustum, level - 1, childX, childZ, cells);
+      }
+   }
 }
 
 void Mesh::exportToPNG(const std::string& filename) const {
@@ -182,7 +338,7 @@ void Mesh::exportToPNG(const std::string& filename) const {
    for (unsigned x = 0; x < sizeX; x++) {
       for (unsigned y = 0; y < sizeY; y++) {
          unsigned index = 4 * sizeX * y + 4 * x;
-         int value = (255 * vertices[y * sizeX + x].position.y);
+         int value = (255 * vertices[y * sizeX + x].height);
          value = (value < 0) ? 0 : value;
          image[index] = (unsigned char) value;
          image[index + 1] = (unsigned char) value;
@@ -202,23 +358,5 @@ void Mesh::exportToPNG(const std::string& filename) const {
 }
 
 void Mesh::exportToPPM(const std::string& filename) const {
-   // Open stream to file
-   std::ofstream file(filename, std::ios::trunc);
-   if (!file.is_open()) {
-      throw std::runtime_error("Could not open file");
-   }
-
-   // Write file header
-   file << "P3 " << sizeX << " " << sizeY << " 255\n";
-
-   // Write file content
-   for (unsigned x = 0; x < sizeX; x++) {
-      for (unsigned y = 0; y < sizeY; y++) {
-         int value = (255 * vertices[y * sizeX + x].position.y);
-         value = (value < 0) ? 0 : value;
-         file << value << " " << value << " " << value << " ";
-      }
-   }
-
-   file.close();
+   ExportHeightmapNetpbm(HeightGrid::of(*this), filename, NetpbmFormat::PPM, 8);
 }
@@ -0,0 +1,444 @@
+#include "MeshExport.hpp"
+#include "FileParts.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <json.hpp>
+#include <memory>
+
+namespace {
+
+/// @brief Lines formatted per band, a band is a few MB of text
+const std::size_t bandLines = 1 << 16;
+
+/// @brief Room for the longest line of an .obj file written here
+const std::size_t maxLineLength = 128;
+
+/**
+ * Format the lines [0, count) and append them to the file in order.
+ * Every round formats one band of lines per thread into the buffer of that band, then the buffers are written
+ * one after the other. So the memory stays bounded by the number of threads, not by the size of the file.
+ * @param format callable (char* out, std::size_t line) writing the line (at most maxLineLength chars) and returning its end
+ */
+template <typename Format>
+void writeLines(std::ofstream& file, const std::size_t count, Format&& format) {
+   const std::size_t workers = perlin::workerCount();
+   // Not initialized, every band only writes its lines
+   std::vector<std::unique_ptr<char[]>> buffers(workers);
+   std::vector<std::size_t> sizes(workers);
+   for (std::size_t first = 0; first < count; first += workers * bandLines) {
+      const std::size_t bands = std::min(workers, (count - first + bandLines - 1) / bandLines);
+      perlin::parallelFor(0, bands, 1, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t band = begin; band < end; ++band) {
+            if (!buffers[band]) {
+               buffers[band].reset(new char[bandLines * maxLineLength]);
+            }
+            const std::size_t lineBegin = first + band * bandLines;
+            const std::size_t lineEnd = std::min(lineBegin + bandLines, count);
+            char* out = buffers[band].get();
+            for (std::size_t line = lineBegin; line < lineEnd; ++line) {
+               out = format(out, line);
+            }
+            sizes[band] = out - buffers[band].get();
+         }
+      });
+      for (std::size_t band = 0; band < bands; ++band) {
+         file.write(buffers[band].get(), sizes[band]);
+      }
+   }
+}
+
+/// @brief A space and the number, with the given significant digits or the shortest exact text for 0 digits
+inline char* putFloat(char* out, const float value, const int precision) {
+   *out++ = ' ';
+   // 16 chars hold any float with up to 9 digits, e.g. -1.23456789e-38
+   return (precision > 0 ? std::to_chars(out, out + 16, value, std::chars_format::general, precision) : std::to_chars(out, out + 16, value)).ptr;
+}
+
+/// @brief A space and the index of a vertex in every attribute that is written, e.g. 7/7/7 or 7//7
+inline char* putCorner(char* out, const GLuint index, const ObjOptions& options) {
+   *out++ = ' ';
+   out = std::to_chars(out, out + 10, index).ptr;
+   if (!options.texCoords && !options.normals) return out;
+   *out++ = '/';
+   if (options.texCoords) {
+      out = std::to_chars(out, out + 10, index).ptr;
+   }
+   if (options.normals) {
+      *out++ = '/';
+      out = std::to_chars(out, out + 10, index).ptr;
+   }
+   return out;
+}
+
+/// @brief Vertices used by some triangles of a mesh, in the order of the mesh
+struct UsedVertices {
+   std::size_t count = 0;
+   std::vector<std::size_t> used; // mesh vertex of every exported vertex, empty if all vertices are used
+   std::vector<GLuint> indices; // triangles in the numbering of the exported vertices, empty if all vertices are used
+
+   std::size_t vertex(const std::size_t k) const {
+      return used.empty() ? k : used[k];
+   }
+
+   /// @brief Triangles to write, the ones of the mesh themselves if all vertices are used
+   const std::vector<GLuint>& triangles(const std::vector<GLuint>& meshTriangles) const {
+      return used.empty() ? meshTriangles : indices;
+   }
+};
+
+UsedVertices selectVertices(const Mesh& mesh, const std::vector<GLuint>& triangles) {
+   UsedVertices selection;
+   std::vector<GLuint> number(mesh.vertices.size(), 0);
+   for (const GLuint k : triangles) {
+      number[k] = 1;
+   }
+   for (std::size_t k = 0; k < mesh.vertices.size(); ++k) {
+      if (number[k] != 0) {
+         number[k] = selection.count++;
+         selection.used.push_back(k);
+      }
+   }
+   if (selection.count == mesh.vertices.size()) {
+      selection.used = {};
+      return selection;
+   }
+   selection.indices.resize(triangles.size());
+   perlin::parallelFor(0, triangles.size(), 1 << 16, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t i = begin; i < end; ++i) {
+         selection.indices[i] = number[triangles[i]];
+      }
+   });
+   return selection;
+}
+
+/// @brief Fill out[0, count) with item(k) on all threads
+template <typename T, typename Item>
+void fillParallel(std::vector<T>& out, const std::size_t count, Item&& item) {
+   out.resize(count);
+   perlin::parallelFor(0, count, 1 << 14, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t k = begin; k < end; ++k) {
+         out[k] = item(k);
+      }
+   });
+}
+
+/// @brief Report a finished export with its duration
+void reportExport(const std::string& filename, const std::chrono::high_resolution_clock::time_point start) {
+   std::chrono::duration<double> seconds = std::chrono::high_resolution_clock::now() - start;
+   std::cout << "Mesh exported to " << filename << " successfully in " << seconds.count() << "s." << std::endl;
+}
+
+/// @brief value in [-1, 1] as a normalized 16-bit integer
+inline std::int16_t quantizeSigned(const float value) {
+   return static_cast<std::int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+/// @brief value in [0, 1] as a normalized unsigned 16-bit integer
+inline std::uint16_t quantizeUnsigned(const float value) {
+   return static_cast<std::uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+/// @brief Vertex of the compact PLY layout, the normal as stored in TerrainVertex
+struct CompactPlyVertex {
+   float x, y, z;
+   std::int16_t normal[2];
+};
+static_assert(sizeof(CompactPlyVertex) == 16, "PLY properties are written without padding");
+
+} // namespace
+
+void ExportToObj(const Mesh& mesh, const std::string& filename, const ObjOptions& options) {
+   ExportToObj(mesh, filename, *mesh.triangles(), options);
+}
+
+void ExportToObj(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const ObjOptions& options) {
+   auto start = std::chrono::high_resolution_clock::now();
+   std::ofstream file(filename, std::ios::binary);
+
+   if (!file.is_open()) {
+      std::cerr << "Failed to open file: " << filename << std::endl;
+      return;
+   }
+   const int precision = std::clamp(options.precision, 0, 9);
+
+   // The used vertices in the order of the mesh, numbered from 1 in the .obj format
+   const UsedVertices selection = selectVertices(mesh, triangles);
+   const std::vector<GLuint>& faces = selection.triangles(triangles);
+
+   // Write vertex positions
+   writeLines(file, selection.count, [&](char* out, const std::size_t line) {
+      const glm::vec3 position = mesh.position(selection.vertex(line));
+      *out++ = 'v';
+      out = putFloat(out, position.x, precision);
+      out = putFloat(out, position.y, precision);
+      out = putFloat(out, position.z, precision);
+      *out++ = '\n';
+      return out;
+   });
+   // Write normals
+   if (options.normals) {
+      writeLines(file, selection.count, [&](char* out, const std::size_t line) {
+         const glm::vec3 normal = mesh.normal(selection.vertex(line));
+         *out++ = 'v';
+         *out++ = 'n';
+         out = putFloat(out, normal.x, precision);
+         out = putFloat(out, normal.y, precision);
+         out = putFloat(out, normal.z, precision);
+         *out++ = '\n';
+         return out;
+      });
+   }
+   // Write texture coordinates
+   if (options.texCoords) {
+      writeLines(file, selection.count, [&](char* out, const std::size_t line) {
+         const glm::vec2 texUV = mesh.texUV(selection.vertex(line));
+         *out++ = 'v';
+         *out++ = 't';
+         out = putFloat(out, texUV.x, precision);
+         out = putFloat(out, texUV.y, precision);
+         *out++ = '\n';
+         return out;
+      });
+   }
+   // Write faces
+   writeLines(file, triangles.size() / 3, [&](char* out, const std::size_t line) {
+      *out++ = 'f';
+      for (std::size_t corner = 3 * line; corner < 3 * line + 3; ++corner) {
+         out = putCorner(out, faces[corner] + 1, options);
+      }
+      *out++ = '\n';
+      return out;
+   });
+
+   file.close();
+   if (!file) {
+      std::cerr << "Failed to write file: " << filename << std::endl;
+      return;
+   }
+   reportExport(filename, start);
+}
+
+void ExportToGlb(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const BinaryMeshOptions& options) {
+   auto start = std::chrono::high_resolution_clock::now();
+   if (!littleEndianHost()) {
+      std::cerr << "Failed to export " << filename << ": .glb files are little endian, this host is not" << std::endl;
+      return;
+   }
+   const UsedVertices selection = selectVertices(mesh, triangles);
+   const std::vector<GLuint>& indices = selection.triangles(triangles);
+   const std::size_t count = selection.count;
+   if (count == 0) {
+      std::cerr << "Failed to export " << filename << ": no triangles" << std::endl;
+      return;
+   }
+
+   // Bounds of the positions
+   glm::vec3 low = mesh.position(selection.vertex(0)), high = low;
+   for (std::size_t k = 1; k < count; ++k) {
+      const glm::vec3 position = mesh.position(selection.vertex(k));
+      low = glm::min(low, position);
+      high = glm::max(high, position);
+   }
+   const glm::vec3 center = 0.5f * (low + high);
+   glm::vec3 extent = 0.5f * (high - low);
+   for (int axis = 0; axis < 3; ++axis) {
+      extent[axis] = extent[axis] > 0.0f ? extent[axis] : 1.0f;
+   }
+
+   // One buffer view per attribute, filled in parallel. Compact vertex attributes are padded to 4 components,
+   // since strides are multiples of 4 bytes
+   std::vector<glm::vec3> positions, normals;
+   std::vector<glm::vec2> texUVs;
+   std::vector<std::array<std::int16_t, 4>> compactPositions, compactNormals;
+   std::vector<std::array<std::uint16_t, 2>> compactTexUVs;
+   nlohmann::json attributes, accessors = nlohmann::json::array(), bufferViews = nlohmann::json::array();
+   std::vector<FilePart> bin;
+   std::size_t binLength = 0;
+   auto addView = [&](const void* data, const std::size_t size, const int target, const int stride) {
+      nlohmann::json view = {{"buffer", 0}, {"byteOffset", binLength}, {"byteLength", size}, {"target", target}};
+      if (stride > 0) {
+         view["byteStride"] = stride;
+      }
+      bufferViews.push_back(view);
+      bin.push_back({data, size});
+      binLength += size; // all sizes are multiples of 4
+      return bufferViews.size() - 1;
+   };
+   auto addAccessor = [&](const std::size_t view, const int componentType, const std::size_t elements, const char* type, const bool normalized) {
+      accessors.push_back({{"bufferView", view}, {"componentType", componentType}, {"count", elements}, {"type", type}});
+      if (normalized) {
+         accessors.back()["normalized"] = true;
+      }
+      return accessors.size() - 1;
+   };
+   const int FLOAT = 5126, SHORT = 5122, UNSIGNED_SHORT = 5123, UNSIGNED_INT = 5125;
+   const int ARRAY_BUFFER = 34962, ELEMENT_ARRAY_BUFFER = 34963;
+
+   if (options.compact) {
+      fillParallel(compactPositions, count, [&](const std::size_t k) {
+         const glm::vec3 q = (mesh.position(selection.vertex(k)) - center) / extent;
+         return std::array<std::int16_t, 4>{quantizeSigned(q.x), quantizeSigned(q.y), quantizeSigned(q.z), 0};
+      });
+      // The bounds of normalized accessors are given as stored
+      std::array<int, 3> qLow{32767, 32767, 32767}, qHigh{-32767, -32767, -32767};
+      for (const auto& q : compactPositions) {
+         for (int axis = 0; axis < 3; ++axis) {
+            qLow[axis] = std::min<int>(qLow[axis], q[axis]);
+            qHigh[axis] = std::max<int>(qHigh[axis], q[axis]);
+         }
+      }
+      attributes["POSITION"] = addAccessor(addView(compactPositions.data(), count * 8, ARRAY_BUFFER, 8), SHORT, count, "VEC3", true);
+      accessors.back()["min"] = qLow;
+      accessors.back()["max"] = qHigh;
+      if (options.normals) {
+         // Normals transform with the inverse transpose of the node scale, so they are stored scaled by the extent
+         fillParallel(compactNormals, count, [&](const std::size_t k) {
+            const glm::vec3 n = glm::normalize(mesh.normal(selection.vertex(k)) * extent);
+            return std::array<std::int16_t, 4>{quantizeSigned(n.x), quantizeSigned(n.y), quantizeSigned(n.z), 0};
+         });
+         attributes["NORMAL"] = addAccessor(addView(compactNormals.data(), count * 8, ARRAY_BUFFER, 8), SHORT, count, "VEC3", true);
+      }
+      if (options.texCoords) {
+         fillParallel(compactTexUVs, count, [&](const std::size_t k) {
+            const glm::vec2 uv = mesh.texUV(selection.vertex(k));
+            return std::array<std::uint16_t, 2>{quantizeUnsigned(uv.x), quantizeUnsigned(uv.y)};
+         });
+         attributes["TEXCOORD_0"] = addAccessor(addView(compactTexUVs.data(), count * 4, ARRAY_BUFFER, 4), UNSIGNED_SHORT, count, "VEC2", true);
+      }
+   } else {
+      fillParallel(positions, count, [&](const std::size_t k) { return mesh.position(selection.vertex(k)); });
+      attributes["POSITION"] = addAccessor(addView(positions.data(), count * 12, ARRAY_BUFFER, 0), FLOAT, count, "VEC3", false);
+      accessors.back()["min"] = {low.x, low.y, low.z};
+      accessors.back()["max"] = {high.x, high.y, high.z};
+      if (options.normals) {
+         fillParallel(normals, count, [&](const std::size_t k) { return mesh.normal(selection.vertex(k)); });
+         attributes["NORMAL"] = addAccessor(addView(normals.data(), count * 12, ARRAY_BUFFER, 0), FLOAT, count, "VEC3", false);
+      }
+      if (options.texCoords) {
+         fillParallel(texUVs, count, [&](const std::size_t k) { return mesh.texUV(selection.vertex(k)); });
+         attributes["TEXCOORD_0"] = addAccessor(addView(texUVs.data(), count * 8, ARRAY_BUFFER, 0), FLOAT, count, "VEC2", false);
+      }
+   }
+   // The triangles of the mesh are written as they are
+   const std::size_t indexAccessor = addAccessor(addView(indices.data(), indices.size() * sizeof(GLuint), ELEMENT_ARRAY_BUFFER, 0), UNSIGNED_INT, indices.size(), "SCALAR", false);
+
+   nlohmann::json node = {{"mesh", 0}};
+   nlohmann::json gltf = {
+      {"asset", {{"version", "2.0"}, {"generator", "Procedural-Terrain-Generation"}}},
+      {"scene", 0},
+      {"scenes", {{{"nodes", {0}}}}},
+      {"meshes", {{{"primitives", {{{"attributes", attributes}, {"indices", indexAccessor}, {"mode", 4}}}}}}},
+      {"accessors", accessors},
+      {"bufferViews", bufferViews},
+      {"buffers", {{{"byteLength", binLength}}}},
+   };
+   if (options.compact) {
+      node["translation"] = {center.x, center.y, center.z};
+      node["scale"] = {extent.x, extent.y, extent.z};
+      gltf["extensionsUsed"] = {"KHR_mesh_quantization"};
+      gltf["extensionsRequired"] = {"KHR_mesh_quantization"};
+   }
+   gltf["nodes"] = {node};
+
+   // Header, JSON chunk (padded with spaces) and the header of the binary chunk, followed by the buffer views
+   std::string json = gltf.dump();
+   json.resize((json.size() + 3) / 4 * 4, ' ');
+   auto put32 = [](std::string& out, const std::uint32_t value) {
+      out.append(reinterpret_cast<const char*>(&value), 4);
+   };
+   std::string head;
+   put32(head, 0x46546C67); // "glTF"
+   put32(head, 2);
+   put32(head, 12 + 8 + json.size() + 8 + binLength);
+   put32(head, json.size());
+   put32(head, 0x4E4F534A); // "JSON"
+   head += json;
+   put32(head, binLength);
+   put32(head, 0x004E4942); // "BIN"
+   bin.insert(bin.begin(), FilePart{head.data(), head.size()});
+   if (writeFileParts(filename, bin)) {
+      reportExport(filename, start);
+   }
+}
+
+void ExportToPly(const Mesh& mesh, const std::string& filename, const std::vector<GLuint>& triangles, const BinaryMeshOptions& options) {
+   auto start = std::chrono::high_resolution_clock::now();
+   const UsedVertices selection = selectVertices(mesh, triangles);
+   const std::vector<GLuint>& indices = selection.triangles(triangles);
+
+   std::string header = "ply\n";
+   header += littleEndianHost() ? "format binary_little_endian 1.0\n" : "format binary_big_endian 1.0\n";
+   header += "comment Procedural-Terrain-Generation\n";
+   std::vector<float> vertices;
+   std::vector<CompactPlyVertex> compactVertices;
+   FilePart vertexPart{nullptr, 0};
+   if (options.compact) {
+      compactVertices.resize(selection.count);
+      perlin::parallelFor(0, selection.count, 1 << 14, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t k = begin; k < end; ++k) {
+            const std::size_t vertex = selection.vertex(k);
+            const glm::vec3 position = mesh.position(vertex);
+            compactVertices[k] = {position.x, position.y, position.z, {mesh.vertices[vertex].normal[0], mesh.vertices[vertex].normal[1]}};
+         }
+      });
+      vertexPart = FilePart{compactVertices.data(), compactVertices.size() * sizeof(CompactPlyVertex)};
+      header += "comment normal_u, normal_v: octahedron encoded unit normal, signed normalized\n";
+      header += "element vertex " + std::to_string(selection.count) + "\n";
+      header += "property float x\nproperty float y\nproperty float z\nproperty short normal_u\nproperty short normal_v\n";
+   } else {
+      // Interleaved floats, filled in parallel
+      const std::size_t stride = 3 + (options.normals ? 3 : 0) + (options.texCoords ? 2 : 0);
+      vertices.resize(selection.count * stride);
+      perlin::parallelFor(0, selection.count, 1 << 14, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t k = begin; k < end; ++k) {
+            float* out = vertices.data() + k * stride;
+            const glm::vec3 position = mesh.position(selection.vertex(k));
+            *out++ = position.x, *out++ = position.y, *out++ = position.z;
+            if (options.normals) {
+               const glm::vec3 normal = mesh.normal(selection.vertex(k));
+               *out++ = normal.x, *out++ = normal.y, *out++ = normal.z;
+            }
+            if (options.texCoords) {
+               const glm::vec2 texUV = mesh.texUV(selection.vertex(k));
+               *out++ = texUV.x, *out++ = texUV.y;
+            }
+         }
+      });
+      vertexPart = FilePart{vertices.data(), vertices.size() * sizeof(float)};
+      header += "element vertex " + std::to_string(selection.count) + "\n";
+      header += "property float x\nproperty float y\nproperty float z\n";
+      if (options.normals) {
+         header += "property float nx\nproperty float ny\nproperty float nz\n";
+      }
+      if (options.texCoords) {
+         header += "property float s\nproperty float t\n";
+      }
+   }
+   const std::size_t numFaces = indices.size() / 3;
+   header += "element face " + std::to_string(numFaces) + "\n";
+   header += "property list uchar uint vertex_indices\nend_header\n";
+
+   // Every face is its count followed by the 3 indices, 13 bytes without padding
+   const std::size_t faceSize = 1 + 3 * sizeof(GLuint);
+   std::unique_ptr<char[]> faces(new char[numFaces * faceSize]);
+   perlin::parallelFor(0, numFaces, 1 << 14, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t f = begin; f < end; ++f) {
+         char* out = faces.get() + f * faceSize;
+         out[0] = 3;
+         std::memcpy(out + 1, indices.data() + 3 * f, 3 * sizeof(GLuint));
+      }
+   });
+
+   if (writeFileParts(filename, {{header.data(), header.size()}, vertexPart, {faces.get(), numFaces * faceSize}})) {
+      reportExport(filename, start);
+   }
+}
@@ -0,0 +1,211 @@
+#include "Rtin.hpp"
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+const float infinity = std::numeric_limits<float>::infinity();
+
+/// @brief Depth of the triangle hierarchy at which the traversal is split into tasks for the threads
+const unsigned taskDepth = 10;
+
+/// @brief Whether the open interval (low, high) contains the limit, i.e. a triangle spanning it crosses the border
+inline bool crosses(const long low, const long high, const long limit) {
+   return low < limit && limit < high;
+}
+
+} // namespace
+
+Rtin::Rtin(const std::vector<TerrainVertex>& vertices, const unsigned long sizeX, const unsigned long sizeY) : sizeX(sizeX), sizeY(sizeY) {
+   const long numX = sizeX - 1;
+   const long numY = sizeY - 1;
+   size = 1;
+   while (size < numX || size < numY) {
+      size *= 2;
+   }
+   const std::size_t stride = size + 1;
+   errors.assign(stride * stride, 0.0f);
+
+   auto height = [&](const long x, const long y) {
+      return vertices[y * sizeX + x].height;
+   };
+   auto error = [&](const long x, const long y) {
+      return errors[y * stride + x];
+   };
+   // Error of a vertex inside the grid splitting the hypotenuse a-b, vertices outside the grid never end up in a triangle
+   auto interpolationError = [&](const long mx, const long my, const long ax, const long ay, const long bx, const long by) {
+      if (mx > numX || my > numY) return 0.0f;
+      return std::abs(height(mx, my) - 0.5f * (height(ax, ay) + height(bx, by)));
+   };
+
+   // Finest to coarsest: the vertices splitting an axis aligned hypotenuse of length 2h depend on the centers of the squares
+   // of size h around them, the centers of the squares of size 2h on the vertices splitting their edges.
+   // Within one step all vertices are independent, so the rows are split between the threads.
+   const long n = size;
+   for (long h = 1; h < n; h *= 2) {
+      const std::size_t minBand = std::max<std::size_t>(1, 16384 / (n / h + 1));
+      perlin::parallelFor(0, n / h + 1, minBand, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t row = begin; row < end; ++row) {
+            const long y = row * h;
+            const bool horizontal = (y / h) % 2 == 0; // hypotenuse along x, otherwise along y
+            for (long x = horizontal ? h : 0; x <= n; x += 2 * h) {
+               float value;
+               if (horizontal) {
+                  const bool crossing = crosses(x - h, x + h, numX) || (y >= h && crosses(y - h, y, numY)) || (y + h <= n && crosses(y, y + h, numY));
+                  value = crossing ? infinity : interpolationError(x, y, x - h, y, x + h, y);
+               } else {
+                  const bool crossing = crosses(y - h, y + h, numY) || (x >= h && crosses(x - h, x, numX)) || (x + h <= n && crosses(x, x + h, numX));
+                  value = crossing ? infinity : interpolationError(x, y, x, y - h, x, y + h);
+               }
+               if (h > 1) {
+                  // Centers of the squares of size h on both sides of the hypotenuse
+                  const long q = h / 2;
+                  for (const long dy : {-q, q}) {
+                     if (y + dy < 0 || y + dy > n) continue;
+                     value = std::max({value, error(x - q, y + dy), error(x + q, y + dy)});
+                  }
+               }
+               errors[y * stride + x] = value;
+            }
+         }
+      });
+      perlin::parallelFor(0, n / (2 * h), minBand, [&](const std::size_t begin, const std::size_t end) {
+         for (std::size_t row = begin; row < end; ++row) {
+            const long y = (2 * row + 1) * h;
+            for (long x = h; x <= n; x += 2 * h) {
+               float value;
+               if (crosses(x - h, x + h, numX) || crosses(y - h, y + h, numY)) {
+                  value = infinity;
+               } else if (((x / (2 * h)) + (y / (2 * h))) % 2 == 0) {
+                  value = interpolationError(x, y, x - h, y - h, x + h, y + h); // diagonal of the square
+               } else {
+                  value = interpolationError(x, y, x + h, y - h, x - h, y + h); // anti-diagonal
+               }
+               errors[y * stride + x] = std::max({value, error(x - h, y), error(x + h, y), error(x, y - h), error(x, y + h)});
+            }
+         }
+      });
+   }
+
+   for (const float value : errors) {
+      if (value != infinity) {
+         largestError = std::max(largestError, value);
+      }
+   }
+}
+
+bool Rtin::outside(const Triangle& t) const {
+   return std::min({t.ax, t.bx, t.cx}) >= sizeX - 1 || std::min({t.ay, t.by, t.cy}) >= sizeY - 1;
+}
+
+bool Rtin::split(const Triangle& t, const float maxError) const {
+   const unsigned mx = (t.ax + t.bx) / 2;
+   const unsigned my = (t.ay + t.by) / 2;
+   const unsigned leg = (t.ax > t.cx ? t.ax - t.cx : t.cx - t.ax) + (t.ay > t.cy ? t.ay - t.cy : t.cy - t.ay);
+   return leg > 1 && errors[std::size_t(my) * (size + 1) + mx] > maxError;
+}
+
+template <typename Emit>
+void Rtin::visit(const Triangle& t, const float maxError, Emit& emit) const {
+   if (outside(t)) return;
+   if (!split(t, maxError)) {
+      emit(t);
+      return;
+   }
+   const unsigned mx = (t.ax + t.bx) / 2;
+   const unsigned my = (t.ay + t.by) / 2;
+   visit(Triangle{t.cx, t.cy, t.ax, t.ay, mx, my}, maxError, emit);
+   visit(Triangle{t.bx, t.by, t.cx, t.cy, mx, my}, maxError, emit);
+}
+
+std::vector<Rtin::Triangle> Rtin::tasks(const float maxError, std::vector<Triangle>& leaves) const {
+   std::vector<Triangle> current{{0, 0, size, size, size, 0}, {size, size, 0, 0, 0, size}};
+   for (unsigned depth = 0; depth < taskDepth && !current.empty(); ++depth) {
+      std::vector<Triangle> next;
+      for (const Triangle& t : current) {
+         if (outside(t)) continue;
+         if (!split(t, maxError)) {
+            leaves.push_back(t);
+            continue;
+         }
+         const unsigned mx = (t.ax + t.bx) / 2;
+         const unsigned my = (t.ay + t.by) / 2;
+         next.push_back({t.cx, t.cy, t.ax, t.ay, mx, my});
+         next.push_back({t.bx, t.by, t.cx, t.cy, mx, my});
+      }
+      current = std::move(next);
+   }
+   return current;
+}
+
+std::vector<GLuint> Rtin::triangulate(const float maxError) const {
+   std::vector<Triangle> leaves;
+   const std::vector<Triangle> roots = tasks(maxError, leaves);
+
+   // Every task fills its own list, they are concatenated in order so the result does not depend on the threads
+   std::vector<std::vector<GLuint>> parts(roots.size() + 1);
+   auto emitInto = [this](std::vector<GLuint>& out) {
+      return [this, &out](const Triangle& t) {
+         // c before b: the root triangles run clockwise in (x, z), the grid triangles counterclockwise
+         out.push_back(t.ay * sizeX + t.ax);
+         out.push_back(t.cy * sizeX + t.cx);
+         out.push_back(t.by * sizeX + t.bx);
+      };
+   };
+   auto emitLeaf = emitInto(parts[roots.size()]);
+   for (const Triangle& t : leaves) {
+      emitLeaf(t);
+   }
+   perlin::parallelFor(0, roots.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t k = begin; k < end; ++k) {
+         auto emit = emitInto(parts[k]);
+         visit(roots[k], maxError, emit);
+      }
+   });
+
+   std::size_t total = 0;
+   for (const auto& part : parts) {
+      total += part.size();
+   }
+   std::vector<GLuint> triangles;
+   triangles.reserve(total);
+   for (const auto& part : parts) {
+      triangles.insert(triangles.end(), part.begin(), part.end());
+   }
+   return triangles;
+}
+
+std::size_t Rtin::countTriangles(const float maxError) const {
+   std::vector<Triangle> leaves;
+   const std::vector<Triangle> roots = tasks(maxError, leaves);
+   std::vector<std::size_t> counts(roots.size(), 0);
+   perlin::parallelFor(0, roots.size(), 1, [&](const std::size_t begin, const std::size_t end) {
+      for (std::size_t k = begin; k < end; ++k) {
+         auto count = [&counts, k](const Triangle&) { ++counts[k]; };
+         visit(roots[k], maxError, count);
+      }
+   });
+   std::size_t total = leaves.size();
+   for (const std::size_t count : counts) {
+      total += count;
+   }
+   return total;
+}
+
+float Rtin::errorForBudget(const std::size_t maxTriangles) const {
+   // The number of triangles only decreases with the threshold, at largestError only the triangles forced by the border are left
+   float low = 0.0f, high = largestError;
+   if (countTriangles(low) <= maxTriangles) return low;
+   for (int iteration = 0; iteration < 24 && high - low > 1e-7f; ++iteration) {
+      const float middle = 0.5f * (low + high);
+      if (countTriangles(middle) <= maxTriangles) {
+         high = middle;
+      } else {
+         low = middle;
+      }
+   }
+   return high;
+}
@@ -4,9 +4,9 @@ VAO::VAO() {
    glGenVertexArrays(1, &ID);
 }
 
-void VAO::LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset) {
+void VAO::LinkAttrib(VBO& VBO, GLuint layout, GLuint numComponents, GLenum type, GLsizeiptr stride, void* offset, GLboolean normalized) {
    VBO.Bind();
-   glVertexAttribPointer(layout, numComponents, type, GL_FALSE, stride, offset);
+   glVertexAttribPointer(layout, numComponents, type, normalized, stride, offset);
    glEnableVertexAttribArray(layout);
    VBO.Unbind();
 }
@@ -20,5 +20,8 @@ void VAO::Unbind() {
 }
 
 void VAO::Delete() {
-   glDeleteVertexArrays(1, &ID);
+   if (ID != 0) {
+      glDeleteVertexArrays(1, &ID);
+      ID = 0;
+   }
 }
\ No newline at end of file
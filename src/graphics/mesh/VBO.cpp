@@ -1,9 +1,55 @@
 #include "VBO.hpp"
 
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float signNotZero(const float value) {
+   return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+} // namespace
+
+void packNormal(const glm::vec3& normal, std::int16_t packed[2]) {
+   // Project onto the octahedron |x| + |y| + |z| = 1, the plane of the square is xz since y points up
+   const float invL1 = 1.0f / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+   float u = normal.x * invL1;
+   float v = normal.z * invL1;
+   if (normal.y < 0.0f) {
+      const float foldedU = (1.0f - std::abs(v)) * signNotZero(u);
+      v = (1.0f - std::abs(u)) * signNotZero(v);
+      u = foldedU;
+   }
+   packed[0] = static_cast<std::int16_t>(std::round(glm::clamp(u, -1.0f, 1.0f) * 32767.0f));
+   packed[1] = static_cast<std::int16_t>(std::round(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+
+glm::vec3 unpackNormal(const std::int16_t packed[2]) {
+   const float u = std::max(packed[0] / 32767.0f, -1.0f);
+   const float v = std::max(packed[1] / 32767.0f, -1.0f);
+   glm::vec3 normal(u, 1.0f - std::abs(u) - std::abs(v), v);
+   const float fold = std::max(-normal.y, 0.0f);
+   normal.x += normal.x >= 0.0f ? -fold : fold;
+   normal.z += normal.z >= 0.0f ? -fold : fold;
+   return glm::normalize(normal);
+}
+
 VBO::VBO(std::vector<Vertex>& vertices) {
-   glGenBuffers(1, &ID);
+   Data(vertices.data(), vertices.size() * sizeof(Vertex), GL_DYNAMIC_DRAW);
+}
+
+void VBO::Data(const void* data, GLsizeiptr size, GLenum usage) {
+   if (ID == 0) {
+      glGenBuffers(1, &ID);
+   }
    glBindBuffer(GL_ARRAY_BUFFER, ID);
-   glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_DYNAMIC_DRAW);
+   glBufferData(GL_ARRAY_BUFFER, size, data, usage);
+}
+
+void VBO::SubData(GLintptr offset, GLsizeiptr size, const void* data) {
+   glBindBuffer(GL_ARRAY_BUFFER, ID);
+   glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
 }
 
 void VBO::Bind() {
@@ -15,5 +61,8 @@ void VBO::Unbind() {
 }
 
 void VBO::Delete() {
-   glDeleteBuffers(1, &ID);
-}
\ No newline at end of file
+   if (ID != 0) {
+      glDeleteBuffers(1, &ID);
+      ID = 0;
+   }
+}
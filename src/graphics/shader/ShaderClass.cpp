@@ -62,14 +62,31 @@ std::string get_file_contents(std::string filename) {
    throw std::system_error(errno, std::generic_category(), "Error reading shader files " + filename);
 }
 
+std::string resolve_includes(const std::string& contents) {
+   // Lines '#include "<file>"' are replaced by the file from the shader directory
+   std::regex includeRegex(R"re(\s*#include\s+"([^"]+)"\s*)re");
+   std::istringstream in(contents);
+   std::string result, line;
+   std::smatch match;
+   while (std::getline(in, line)) {
+      if (std::regex_match(line, match, includeRegex)) {
+         result += get_file_contents(std::string(SHADER_ROOT) + "/" + match[1].str());
+      } else {
+         result += line;
+      }
+      result += '\n';
+   }
+   return result;
+}
+
 Shader::Shader() {
    ID = -1;
    name = "";
 }
 
 Shader::Shader(const std::string& vertexFile, const std::string& fragmentFile) {
-   std::string vertexCode = get_file_contents(std::string(SHADER_ROOT) + "/" + vertexFile);
-   std::string fragmentCode = get_file_contents(std::string(SHADER_ROOT) + "/" + fragmentFile);
+   std::string vertexCode = resolve_includes(get_file_contents(std::string(SHADER_ROOT) + "/" + vertexFile));
+   std::string fragmentCode = resolve_includes(get_file_contents(std::string(SHADER_ROOT) + "/" + fragmentFile));
 
    // userFloatUniforms = parse_uniform_float_names(vertexCode);
    // userFloatValues.resize(userFloatUniforms.size());
@@ -1,6 +1,6 @@
 #include "GUI.hpp"
 
-GUI::GUI(Window& window) : window(window), shaderManager(shaders), fuse(200, 8, 4) {
+GUI::GUI(Window& window) : window(window), shaderManager(shaders) {
    if (!window.getWindow()) {
       throw std::runtime_error("GLFW window is null in GUI constructor!");
    }
@@ -41,16 +41,20 @@ void GUI::RenderCommonImGui(Terrain& terrain, float fps) {
    setGUIHovered(ImGui::IsWindowHovered());
 
    DisplayMode();
+   ImGui::Text(terrain.isBuilding() ? "Terrain: updating..." : "Terrain: up to date");
    MeshSettings();
    if (is3DMode) {
       ShaderDropdown3D();
+      IndexFormatDropdown(terrain);
+      LodSettings(terrain);
    } else {
       ShaderDropdown2D();
    }
 
    ImGui::Text("\n");
    UserShaderParameters();
-   NoiseLayersGui(terrain, fuse);
+   NoiseLayersGui(terrain);
+   PostProcessGui(terrain);
    JSON_IO(terrain);
 }
 
@@ -208,33 +212,96 @@ NOTE: Cursor must be in the rendering area
 }
 
 /**
- * Renders the save to file options for 3D mode in the ImGui window. (obj)
- * @param mesh Mesh to be saved to a file
+ * Renders the save to file options for 3D mode in the ImGui window. (obj, full or simplified)
+ * @param terrain Terrain whose mesh is saved to a file
  * @author SD
  */
-void GUI::SaveToFile3D(Mesh& mesh) {
-   ImGui::Text("\nSave Current Object to .obj\n");
+void GUI::SaveToFile3D(Terrain& terrain) {
+   ImGui::Text("\nSave Current Object\n");
    static char _user_save_path[256] = "";
    ImGui::InputText("Filename", _user_save_path, sizeof(_user_save_path));
-   auto filename = std::string(OUTPUT_FOLDER_PATH) + "/" + _user_save_path + ".obj";
-   if (ImGui::Button("Save to .obj")) {
-      if (std::filesystem::exists(filename)) {
-         // Create pop up to ask if they want to overwrite the file
-         ImGui::OpenPopup("ConfirmOBJOverwrite");
+   auto filename = std::string(OUTPUT_FOLDER_PATH) + "/" + _user_save_path;
+
+   // Adaptive triangulation with fewer triangles where the terrain is flat
+   const char* details[] = {"Full grid", "Max error", "Triangle budget"};
+   ImGui::SetNextItemWidth(180.f);
+   bool detailChanged = ImGui::Combo("Detail", &exportDetail, details, IM_ARRAYSIZE(details));
+   if (exportDetail == 1) {
+      ImGui::SetNextItemWidth(180.f);
+      detailChanged |= ImGui::InputFloat("Max error", &exportMaxError, 0.0005f, 0.005f, "%.4f");
+      exportMaxError = std::max(exportMaxError, 0.0f);
+   } else if (exportDetail == 2) {
+      ImGui::SetNextItemWidth(180.f);
+      detailChanged |= ImGui::InputInt("Triangles", &exportTriangleBudget, 10000, 100000);
+      exportTriangleBudget = std::max(exportTriangleBudget, 2);
+   }
+   if (exportDetail != 0) {
+      detailChanged |= ImGui::Checkbox("Preview simplified mesh", &previewSimplified);
+   }
+   if (detailChanged) {
+      const bool preview = exportDetail != 0 && previewSimplified;
+      terrain.setRenderSimplification(preview, preview ? ExportMaxError(terrain) : 0.0f);
+   }
+
+   // Smaller files: fewer digits, no normals or texture coordinates
+   ImGui::SetNextItemWidth(180.f);
+   ImGui::InputInt("Digits (0: exact)", &objOptions.precision);
+   objOptions.precision = std::clamp(objOptions.precision, 0, 9);
+   ImGui::Checkbox("Normals", &objOptions.normals);
+   ImGui::SameLine();
+   ImGui::Checkbox("UVs", &objOptions.texCoords);
+
+   // Binary files: quantized glTF attributes or the vertex buffer of the mesh as it is in .ply
+   ImGui::Checkbox("Compact (.glb, .ply)", &binaryMeshOptions.compact);
+   binaryMeshOptions.normals = objOptions.normals;
+   binaryMeshOptions.texCoords = objOptions.texCoords;
+
+   auto save = [&](const std::string& extension) {
+      const Mesh& mesh = terrain.getMesh();
+      // The full triangle list is only built for the export, grid meshes draw from the shared GPU indices
+      std::shared_ptr<const std::vector<GLuint>> full;
+      std::vector<GLuint> simplified;
+      if (exportDetail != 0) {
+         simplified = terrain.simplify(ExportMaxError(terrain));
       } else {
-         ExportToObj(mesh, filename);
-         operationCompleted = true;
+         full = mesh.triangles();
+      }
+      const std::vector<GLuint>& triangles = exportDetail == 0 ? *full : simplified;
+      if (extension == ".obj") {
+         ExportToObj(mesh, filename + extension, triangles, objOptions);
+      } else if (extension == ".glb") {
+         ExportToGlb(mesh, filename + extension, triangles, binaryMeshOptions);
+      } else {
+         ExportToPly(mesh, filename + extension, triangles, binaryMeshOptions);
+      }
+      operationCompleted = true;
+   };
+   const std::string extensions[] = {".obj", ".glb", ".ply"};
+   for (const std::string& extension : extensions) {
+      if (&extension != &extensions[0]) {
+         ImGui::SameLine();
+      }
+      if (ImGui::Button(("Save to " + extension).c_str())) {
+         if (std::filesystem::exists(filename + extension)) {
+            // Create pop up to ask if they want to overwrite the file
+            pendingMeshExtension = extension;
+            ImGui::OpenPopup("ConfirmMeshOverwrite");
+         } else {
+            save(extension);
+         }
       }
    }
 
-   YesNoPopup("ConfirmOBJOverwrite", "You already have a file named this, do you want to overwrite it?", [&]() {
-      ExportToObj(mesh, filename);
-      operationCompleted = true;
-   });
+   YesNoPopup("ConfirmMeshOverwrite", "You already have a file named this, do you want to overwrite it?",
+              [&]() { save(pendingMeshExtension); });
+}
+
+float GUI::ExportMaxError(Terrain& terrain) {
+   return exportDetail == 2 ? terrain.errorForTriangleBudget(exportTriangleBudget) : exportMaxError;
 }
 
 /**
- * Renders the save to file options for 2D mode in the ImGui window. (png and ppm)
+ * Renders the save to file options for 2D mode in the ImGui window. (png and ppm, and 16-bit or float heightmaps)
  * @param mesh Mesh to be saved to a file
  * @author PK
  */
@@ -272,6 +339,91 @@ void GUI::SaveToFile2D(Mesh& mesh) {
       mesh.exportToPPM(filename + ".ppm");
       operationCompleted = true;
    });
+
+   // Heightmaps with 16-bit or float precision, read straight from the heights of the grid
+   const char* formats[] = {"16-bit .png", "16-bit .pgm", "Raw .r16", "Raw .f32"};
+   const char* extensions[] = {".png", ".pgm", ".r16", ".f32"};
+   ImGui::SetNextItemWidth(180.f);
+   ImGui::Combo("Heightmap", &heightmapFormat, formats, IM_ARRAYSIZE(formats));
+   ImGui::Checkbox("Fit height range", &heightmapFitRange);
+   if (heightmapFormat == 0) {
+      ImGui::SameLine();
+      ImGui::Checkbox("Fast compression", &heightmapOptions.fast);
+   }
+   const std::string heightmapFile = filename + extensions[heightmapFormat];
+   auto saveHeightmap = [&]() {
+      const HeightGrid grid = HeightGrid::of(mesh);
+      HeightmapOptions options = heightmapOptions;
+      if (heightmapFitRange) {
+         std::tie(options.low, options.high) = heightRange(grid);
+      }
+      switch (heightmapFormat) {
+         case 0: ExportHeightmapPng(grid, heightmapFile, options); break;
+         case 1: ExportHeightmapNetpbm(grid, heightmapFile, NetpbmFormat::PGM, 16, options); break;
+         case 2: ExportHeightmapRaw(grid, heightmapFile, RawHeightFormat::R16, options); break;
+         default: ExportHeightmapRaw(grid, heightmapFile, RawHeightFormat::F32, options); break;
+      }
+      operationCompleted = true;
+   };
+   if (ImGui::Button("Save heightmap")) {
+      if (std::filesystem::exists(heightmapFile)) {
+         // Create pop up to ask if they want to overwrite the file
+         ImGui::OpenPopup("ConfirmHeightmapOverwrite");
+      } else {
+         saveHeightmap();
+      }
+   }
+
+   YesNoPopup("ConfirmHeightmapOverwrite", "You already have a file named this, do you want to overwrite it?", saveHeightmap);
+}
+
+/**
+ * Renders the export of the terrain as a pyramid of heightmap tiles, at any map size (see ExportTilePyramid).
+ * The height range is that of the heightmap export, fitted to the current map if chosen there.
+ * @param terrain Terrain whose settings are exported
+ * @author SD
+ */
+void GUI::SaveTilePyramid(Terrain& terrain) {
+   if (!ImGui::CollapsingHeader("Tile Pyramid")) return;
+   if (terrain.hasGraph() || terrain.getPostProcessParams().anyEnabled()) {
+      ImGui::Text("Tiles are computed from the layers,\nnot available with a graph or erosion and smoothing.");
+      return;
+   }
+   static char _user_save_path[256] = "tiles";
+   ImGui::InputText("Folder", _user_save_path, sizeof(_user_save_path));
+   const std::string directory = std::string(OUTPUT_FOLDER_PATH) + "/" + _user_save_path;
+   ImGui::SetNextItemWidth(110.f);
+   InputUnsigned("Map width", &tilePyramidSizeX, 1024, 16384);
+   ImGui::SetNextItemWidth(110.f);
+   InputUnsigned("Map height", &tilePyramidSizeY, 1024, 16384);
+   const char* tileSizes[] = {"128", "256", "512"};
+   ImGui::SetNextItemWidth(110.f);
+   ImGui::Combo("Tile size", &tilePyramidTileSize, tileSizes, IM_ARRAYSIZE(tileSizes));
+   const char* formats[] = {"16-bit .png", "Raw .r16", "Raw .f32"};
+   ImGui::SetNextItemWidth(110.f);
+   ImGui::Combo("Tile format", &tilePyramidFormat, formats, IM_ARRAYSIZE(formats));
+
+   auto save = [&]() {
+      TileExportOptions options;
+      options.tileSize = 128u << tilePyramidTileSize;
+      options.format = static_cast<TileFormat>(tilePyramidFormat);
+      options.heightmap = heightmapOptions;
+      if (heightmapFitRange && terrain.hasMesh()) {
+         std::tie(options.heightmap.low, options.heightmap.high) = heightRange(HeightGrid::of(terrain.getMesh()));
+      }
+      ExportTilePyramid(terrain.getSettings(), std::max(tilePyramidSizeX, 1u), std::max(tilePyramidSizeY, 1u), directory, options);
+      operationCompleted = true;
+   };
+   if (ImGui::Button("Export tiles")) {
+      if (std::filesystem::exists(directory + "/manifest.json")) {
+         // Create pop up to ask if they want to overwrite the pyramid
+         ImGui::OpenPopup("ConfirmTilesOverwrite");
+      } else {
+         save();
+      }
+   }
+
+   YesNoPopup("ConfirmTilesOverwrite", "This folder already has a tile pyramid, do you want to overwrite it?", save);
 }
 
 /**
@@ -292,12 +444,23 @@ void GUI::SaveJSON(Terrain& terrain, std::string filename) {
    }
 
    j["noiseParams"] = nlohmann::json::array();
-   for (auto& layerParam : terrain.getNoiseParams()) {
-      j["noiseParams"].push_back({{"chunkSize", layerParam.first}, {"weight", layerParam.second}});
+   for (unsigned i = 0; i < terrain.getNoiseParams().size(); ++i) {
+      const auto& layerParam = terrain.getNoiseParams()[i];
+      const auto& warp = terrain.getNoiseWarps()[i];
+      j["noiseParams"].push_back({{"chunkSize", layerParam.first}, {"weight", layerParam.second}, {"warpChunkSize", warp.chunkSize}, {"warpAmplitude", warp.amplitude}});
    }
    j["baselineParams"] = nlohmann::json::array();
-   for (auto& layerParam : terrain.getBaselineParams()) {
-      j["baselineParams"].push_back({{"chunkSize", layerParam.first}, {"weight", layerParam.second}});
+   for (unsigned i = 0; i < terrain.getBaselineParams().size(); ++i) {
+      const auto& layerParam = terrain.getBaselineParams()[i];
+      const auto& warp = terrain.getBaselineWarps()[i];
+      j["baselineParams"].push_back({{"chunkSize", layerParam.first}, {"weight", layerParam.second}, {"warpChunkSize", warp.chunkSize}, {"warpAmplitude", warp.amplitude}});
+   }
+
+   postProcessToJson(postProcessParams, j);
+
+   // A custom node graph is stored alongside the layer parameters
+   if (terrain.hasGraph()) {
+      j["graph"] = terrain.getGraphJson();
    }
 
    std::ofstream file(filename, std::ios::trunc);
@@ -331,11 +494,29 @@ void GUI::LoadJSON(Terrain& terrain, std::string filename) {
    for (unsigned i = 0; i < noiseParams.size(); ++i) {
       terrain.getNoiseParams()[i].first = noiseParams[i]["chunkSize"];
       terrain.getNoiseParams()[i].second = noiseParams[i]["weight"];
+      terrain.getNoiseWarps()[i].chunkSize = noiseParams[i].value("warpChunkSize", 0u);
+      terrain.getNoiseWarps()[i].amplitude = noiseParams[i].value("warpAmplitude", 0.0);
    }
    auto baselineParams = j["baselineParams"];
    for (unsigned i = 0; i < baselineParams.size(); ++i) {
       terrain.getBaselineParams()[i].first = baselineParams[i]["chunkSize"];
       terrain.getBaselineParams()[i].second = baselineParams[i]["weight"];
+      terrain.getBaselineWarps()[i].chunkSize = baselineParams[i].value("warpChunkSize", 0u);
+      terrain.getBaselineWarps()[i].amplitude = baselineParams[i].value("warpAmplitude", 0.0);
+   }
+
+   postProcessParams = postProcessFromJson(j, postProcessParams);
+   terrain.setPostProcessParams(postProcessParams);
+   terrain.scheduleBuild(); // the layer parameters were changed in place
+
+   if (j.contains("graph")) {
+      try {
+         terrain.setGraph(TerrainGraph::fromJson(j["graph"], terrain.getSizeX(), terrain.getSizeY()));
+      } catch (const std::invalid_argument& e) {
+         std::cerr << "Invalid terrain graph in " << filename << ": " << e.what() << std::endl;
+      }
+   } else {
+      terrain.clearGraph();
    }
 
    Shader* shader = shaderManager.getShader(j["shader"]);
@@ -377,6 +558,79 @@ void GUI::JSON_IO(Terrain& terrain) {
       SaveJSON(terrain, filename);
       operationCompleted = true;
    });
+
+   // Binary snapshot of the whole terrain, loading it skips the generation
+   const std::string snapshotFile = std::string(OUTPUT_FOLDER_PATH) + "/" + _user_save_path + ".tsnap";
+   ImGui::Checkbox("Include mesh", &snapshotWithMesh);
+   ImGui::SameLine();
+   if (ImGui::Button("Save snapshot")) {
+      if (std::filesystem::exists(snapshotFile)) {
+         ImGui::OpenPopup("ConfirmSnapshotOverwrite");
+      } else {
+         SaveSnapshot(terrain, snapshotFile);
+      }
+   }
+   ImGui::SameLine();
+   if (ImGui::Button("Load snapshot")) {
+      ImGui::OpenPopup("ConfirmSnapshotLoad");
+   }
+
+   YesNoPopup("ConfirmSnapshotLoad", "This will irreversibly overwrite your current terrain!", [&]() {
+      LoadSnapshot(terrain, snapshotFile);
+   });
+   YesNoPopup("ConfirmSnapshotOverwrite", "You already have a file named this, do you want to overwrite it?", [&]() {
+      SaveSnapshot(terrain, snapshotFile);
+   });
+}
+
+/**
+ * Saves the terrain with its layers and mesh to a snapshot file, the settings of the GUI are stored with it.
+ * @param terrain Terrain to be saved, nothing is saved while it is being built
+ * @param filename Absolute path to the snapshot file
+ * @author SD
+ */
+void GUI::SaveSnapshot(Terrain& terrain, const std::string& filename) {
+   nlohmann::json extra;
+   extra["is3DMode"] = is3DMode;
+   extra["shader"] = currentVertexShader;
+   extra["shaderParams"] = nlohmann::json::object();
+   const Shader& shader = shaderManager.getCurrentShader();
+   for (unsigned i = 0; i < shader.userFloatValues.size(); i++) {
+      extra["shaderParams"][shader.userFloatUniforms[i]] = shader.userFloatValues[i];
+   }
+   operationCompleted = terrain.saveSnapshot(filename, extra, snapshotWithMesh);
+}
+
+/**
+ * Loads a snapshot saved by SaveSnapshot, the terrain is drawn without being generated again.
+ * @param terrain Terrain to be replaced
+ * @param filename Absolute path to the snapshot file
+ * @author SD
+ */
+void GUI::LoadSnapshot(Terrain& terrain, const std::string& filename) {
+   nlohmann::json extra;
+   try {
+      extra = terrain.loadSnapshot(filename);
+   } catch (const std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      return;
+   }
+   // The values the GUI edits follow the terrain, so they do not schedule a build
+   const TerrainSettings settings = terrain.getSettings();
+   seed = previousSeed = settings.seed;
+   flattenFactor = lastFlattenFactor = settings.flattenFactor;
+   postProcessParams = settings.postProcessParams;
+   is3DMode = extra.value("is3DMode", is3DMode);
+   if (extra.contains("shader") && shaderManager.getShader(extra["shader"])) {
+      previousVertexShader = currentVertexShader;
+      currentVertexShader = extra["shader"];
+      shaderManager.SwitchShader(currentVertexShader);
+      Shader* shader = shaderManager.getShader(currentVertexShader);
+      for (unsigned i = 0; i < shader->userFloatValues.size(); i++) {
+         shader->userFloatValues[i] = extra["shaderParams"].value(shader->userFloatUniforms[i], shader->userFloatValues[i]);
+      }
+   }
+   operationCompleted = true;
 }
 
 /**
@@ -425,6 +679,40 @@ void GUI::MeshSettings() {
    ImGui::Text("Flatten Factor");
 }
 
+/**
+ * Lets the user choose how the grid is sent to the GPU. All formats draw the same triangles.
+ * @author SD
+ */
+void GUI::IndexFormatDropdown(Terrain& terrain) {
+   const char* modes[] = {"Triangles (32-bit)", "Strips (32-bit)", "Row patches (16-bit)"};
+   int mode = static_cast<int>(terrain.getIndexMode());
+   ImGui::SetNextItemWidth(180.f);
+   if (ImGui::Combo("Index format", &mode, modes, IM_ARRAYSIZE(modes))) {
+      terrain.setIndexMode(static_cast<IndexMode>(mode));
+   }
+}
+
+void GUI::LodSettings(Terrain& terrain) {
+   ImGui::Checkbox("Level of detail", &lodEnabled);
+   PatchStats stats;
+   if (lodEnabled) {
+      float distance = terrain.getLodDetailDistance();
+      ImGui::SetNextItemWidth(180.f);
+      if (ImGui::SliderFloat("Detail distance", &distance, 0.05f, 2.0f)) {
+         terrain.setLodDetailDistance(distance);
+      }
+      stats = terrain.getLodStats();
+   } else {
+      bool culling = terrain.isFrustumCulling();
+      if (ImGui::Checkbox("Frustum culling", &culling)) {
+         terrain.setFrustumCulling(culling);
+      }
+      stats = terrain.getDrawStats();
+   }
+   ImGui::Text("Drawn: %u patches, %lu triangles", stats.patches, stats.triangles);
+   ImGui::Text("Culled: %u patches, %lu triangles", stats.culledPatches, stats.culledTriangles);
+}
+
 bool GUI::InputUnsigned(const char* label, unsigned int* v, unsigned int step, unsigned int step_fast, ImGuiInputTextFlags flags) {
    int value = static_cast<int>(*v); // Cast to signed for ImGui input
    bool changed = ImGui::InputInt(label, &value, static_cast<int>(step), static_cast<int>(step_fast), flags);
@@ -437,22 +725,30 @@ bool GUI::InputUnsigned(const char* label, unsigned int* v, unsigned int step, u
    return changed;
 }
 
-void GUI::NoiseLayersGui(Terrain& terrain, Fuse& fuse) {
+void GUI::NoiseLayersGui(Terrain& terrain) {
    if (ImGui::CollapsingHeader("Noise Parameters")) {
+      if (terrain.hasGraph()) {
+         ImGui::Text("Custom node graph active (%zu nodes),\nlayer parameters below are not used.", terrain.getGraphNodeCount());
+         if (ImGui::Button("Use layer stacks")) {
+            terrain.clearGraph();
+         }
+      } else if (ImGui::Button("Convert layers to node graph")) {
+         terrain.setGraph(terrain.layersToGraph());
+      }
       unsigned index = 0;
       ImGui::Text("Chunk Size       Weight");
       for (auto& layerParam : terrain.getNoiseParams()) {
          ImGui::PushID(uselessIDcounter++);
          ImGui::SetNextItemWidth(110.f);
          if (InputUnsigned("##xx", &layerParam.first, 10, 100)) {
-            fuse.planLayerUpdate(index, NOISE_LAYER, CHUNK_SIZE);
+            terrain.scheduleBuild();
          }
          ImGui::PopID();
          ImGui::SameLine();
          ImGui::PushID(uselessIDcounter++);
          ImGui::SetNextItemWidth(110.f);
          if (ImGui::InputDouble("##xx", &layerParam.second, 1.0, 10.0, "%.1f")) {
-            fuse.planLayerUpdate(index, NOISE_LAYER, WEIGHT);
+            terrain.scheduleBuild();
          }
          ImGui::PopID();
          index++;
@@ -463,18 +759,126 @@ void GUI::NoiseLayersGui(Terrain& terrain, Fuse& fuse) {
          ImGui::PushID(uselessIDcounter++);
          ImGui::SetNextItemWidth(110.f);
          if (InputUnsigned("##xx", &layerParam.first, 10, 100)) {
-            fuse.planLayerUpdate(index, BASELINE_LAYER, CHUNK_SIZE);
+            terrain.scheduleBuild();
          }
          ImGui::PopID();
          ImGui::SameLine();
          ImGui::PushID(uselessIDcounter++);
          ImGui::SetNextItemWidth(110.f);
          if (ImGui::InputDouble("##xx", &layerParam.second, 1.0, 10.0, "%.1f")) {
-            fuse.planLayerUpdate(index, BASELINE_LAYER, WEIGHT);
+            terrain.scheduleBuild();
          }
          ImGui::PopID();
          index++;
       }
+      WarpGui(terrain.getNoiseWarps(), "Noise Layer Warp", terrain);
+      WarpGui(terrain.getBaselineWarps(), "Baseline Layer Warp", terrain);
+      bool quantized = terrain.getLayerStorage() == perlin::LayerStorage::QUANTIZED16;
+      if (ImGui::Checkbox("16-bit layers (less memory)", &quantized)) {
+         terrain.setLayerStorage(quantized ? perlin::LayerStorage::QUANTIZED16 : perlin::LayerStorage::DOUBLE);
+      }
+   }
+}
+
+/**
+ * Domain warp of each layer of a stack: the chunk size of the displacement noise (0 = off) and its amplitude in cells.
+ * A change recomputes the layer like a change of its chunk size.
+ * @param warps Warp parameters of the layers, edited in place
+ * @param title Section title
+ * @param terrain Rebuilt once the edits settle
+ */
+void GUI::WarpGui(std::vector<perlin::WarpParams>& warps, const char* title, Terrain& terrain) {
+   if (ImGui::TreeNode(title)) {
+      ImGui::Text("Warp Chunk Size  Amplitude");
+      for (unsigned index = 0; index < warps.size(); ++index) {
+         ImGui::PushID(uselessIDcounter++);
+         ImGui::SetNextItemWidth(110.f);
+         if (InputUnsigned("##xx", &warps[index].chunkSize, 10, 100)) {
+            terrain.scheduleBuild();
+         }
+         ImGui::PopID();
+         ImGui::SameLine();
+         ImGui::PushID(uselessIDcounter++);
+         ImGui::SetNextItemWidth(110.f);
+         if (ImGui::InputDouble("##xx", &warps[index].amplitude, 1.0, 10.0, "%.1f")) {
+            terrain.scheduleBuild();
+         }
+         ImGui::PopID();
+      }
+      ImGui::TreePop();
+   }
+}
+
+/**
+ * Controls of the erosion and smoothing stages, which run on the combined heightfield before the mesh is built.
+ * Changes are handed to the terrain at once, it rebuilds when the edits settle.
+ * @param terrain Terrain whose post-processing is edited
+ */
+void GUI::PostProcessGui(Terrain& terrain) {
+   if (ImGui::CollapsingHeader("Erosion and Smoothing")) {
+      bool changed = false;
+      auto& hydraulic = postProcessParams.hydraulic;
+      changed |= ImGui::Checkbox("Hydraulic erosion", &hydraulic.enabled);
+      if (hydraulic.enabled) {
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Droplets", &hydraulic.droplets, 10000, 100000);
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Droplet seed", &hydraulic.seed);
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Lifetime", &hydraulic.maxLifetime, 1, 10);
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Brush radius", &hydraulic.radius);
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Inertia", &hydraulic.inertia, 0.01, 0.1, "%.2f");
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Capacity", &hydraulic.sedimentCapacity, 0.5, 2.0, "%.1f");
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Erode speed", &hydraulic.erodeSpeed, 0.05, 0.1, "%.2f");
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Deposit speed", &hydraulic.depositSpeed, 0.05, 0.1, "%.2f");
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Evaporation", &hydraulic.evaporateSpeed, 0.005, 0.05, "%.3f");
+      }
+
+      auto& thermal = postProcessParams.thermal;
+      changed |= ImGui::Checkbox("Thermal erosion", &thermal.enabled);
+      if (thermal.enabled) {
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Thermal iterations", &thermal.iterations, 1, 10);
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Talus slope", &thermal.talusSlope, 0.1, 0.5, "%.2f");
+         ImGui::SetNextItemWidth(110.f);
+         changed |= ImGui::InputDouble("Rate", &thermal.rate, 0.05, 0.1, "%.2f");
+      }
+
+      auto& smoothing = postProcessParams.smoothing;
+      changed |= ImGui::Checkbox("Smoothing", &smoothing.enabled);
+      if (smoothing.enabled) {
+         const char* filters[] = {"Gaussian", "Median", "Slope-limited"};
+         int filter = static_cast<int>(smoothing.filter);
+         ImGui::SetNextItemWidth(110.f);
+         if (ImGui::Combo("Filter", &filter, filters, IM_ARRAYSIZE(filters))) {
+            smoothing.filter = static_cast<perlin::SmoothingFilter>(filter);
+            changed = true;
+         }
+         ImGui::SetNextItemWidth(110.f);
+         changed |= InputUnsigned("Smoothing iterations", &smoothing.iterations, 1, 10);
+         if (smoothing.filter == perlin::SmoothingFilter::SLOPE_LIMITED) {
+            ImGui::SetNextItemWidth(110.f);
+            changed |= ImGui::InputDouble("Slope limit", &smoothing.slopeLimit, 0.1, 0.5, "%.2f");
+         }
+      }
+
+      if (changed) {
+         hydraulic.inertia = std::clamp(hydraulic.inertia, 0.0, 1.0);
+         hydraulic.erodeSpeed = std::clamp(hydraulic.erodeSpeed, 0.0, 1.0);
+         hydraulic.depositSpeed = std::clamp(hydraulic.depositSpeed, 0.0, 1.0);
+         hydraulic.evaporateSpeed = std::clamp(hydraulic.evaporateSpeed, 0.0, 1.0);
+         thermal.talusSlope = std::max(thermal.talusSlope, 0.0);
+         thermal.rate = std::clamp(thermal.rate, 0.0, 1.0);
+         smoothing.slopeLimit = std::max(smoothing.slopeLimit, 0.0);
+         terrain.setPostProcessParams(postProcessParams);
+      }
    }
 }
 
@@ -495,7 +899,9 @@ void GUI::FPSDisplay() {
  */
 void GUI::Render3DImGui(Terrain& terrain, float fps) {
    RenderCommonImGui(terrain, fps);
-   SaveToFile3D(terrain.getMesh());
+   if (terrain.hasMesh()) {
+      SaveToFile3D(terrain);
+   }
 
    ImGui::Text("\n");
    _3DInputControls();
@@ -513,7 +919,10 @@ void GUI::Render3DImGui(Terrain& terrain, float fps) {
  */
 void GUI::Render2DImGui(Terrain& terrain, float fps) {
    RenderCommonImGui(terrain, fps);
-   SaveToFile2D(terrain.getMesh());
+   if (terrain.hasMesh()) {
+      SaveToFile2D(terrain.getMesh());
+   }
+   SaveTilePyramid(terrain);
 
    ImGui::Text("\n");
    _2DInputControls();
@@ -554,30 +963,24 @@ void GUI::DisplayGUI(Terrain& terrain, float elapsedSinceLastFrame) {
 
    // // Render ImGUI
    ImGui::Render();
-   fuse.tick();
 
+   // The terrain coalesces the edits and rebuilds in the background once they settle
    if (previousSeed != seed) {
-      fuse.planSeedUpdate();
+      terrain.createFromSeed(seed);
       previousSeed = seed;
    }
    if (abs(flattenFactor - lastFlattenFactor) > 0.1) { // only do meaningful changes
-      fuse.planFlattenFactorUpdate();
-      lastFlattenFactor = flattenFactor;
-   }
-   if (fuse.isSeedUpdateNow()) {
-      terrain.createFromSeed(seed);
-   }
-   if (fuse.isFlattenFactorUpdateNow()) {
       terrain.computeMesh(flattenFactor);
-   }
-
-   if (fuse.isLayerUpdateNow()) {
-      terrain.recomputeLayers(fuse.noiseLayerUpdate, fuse.baselineLayerUpdate);
+      lastFlattenFactor = flattenFactor;
    }
 }
 
 void GUI::DrawTerrain(Terrain& terrain, Camera& camera) {
-   terrain.Draw(shaderManager.getCurrentShader(), camera);
+   if (is3DMode && lodEnabled) {
+      terrain.DrawLod(shaderManager.getCurrentShader(), camera);
+   } else {
+      terrain.Draw(shaderManager.getCurrentShader(), camera);
+   }
 }
 
 void GUI::DeleteShaderManager() {
@@ -0,0 +1,55 @@
+#include "GridNormals.hpp"
+#include "IndexCache.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+
+//-----------------------------------------------------------------------------
+
+namespace {
+
+/// @brief Grid of rolling hills with a few steep steps, so that the face normals point in many directions
+std::vector<TerrainVertex> hillyGrid(const unsigned long sizeX, const unsigned long sizeY) {
+   std::vector<TerrainVertex> vertices(sizeX * sizeY);
+   for (unsigned long j = 0; j < sizeY; ++j) {
+      for (unsigned long i = 0; i < sizeX; ++i) {
+         const float height = 0.3f * std::sin(0.21f * i) * std::cos(0.17f * j) + ((i * 7 + j * 3) % 11 == 0 ? 0.05f : 0.0f);
+         vertices[j * sizeX + i].height = height;
+      }
+   }
+   return vertices;
+}
+
+} // namespace
+
+TEST(GridNormals, SameAsTriangleScatter)
+/// SD: test if computeGridNormals gives bitwise the normals of the scatter over the IndexCache triangle list
+{
+   const unsigned long sizeX = 67, sizeY = 45;
+   std::vector<TerrainVertex> gathered = hillyGrid(sizeX, sizeY);
+   std::vector<TerrainVertex> scattered = gathered;
+   computeGridNormals(gathered, sizeX, sizeY);
+   computeTriangleNormals(scattered, sizeX, sizeY, *IndexCache::triangles(sizeX - 1, sizeY - 1));
+   for (unsigned long j = 1; j + 1 < sizeY; ++j) {
+      for (unsigned long i = 1; i + 1 < sizeX; ++i) {
+         const std::size_t k = j * sizeX + i;
+         ASSERT_EQ(gathered[k].normal[0], scattered[k].normal[0]) << "vertex (" << i << ", " << j << ")";
+         ASSERT_EQ(gathered[k].normal[1], scattered[k].normal[1]) << "vertex (" << i << ", " << j << ")";
+      }
+   }
+}
+
+TEST(GridNormals, RowsSameAsWholeGrid)
+/// SD: test if computeGridNormalRows on separate bands gives the normals of computeGridNormals
+{
+   const unsigned long sizeX = 40, sizeY = 33;
+   std::vector<TerrainVertex> whole = hillyGrid(sizeX, sizeY);
+   std::vector<TerrainVertex> bands = whole;
+   computeGridNormals(whole, sizeX, sizeY);
+   for (unsigned long begin = 0; begin < sizeY; begin += 5) {
+      computeGridNormalRows(bands, sizeX, sizeY, begin, std::min(begin + 5, sizeY));
+   }
+   for (std::size_t k = 0; k < whole.size(); ++k) {
+      ASSERT_EQ(whole[k].normal[0], bands[k].normal[0]);
+      ASSERT_EQ(whole[k].normal[1], bands[k].normal[1]);
+   }
+}
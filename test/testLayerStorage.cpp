@@ -0,0 +1,57 @@
+#include "TerrainGenerator.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+
+//-----------------------------------------------------------------------------
+
+TEST(LayerStorage, QuantizedLayerWithinMaxError)
+/// SD: test if every value of a quantized layer errs by at most QuantizedMatrix::maxError from the exact layer
+{
+   const std::vector<perlin::vec2d> gradients = TerrainGenerator::gradientsFor(17);
+   for (const unsigned chunkSize : {3u, 40u, 250u}) {
+      perlin::PerlinLayer exact(120, 90, chunkSize, 1.0, perlin::WarpParams{}, perlin::LayerStorage::DOUBLE);
+      perlin::PerlinLayer quantized(120, 90, chunkSize, 1.0, perlin::WarpParams{}, perlin::LayerStorage::QUANTIZED16);
+      exact.fill(gradients);
+      quantized.fill(gradients);
+      ASSERT_TRUE(quantized.isQuantized());
+      const double maxError = quantized.getQuantized().maxError();
+      ASSERT_LE(maxError, 1.08e-5);
+      for (unsigned x = 0; x < 120; ++x) {
+         for (unsigned y = 0; y < 90; ++y) {
+            ASSERT_LE(std::abs(quantized.value(x, y) - exact.getResult()[x][y]), maxError) << "chunk size " << chunkSize << " at (" << x << ", " << y << ")";
+         }
+      }
+   }
+}
+
+TEST(LayerStorage, GeneratedHeightsWithinBound)
+/// SD: test if the heights of quantized layers differ from the exact ones by at most 1.08e-5 * sum |w| / normalizing factor
+{
+   const unsigned size = 150;
+   TerrainSettings settings{};
+   settings.seed = 5;
+   settings.flattenFactor = 1.5;
+   settings.noiseParams = {{100, 3.0}, {30, -1.0}, {7, 0.2}};
+   settings.baselineParams = {{60, 1.0}, {20, 0.5}};
+   TerrainGenerator exactGenerator(size, size), quantizedGenerator(size, size);
+   const GridMeshData exact = exactGenerator.generate(settings);
+   settings.layerStorage = perlin::LayerStorage::QUANTIZED16;
+   const GridMeshData quantized = quantizedGenerator.generate(settings);
+
+   double absoluteWeights = 0.0, noiseWeights = 0.0;
+   for (const layerP& param : settings.noiseParams) {
+      absoluteWeights += std::abs(param.second);
+      noiseWeights += param.second;
+   }
+   for (const layerP& param : settings.baselineParams) {
+      absoluteWeights += std::abs(param.second);
+   }
+   const double bound = 1.08e-5 * absoluteWeights / (noiseWeights * settings.flattenFactor);
+   ASSERT_EQ(exact.vertices.size(), quantized.vertices.size());
+   for (std::size_t k = 0; k < exact.vertices.size(); ++k) {
+      // plus the rounding of both heights to float
+      const double rounding = 2.0 * std::numeric_limits<float>::epsilon() * std::abs(exact.vertices[k].height);
+      ASSERT_LE(std::abs(double(quantized.vertices[k].height) - exact.vertices[k].height), bound + rounding) << "vertex " << k;
+   }
+}